@@ -0,0 +1,85 @@
+#ifndef _MIPS_ATOMIC_H_
+#define _MIPS_ATOMIC_H_
+
+/*
+ * Machine-dependent part of atomic.h: single LL/SC attempts. Each
+ * returns true if its SC went through, and false if something else
+ * touched the word (or an interrupt came) in between, in which case
+ * the caller tries again.
+ *
+ * The asm has no branches, to stay clear of delay slots; CAS stores
+ * back the value it loaded when it doesn't match, which is a no-op.
+ */
+
+#include <cdefs.h>
+
+bool atomic_tryadd(volatile int *p, int inc, int *old);
+bool atomic_trycas(volatile int *p, int old, int new, int *seen);
+bool atomic_tryswap(volatile int *p, int new, int *old);
+
+////////////////////////////////////////////////////////////
+
+ATOMIC_INLINE
+bool
+atomic_tryadd(volatile int *p, int inc, int *old)
+{
+	int x, y;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		"ll %0, 0(%2);"		/*   x = *p */
+		"addu %1, %0, %3;"	/*   y = x + inc */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y) : "r" (p), "r" (inc) : "memory");
+	*old = x;
+	return y != 0;
+}
+
+ATOMIC_INLINE
+bool
+atomic_trycas(volatile int *p, int old, int new, int *seen)
+{
+	int x, y, t;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		"ll %0, 0(%3);"		/*   x = *p */
+		"xor %2, %0, %4;"	/*   t = x ^ old */
+		"sltiu %2, %2, 1;"	/*   t = (x == old) */
+		"subu %2, $0, %2;"	/*   t = t ? ~0 : 0 */
+		"xor %1, %5, %0;"	/*   y = new ^ x */
+		"and %1, %1, %2;"	/*   y &= t */
+		"xor %1, %1, %0;"	/*   y ^= x: new if matched, else x */
+		"sc %1, 0(%3);"		/*   *p = y; y = success? */
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y), "=&r" (t)
+		: "r" (p), "r" (old), "r" (new) : "memory");
+	*seen = x;
+	return y != 0;
+}
+
+ATOMIC_INLINE
+bool
+atomic_tryswap(volatile int *p, int new, int *old)
+{
+	int x, y;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		"ll %0, 0(%2);"		/*   x = *p */
+		"move %1, %3;"		/*   y = new */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y) : "r" (p), "r" (new) : "memory");
+	*old = x;
+	return y != 0;
+}
+
+#endif /* _MIPS_ATOMIC_H_ */
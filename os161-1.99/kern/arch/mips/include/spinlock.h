@@ -43,6 +43,8 @@ typedef unsigned spinlock_data_t;
 void spinlock_data_set(volatile spinlock_data_t *sd, unsigned val);
 spinlock_data_t spinlock_data_get(volatile spinlock_data_t *sd);
 spinlock_data_t spinlock_data_testandset(volatile spinlock_data_t *sd);
+bool spinlock_data_tryadd(volatile spinlock_data_t *sd, unsigned inc,
+			  spinlock_data_t *old);
 
 ////////////////////////////////////////////////////////////
 
@@ -93,5 +95,34 @@ spinlock_data_testandset(volatile spinlock_data_t *sd)
 	return x;
 }
 
+SPINLOCK_INLINE
+bool
+spinlock_data_tryadd(volatile spinlock_data_t *sd, unsigned inc,
+		     spinlock_data_t *old)
+{
+	spinlock_data_t x;
+	spinlock_data_t y;
+
+	/*
+	 * Fetch-and-add using LL/SC, one attempt.
+	 *
+	 * Load the existing value into X and store X+INC; as above,
+	 * Y ends up 1 if the SC succeeded and 0 if it failed. The
+	 * caller retries on failure.
+	 */
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		"ll %0, 0(%2);"		/*   x = *sd */
+		"addu %1, %0, %3;"	/*   y = x + inc */
+		"sc %1, 0(%2);"		/*   *sd = y; y = success? */
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y) : "r" (sd), "r" (inc));
+	*old = x;
+	return y != 0;
+}
+
 
 #endif /* _MIPS_SPINLOCK_H_ */
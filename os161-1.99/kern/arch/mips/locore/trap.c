@@ -114,42 +114,18 @@ kill_curthread(vaddr_t epc, unsigned code, vaddr_t vaddr)
 		break;
 	}
 
-	struct addrspace *as;
-  struct proc *p = curproc;
+  struct procusage usage;
 
+  /* the whole process dies, not just this thread */
+  uthread_exitall();
 
-  lock_acquire(arrayLock);
-  struct processInfo* pInfo= findProcess(curproc->pid);
-  pInfo->active = false;
-  pInfo->exitStatus = _MKWAIT_SIG(sig);
 
-  for (unsigned int i=0; i<array_num(processes); i++) {
-    pInfo = array_get(processes,i);
-
-    if (pInfo->parent == curproc->pid && pInfo->active == false) {
-      removeProcess(pInfo->process);
-    }
-    if (pInfo->parent == curproc->pid) {
-      pInfo->parent = -1;
-    }
-  }
-  pInfo= findProcess(curproc->pid);
-  if (pInfo->parent == -1) { // no parent
-    removeProcess(curproc->pid);
-  }
-  else {
-    cv_broadcast(waitQ,arrayLock);
-  }
-
-  lock_release(arrayLock);
+  proc_exitusage(curproc, &usage);
+  processExited(curproc->pid, _MKWAIT_SIG(sig), &usage);
 
 
   KASSERT(curproc->p_addrspace != NULL);
-  as_deactivate();
-  as = curproc_setas(NULL);
-  as_destroy(as);
-  proc_remthread(curthread);
-  proc_destroy(p);
+  proc_exit();
   
   thread_exit();
 
@@ -192,10 +168,13 @@ mips_trap(struct trapframe *tf)
 	/* Interrupt? Call the interrupt handler and return. */
 	if (code == EX_IRQ) {
 		int old_in;
+		bool old_fromuser;
 		bool doadjust;
 
 		old_in = curthread->t_in_interrupt;
+		old_fromuser = curthread->t_intr_fromuser;
 		curthread->t_in_interrupt = 1;
+		curthread->t_intr_fromuser = !iskern;
 
 		/*
 		 * The processor has turned interrupts off; if the
@@ -235,6 +214,7 @@ mips_trap(struct trapframe *tf)
 		}
 
 		curthread->t_in_interrupt = old_in;
+		curthread->t_intr_fromuser = old_fromuser;
 		goto done2;
 	}
 
@@ -364,6 +344,20 @@ mips_trap(struct trapframe *tf)
 	cpu_irqoff();
  done2:
 
+	/*
+	 * If another thread in the process is tearing it down (in
+	 * _exit or execv), don't go back to user mode; exit, or wait
+	 * to see whether execv succeeds. Interrupts are off here but
+	 * we're not in an interrupt handler any more, so it's safe to
+	 * turn them on and sleep.
+	 */
+	if (!iskern &&
+	    (curproc->p_exiting || curproc->p_stopper != NULL)) {
+		spl0();
+		uthread_checkstop();
+		cpu_irqoff();
+	}
+
 	/*
 	 * The boot thread can get here (e.g. on interrupt return) but
 	 * since it doesn't go to userlevel, it can't be returning to
@@ -31,10 +31,12 @@
 #include <kern/errno.h>
 #include <kern/syscall.h>
 #include <lib.h>
+#include <copyinout.h>
 #include <mips/trapframe.h>
 #include <thread.h>
 #include <current.h>
 #include <syscall.h>
+#include <sysstat.h>
 #include <opt-A2.h>
 
 /*
@@ -81,12 +83,14 @@ syscall(struct trapframe *tf)
 	int callno;
 	int32_t retval;
 	int err;
+	uint64_t start;
 
 	KASSERT(curthread != NULL);
 	KASSERT(curthread->t_curspl == 0);
 	KASSERT(curthread->t_iplhigh_count == 0);
 
 	callno = tf->tf_v0;
+	start = sysstat_enter(callno);
 
 	/*
 	 * Initialize retval to 0. Many of the system calls don't
@@ -108,13 +112,132 @@ syscall(struct trapframe *tf)
 		err = sys___time((userptr_t)tf->tf_a0,
 				 (userptr_t)tf->tf_a1);
 		break;
+
+	    case SYS_nanosleep:
+		err = sys_nanosleep((userptr_t)tf->tf_a0,
+				    (userptr_t)tf->tf_a1);
+		break;
 #ifdef UW
+	case SYS_open:
+	  err = sys_open((userptr_t)tf->tf_a0, (int)tf->tf_a1,
+			 (mode_t)tf->tf_a2, &retval);
+	  break;
+
+	case SYS_read:
+	  err = sys_read((int)tf->tf_a0,
+			 (userptr_t)tf->tf_a1,
+			 (size_t)tf->tf_a2,
+			 &retval);
+	  break;
+
 	case SYS_write:
 	  err = sys_write((int)tf->tf_a0,
 			  (userptr_t)tf->tf_a1,
-			  (int)tf->tf_a2,
-			  (int *)(&retval));
+			  (size_t)tf->tf_a2,
+			  &retval);
+	  break;
+
+	case SYS_readv:
+	  err = sys_readv((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			  (int)tf->tf_a2, &retval);
 	  break;
+
+	case SYS_writev:
+	  err = sys_writev((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			   (int)tf->tf_a2, &retval);
+	  break;
+
+	case SYS_pread:
+	case SYS_pwrite:
+	  /* the 64-bit offset is aligned onto the stack, past a3 */
+	  {
+	    off_t pos;
+
+	    err = copyin((userptr_t)(tf->tf_sp + 16), &pos, sizeof(pos));
+	    if (!err && callno == SYS_pread) {
+	      err = sys_pread((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			      (size_t)tf->tf_a2, pos, &retval);
+	    }
+	    else if (!err) {
+	      err = sys_pwrite((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			       (size_t)tf->tf_a2, pos, &retval);
+	    }
+	  }
+	  break;
+
+	case SYS_close:
+	  err = sys_close((int)tf->tf_a0);
+	  break;
+
+	case SYS_lseek:
+	  /*
+	   * The 64-bit offset is in a2/a3 and whence on the stack;
+	   * the 64-bit result goes back in v0/v1.
+	   */
+	  {
+	    off_t pos, newpos;
+	    int whence;
+
+	    pos = ((off_t)tf->tf_a2 << 32) | tf->tf_a3;
+	    err = copyin((userptr_t)(tf->tf_sp + 16), &whence, sizeof(whence));
+	    if (!err) {
+	      err = sys_lseek((int)tf->tf_a0, pos, whence, &newpos);
+	    }
+	    if (!err) {
+	      retval = (int32_t)(newpos >> 32);
+	      tf->tf_v1 = (uint32_t)newpos;
+	    }
+	  }
+	  break;
+
+	case SYS_dup2:
+	  err = sys_dup2((int)tf->tf_a0, (int)tf->tf_a1, &retval);
+	  break;
+
+	case SYS_fstat:
+	  err = sys_fstat((int)tf->tf_a0, (userptr_t)tf->tf_a1);
+	  break;
+
+	case SYS_fsync:
+	  err = sys_fsync((int)tf->tf_a0);
+	  break;
+
+	case SYS_ftruncate:
+	  /* the 64-bit length is in a2/a3 */
+	  err = sys_ftruncate((int)tf->tf_a0,
+			      ((off_t)tf->tf_a2 << 32) | tf->tf_a3);
+	  break;
+
+	case SYS_getdirentry:
+	  err = sys_getdirentry((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+				(size_t)tf->tf_a2, &retval);
+	  break;
+
+	case SYS_chdir:
+	  err = sys_chdir((userptr_t)tf->tf_a0);
+	  break;
+
+	case SYS___getcwd:
+	  err = sys___getcwd((userptr_t)tf->tf_a0, (size_t)tf->tf_a1,
+			     &retval);
+	  break;
+
+	case SYS_mkdir:
+	  err = sys_mkdir((userptr_t)tf->tf_a0, (mode_t)tf->tf_a1);
+	  break;
+
+	case SYS_rmdir:
+	  err = sys_rmdir((userptr_t)tf->tf_a0);
+	  break;
+
+	case SYS_remove:
+	  err = sys_remove((userptr_t)tf->tf_a0);
+	  break;
+
+	case SYS_rename:
+	  err = sys_rename((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1);
+	  break;
+
 	case SYS__exit:
 	  sys__exit((int)tf->tf_a0);
 	  /* sys__exit does not return, execution should not get here */
@@ -135,7 +258,46 @@ syscall(struct trapframe *tf)
 	  break;
 
 	case SYS_execv:
-		err = sys_execv((char*)tf->tf_a0, (char**)tf->tf_a1);
+		err = sys_execv((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1);
+	  break;
+
+	case SYS_spawn:
+	  err = sys_spawn((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1,
+			  (userptr_t)tf->tf_a2, (int)tf->tf_a3,
+			  (pid_t *)&retval);
+	  break;
+
+	case SYS_getrusage:
+	  err = sys_getrusage((int)tf->tf_a0, (userptr_t)tf->tf_a1);
+	  break;
+
+	case SYS_setshare:
+	  err = sys_setshare((pid_t)tf->tf_a0, (int)tf->tf_a1, &retval);
+	  break;
+
+	case SYS___thread_create:
+	  err = sys___thread_create(tf,
+				    (userptr_t)tf->tf_a0,
+				    (userptr_t)tf->tf_a1,
+				    (userptr_t)tf->tf_a2,
+				    &retval);
+	  break;
+
+	case SYS_thread_exit:
+	  err = sys_thread_exit((int)tf->tf_a0);
+	  break;
+
+	case SYS_thread_join:
+	  err = sys_thread_join((int)tf->tf_a0, (userptr_t)tf->tf_a1);
+	  break;
+
+	case SYS_futex:
+	  err = sys_futex((userptr_t)tf->tf_a0, (int)tf->tf_a1,
+			  (int)tf->tf_a2, &retval);
+	  break;
+
+	case SYS___sysstat:
+	  err = sys___sysstat((int)tf->tf_a0, (userptr_t)tf->tf_a1);
 	  break;
 #endif // UW
 
@@ -147,6 +309,7 @@ syscall(struct trapframe *tf)
 	  break;
 	}
 
+	sysstat_exit(callno, err, start);
 
 	if (err) {
 		/*
@@ -202,3 +365,17 @@ enter_forked_process(struct trapframe *tf)
 	(void)tf;
 	#endif
 }
+
+/*
+ * Enter user mode for a new thread in an existing process (see
+ * thread_syscalls.c). TF was set up by the creating thread and is in
+ * the heap; mips_usermode needs it on our own stack.
+ */
+void
+enter_new_thread(struct trapframe *tf)
+{
+	struct trapframe mytf = *tf;
+
+	kfree(tf);
+	mips_usermode(&mytf);
+}
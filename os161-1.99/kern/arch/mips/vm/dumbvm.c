@@ -48,6 +48,18 @@
 /* under dumbvm, always have 48k of user stack */
 #define DUMBVM_STACKPAGES    12
 
+/*
+ * Stacks for additional threads go below the main stack, each
+ * DUMBVM_TSTACKPAGES long with an unmapped guard page above it.
+ * Slot i spans [DUMBVM_TSTACKTOP - (i+1)*DUMBVM_TSTACKSPAN,
+ * DUMBVM_TSTACKTOP - i*DUMBVM_TSTACKSPAN), guard page last.
+ */
+#define DUMBVM_TSTACKPAGES   4
+#define DUMBVM_TSTACKSPAN    ((DUMBVM_TSTACKPAGES + 1) * PAGE_SIZE)
+#define DUMBVM_TSTACKTOP     (USERSTACK - DUMBVM_STACKPAGES * PAGE_SIZE)
+#define DUMBVM_TSTACKBOTTOM  (DUMBVM_TSTACKTOP - \
+			      AS_NTHREADSTACKS * DUMBVM_TSTACKSPAN)
+
 // COREMAP DATA STRUCTURE
 struct singleMap {
 	paddr_t paddr;
@@ -70,10 +82,7 @@ static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER;
 void
 vm_bootstrap(void)
 {
-	/* Do nothing. */
-
-
-
+	spinlock_register(&stealmem_lock, "stealmem");
 }
 
 static
@@ -127,7 +136,9 @@ int
 vm_fault(int faulttype, vaddr_t faultaddress)
 {
 	vaddr_t vbase1, vtop1, vbase2, vtop2, stackbase, stacktop;
+	vaddr_t tstackoff;
 	paddr_t paddr;
+	unsigned slot;
 	int i;
 	uint32_t ehi, elo;
 	struct addrspace *as;
@@ -168,6 +179,9 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 		return EFAULT;
 	}
 
+	/* for getrusage */
+	curthread->t_minflt++;
+
 	/* Assert that the address space has been set up properly. */
 	KASSERT(as->as_vbase1 != 0);
 	KASSERT(as->as_pbase1 != 0);
@@ -199,6 +213,18 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	else if (faultaddress >= stackbase && faultaddress < stacktop) {
 		paddr = (faultaddress - stackbase) + as->as_stackpbase;
 	}
+	else if (faultaddress >= DUMBVM_TSTACKBOTTOM &&
+		 faultaddress < DUMBVM_TSTACKTOP) {
+		slot = (DUMBVM_TSTACKTOP - 1 - faultaddress) / DUMBVM_TSTACKSPAN;
+		tstackoff = faultaddress -
+			(DUMBVM_TSTACKTOP - (slot + 1) * DUMBVM_TSTACKSPAN);
+		if (tstackoff >= DUMBVM_TSTACKPAGES * PAGE_SIZE ||
+		    (as->as_tstackused & (1U << slot)) == 0) {
+			/* guard page, or nobody's stack */
+			return EFAULT;
+		}
+		paddr = tstackoff + as->as_tstackpbase[slot];
+	}
 	else {
 		return EFAULT;
 	}
@@ -244,6 +270,7 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 struct addrspace *
 as_create(void)
 {
+	unsigned i;
 	struct addrspace *as = kmalloc(sizeof(struct addrspace));
 	if (as==NULL) {
 		return NULL;
@@ -258,12 +285,19 @@ as_create(void)
 	as->as_stackpbase = 0;
 	as->done = false;
 
+	spinlock_init(&as->as_tstacklock);
+	as->as_tstackused = 0;
+	for (i=0; i<AS_NTHREADSTACKS; i++) {
+		as->as_tstackpbase[i] = 0;
+	}
+
 	return as;
 }
 
 void
 as_destroy(struct addrspace *as)
 {
+	spinlock_cleanup(&as->as_tstacklock);
 	kfree(as);
 }
 
@@ -388,10 +422,74 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 	return 0;
 }
 
+int
+as_define_threadstack(struct addrspace *as, vaddr_t *stackptr)
+{
+	unsigned slot;
+
+	spinlock_acquire(&as->as_tstacklock);
+	for (slot=0; slot<AS_NTHREADSTACKS; slot++) {
+		if ((as->as_tstackused & (1U << slot)) == 0) {
+			break;
+		}
+	}
+	if (slot == AS_NTHREADSTACKS) {
+		spinlock_release(&as->as_tstacklock);
+		return ENOMEM;
+	}
+	as->as_tstackused |= 1U << slot;
+	spinlock_release(&as->as_tstacklock);
+
+	/* The slot is ours now, so we can fill it in unlocked. */
+	if (as->as_tstackpbase[slot] == 0) {
+		as->as_tstackpbase[slot] = getppages(DUMBVM_TSTACKPAGES);
+		if (as->as_tstackpbase[slot] == 0) {
+			spinlock_acquire(&as->as_tstacklock);
+			as->as_tstackused &= ~(1U << slot);
+			spinlock_release(&as->as_tstacklock);
+			return ENOMEM;
+		}
+	}
+	as_zero_region(as->as_tstackpbase[slot], DUMBVM_TSTACKPAGES);
+
+	*stackptr = DUMBVM_TSTACKTOP - slot * DUMBVM_TSTACKSPAN - PAGE_SIZE;
+	return 0;
+}
+
+void
+as_release_threadstack(struct addrspace *as, vaddr_t stackptr)
+{
+	unsigned slot;
+
+	KASSERT(stackptr > DUMBVM_TSTACKBOTTOM && stackptr < DUMBVM_TSTACKTOP);
+	slot = (DUMBVM_TSTACKTOP - stackptr) / DUMBVM_TSTACKSPAN;
+
+	spinlock_acquire(&as->as_tstacklock);
+	KASSERT(as->as_tstackused & (1U << slot));
+	as->as_tstackused &= ~(1U << slot);
+	spinlock_release(&as->as_tstacklock);
+}
+
+void
+as_trim_threadstacks(struct addrspace *as, vaddr_t stackptr)
+{
+	uint32_t keep = 0;
+
+	if (stackptr > DUMBVM_TSTACKBOTTOM && stackptr < DUMBVM_TSTACKTOP) {
+		keep = 1U << ((DUMBVM_TSTACKTOP - stackptr) / DUMBVM_TSTACKSPAN);
+	}
+
+	spinlock_acquire(&as->as_tstacklock);
+	as->as_tstackused &= keep;
+	spinlock_release(&as->as_tstacklock);
+}
+
 int
 as_copy(struct addrspace *old, struct addrspace **ret)
 {
 	struct addrspace *new;
+	uint32_t used;
+	unsigned slot;
 
 	new = as_create();
 	if (new==NULL) {
@@ -424,6 +522,29 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 	memmove((void *)PADDR_TO_KVADDR(new->as_stackpbase),
 		(const void *)PADDR_TO_KVADDR(old->as_stackpbase),
 		DUMBVM_STACKPAGES*PAGE_SIZE);
+
+	/*
+	 * Copy the thread stacks in use. A slot being set up right now
+	 * by another thread may not have memory yet; skip it.
+	 */
+	spinlock_acquire(&old->as_tstacklock);
+	used = old->as_tstackused;
+	spinlock_release(&old->as_tstacklock);
+	for (slot=0; slot<AS_NTHREADSTACKS; slot++) {
+		if ((used & (1U << slot)) == 0 ||
+		    old->as_tstackpbase[slot] == 0) {
+			continue;
+		}
+		new->as_tstackpbase[slot] = getppages(DUMBVM_TSTACKPAGES);
+		if (new->as_tstackpbase[slot] == 0) {
+			as_destroy(new);
+			return ENOMEM;
+		}
+		memmove((void *)PADDR_TO_KVADDR(new->as_tstackpbase[slot]),
+			(const void *)PADDR_TO_KVADDR(old->as_tstackpbase[slot]),
+			DUMBVM_TSTACKPAGES*PAGE_SIZE);
+		new->as_tstackused |= 1U << slot;
+	}
 	
 	*ret = new;
 	return 0;
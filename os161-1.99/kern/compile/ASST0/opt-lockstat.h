@@ -0,0 +1,5 @@
+/* Automatically generated; do not edit */
+#ifndef _OPT_LOCKSTAT_H_
+#define _OPT_LOCKSTAT_H_
+#define OPT_LOCKSTAT 0
+#endif /* _OPT_LOCKSTAT_H_ */
@@ -46,7 +46,10 @@
  * and (2) if the system crashes before we find a console, no output
  * at all may appear.
  *
- * Note that we have no input buffering; characters typed too rapidly
+ * Output is buffered: see console.h. Writers queue their characters
+ * and return as soon as there is room for them, and the ring is
+ * drained from the device's write-done interrupt. Input is buffered
+ * only CONSOLE_INPUT_BUFFER_SIZE deep; characters typed too rapidly
  * will be lost.
  */
 
@@ -57,6 +60,8 @@
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <wchan.h>
+#include <syscall.h>
 #include <generic/console.h>
 #include <vfs.h>
 #include <device.h>
@@ -68,10 +73,10 @@
 static struct con_softc *the_console = NULL;
 
 /*
- * Lock so user I/Os are atomic.
- * We use two locks so readers waiting for input don't lock out writers.
+ * Lock so user writes are atomic. User reads take turns through
+ * cs_reader instead, so that they wait on cs_inwchan, where
+ * getch_wakeup can find them.
  */
-static struct lock *con_userlock_read = NULL;
 static struct lock *con_userlock_write = NULL;
 
 //////////////////////////////////////////////////
@@ -114,11 +119,33 @@ flush_delay_buf(void)
 /*
  * Print a character, using polling instead of interrupts to wait for
  * I/O completion.
+ *
+ * Whatever is still in the output ring goes first, so that (say) a
+ * panic message comes out after the output that led up to it. Not if
+ * we got here from inside the ring code, though.
+ *
+ * We only get here in an interrupt handler, with a spinlock held, or
+ * panicking, where the wchan and runqueue locks may already be held,
+ * so writers waiting for room are not woken from here: cs_outwakeup
+ * asks the next con_kick to do it. There will be one, since writers
+ * only sleep while the device is busy with a character.
  */
 static
 void
 putch_polled(struct con_softc *cs, int ch)
 {
+	if (!spinlock_do_i_hold(&cs->cs_outlock)) {
+		spinlock_acquire(&cs->cs_outlock);
+		while (cs->cs_outcount > 0) {
+			cs->cs_sendpolled(cs->cs_devdata,
+					  cs->cs_outbuf[cs->cs_outtail]);
+			cs->cs_outtail = (cs->cs_outtail + 1) %
+				CONSOLE_OUTPUT_BUFFER_SIZE;
+			cs->cs_outcount--;
+			cs->cs_outwakeup = true;
+		}
+		spinlock_release(&cs->cs_outlock);
+	}
 	cs->cs_sendpolled(cs->cs_devdata, ch);
 }
 
@@ -142,6 +169,82 @@ putch_complete_polled(struct con_softc *cs)
 
 //////////////////////////////////////////////////
 
+/*
+ * If the device is idle, hand it the next character from the ring,
+ * and wake waiting writers if there is room for them now or
+ * putch_polled asked. Called with cs_outlock held, which is dropped
+ * around the send (some devices call con_start before returning) and
+ * the wakeup (which takes the runqueue lock, and that must not nest
+ * inside cs_outlock), and held again on return.
+ */
+static
+void
+con_kick(struct con_softc *cs)
+{
+	bool wake, send = false;
+	int ch = 0;
+
+	KASSERT(spinlock_do_i_hold(&cs->cs_outlock));
+
+	wake = cs->cs_outwakeup;
+	cs->cs_outwakeup = false;
+	if (!cs->cs_outbusy && cs->cs_outcount > 0) {
+		ch = cs->cs_outbuf[cs->cs_outtail];
+		cs->cs_outtail = (cs->cs_outtail + 1) %
+			CONSOLE_OUTPUT_BUFFER_SIZE;
+		cs->cs_outcount--;
+		/* writers sleep only on a full ring, so they all pass here */
+		if (cs->cs_outcount == CONSOLE_OUTPUT_BUFFER_SIZE / 2) {
+			wake = true;
+		}
+		cs->cs_outbusy = true;
+		send = true;
+	}
+	if (!wake && !send) {
+		return;
+	}
+
+	spinlock_release(&cs->cs_outlock);
+	if (wake) {
+		wchan_wakeall(cs->cs_outwchan);
+	}
+	if (send) {
+		cs->cs_send(cs->cs_devdata, ch);
+	}
+	spinlock_acquire(&cs->cs_outlock);
+}
+
+/*
+ * Queue LEN characters for output, sleeping while the ring is full.
+ * Returns once they are all in the ring, not once they are printed.
+ */
+static
+void
+con_queue(struct con_softc *cs, const char *buf, size_t len)
+{
+	size_t i;
+
+	spinlock_acquire(&cs->cs_outlock);
+	for (i=0; i<len; i++) {
+		while (cs->cs_outcount == CONSOLE_OUTPUT_BUFFER_SIZE) {
+			if (!cs->cs_outbusy) {
+				con_kick(cs);
+				continue;
+			}
+			wchan_lock(cs->cs_outwchan);
+			spinlock_release(&cs->cs_outlock);
+			wchan_sleep(cs->cs_outwchan);
+			spinlock_acquire(&cs->cs_outlock);
+		}
+		cs->cs_outbuf[cs->cs_outhead] = buf[i];
+		cs->cs_outhead = (cs->cs_outhead + 1) %
+			CONSOLE_OUTPUT_BUFFER_SIZE;
+		cs->cs_outcount++;
+	}
+	con_kick(cs);
+	spinlock_release(&cs->cs_outlock);
+}
+
 /*
  * Print a character, using interrupts to wait for I/O completion.
  */
@@ -149,34 +252,46 @@ static
 void
 putch_intr(struct con_softc *cs, int ch)
 {
-	P(cs->cs_wsem);
-	cs->cs_send(cs->cs_devdata, ch);
+	char c = ch;
+
+	con_queue(cs, &c, 1);
 }
 
 /*
  * Read a character, using interrupts to wait for I/O completion.
+ *
+ * If CANCEL is set, give up with EINTR once the calling thread's
+ * process wants it gone (see uthread_cancelled), so that _exit or
+ * execv in another thread isn't kept waiting for someone to type.
+ * Whoever cancels us calls getch_wakeup.
  */
 static
 int
-getch_intr(struct con_softc *cs)
+getch_intr(struct con_softc *cs, bool cancel, int *ret)
 {
-	unsigned char ret;
-
-	P(cs->cs_rsem);
-	ret = cs->cs_gotchars[cs->cs_gotchars_tail];
+	spinlock_acquire(&cs->cs_inlock);
+	while (cs->cs_gotchars_head == cs->cs_gotchars_tail) {
+		if (cancel && uthread_cancelled()) {
+			spinlock_release(&cs->cs_inlock);
+			return EINTR;
+		}
+		wchan_lock(cs->cs_inwchan);
+		spinlock_release(&cs->cs_inlock);
+		wchan_sleep(cs->cs_inwchan);
+		spinlock_acquire(&cs->cs_inlock);
+	}
+	*ret = cs->cs_gotchars[cs->cs_gotchars_tail];
 	cs->cs_gotchars_tail =
 		(cs->cs_gotchars_tail + 1) % CONSOLE_INPUT_BUFFER_SIZE;
-	return ret;
+	spinlock_release(&cs->cs_inlock);
+	return 0;
 }
 
 /*
  * Called from underlying device when a read-ready interrupt occurs.
  *
  * Note: if gotchars_head == gotchars_tail, the buffer is empty. Thus
- * if gotchars_head+1 == gotchars_tail, the buffer is full. A slightly
- * tidier way to implement this check (that avoids wasting a slot,
- * too) would be with a second semaphore used with a nonblocking P,
- * but we don't have that in OS/161.
+ * if gotchars_head+1 == gotchars_tail, the buffer is full.
  */
 void
 con_input(void *vcs, int ch)
@@ -184,27 +299,34 @@ con_input(void *vcs, int ch)
 	struct con_softc *cs = vcs;
 	unsigned nexthead;
 
+	spinlock_acquire(&cs->cs_inlock);
 	nexthead = (cs->cs_gotchars_head + 1) % CONSOLE_INPUT_BUFFER_SIZE;
 	if (nexthead == cs->cs_gotchars_tail) {
 		/* overflow; drop character */
+		spinlock_release(&cs->cs_inlock);
 		return;
 	}
 
 	cs->cs_gotchars[cs->cs_gotchars_head] = ch;
 	cs->cs_gotchars_head = nexthead;
-		
-	V(cs->cs_rsem);
+	spinlock_release(&cs->cs_inlock);
+
+	wchan_wakeall(cs->cs_inwchan);
 }
 
 /*
- * Called from underlying device when a write-done interrupt occurs.
+ * Called from underlying device when a write-done interrupt occurs:
+ * send the next character, if there is one.
  */
 void
 con_start(void *vcs)
 {
 	struct con_softc *cs = vcs;
 
-	V(cs->cs_wsem);
+	spinlock_acquire(&cs->cs_outlock);
+	cs->cs_outbusy = false;
+	con_kick(cs);
+	spinlock_release(&cs->cs_outlock);
 }
 
 //////////////////////////////////////////////////
@@ -265,14 +387,31 @@ putch_complete(void)
 	}
 }
 
+/*
+ * Wake every thread waiting in a console read, so that any that have
+ * been cancelled notice; the rest go back to sleep.
+ */
+void
+getch_wakeup(void)
+{
+	struct con_softc *cs = the_console;
+
+	if (cs != NULL) {
+		wchan_wakeall(cs->cs_inwchan);
+	}
+}
+
 int
 getch(void)
 {
 	struct con_softc *cs = the_console;
+	int ch;
+
 	KASSERT(cs != NULL);
 	KASSERT(!curthread->t_in_interrupt && curthread->t_iplhigh_count == 0);
 
-	return getch_intr(cs);
+	getch_intr(cs, false, &ch);
+	return ch;
 }
 
 ////////////////////////////////////////////////////////////
@@ -298,55 +437,119 @@ con_close(struct device *dev)
 	return 0;
 }
 
+/*
+ * Staging buffers for writes, protected by con_userlock_write. User
+ * data can't be moved straight into the ring: uiomove may fault and
+ * sleep, which it can't do holding the ring's spinlock. Output gets
+ * twice the room for the \r put in front of each \n.
+ */
+#define CON_WCHUNK 512
+static char con_win[CON_WCHUNK];
+static char con_wout[2 * CON_WCHUNK];
+
 static
 int
-con_io(struct device *dev, struct uio *uio)
+con_write(struct con_softc *cs, struct uio *uio)
 {
+	size_t len, i, n;
 	int result;
-	char ch;
-	struct lock *lk;
 
-	(void)dev;  // unused
+	KASSERT(lock_do_i_hold(con_userlock_write));
 
-	if (uio->uio_rw==UIO_READ) {
-		lk = con_userlock_read;
-	}
-	else {
-		lk = con_userlock_write;
+	while (uio->uio_resid > 0) {
+		len = uio->uio_resid;
+		if (len > CON_WCHUNK) {
+			len = CON_WCHUNK;
+		}
+		result = uiomove(con_win, len, uio);
+		if (result) {
+			return result;
+		}
+		n = 0;
+		for (i=0; i<len; i++) {
+			if (con_win[i] == '\n') {
+				con_wout[n++] = '\r';
+			}
+			con_wout[n++] = con_win[i];
+		}
+		con_queue(cs, con_wout, n);
 	}
+	return 0;
+}
 
-	KASSERT(lk != NULL);
-	lock_acquire(lk);
+/*
+ * Read up to a line for a user read. One reader at a time, so that
+ * lines don't get split between them. If the read is cancelled after
+ * some characters have been taken, they are returned rather than
+ * lost, as a short read.
+ */
+static
+int
+con_read(struct con_softc *cs, struct uio *uio)
+{
+	size_t startresid = uio->uio_resid;
+	int result = 0;
+	int ch;
+	char c;
+
+	spinlock_acquire(&cs->cs_inlock);
+	while (cs->cs_reader != NULL) {
+		if (uthread_cancelled()) {
+			spinlock_release(&cs->cs_inlock);
+			return EINTR;
+		}
+		wchan_lock(cs->cs_inwchan);
+		spinlock_release(&cs->cs_inlock);
+		wchan_sleep(cs->cs_inwchan);
+		spinlock_acquire(&cs->cs_inlock);
+	}
+	cs->cs_reader = curthread;
+	spinlock_release(&cs->cs_inlock);
 
 	while (uio->uio_resid > 0) {
-		if (uio->uio_rw==UIO_READ) {
-			ch = getch();
-			if (ch=='\r') {
-				ch = '\n';
-			}
-			result = uiomove(&ch, 1, uio);
-			if (result) {
-				lock_release(lk);
-				return result;
-			}
-			if (ch=='\n') {
-				break;
-			}
+		result = getch_intr(cs, true, &ch);
+		if (result) {
+			break;
 		}
-		else {
-			result = uiomove(&ch, 1, uio);
-			if (result) {
-				lock_release(lk);
-				return result;
-			}
-			if (ch=='\n') {
-				putch('\r');
-			}
-			putch(ch);
+		if (ch=='\r') {
+			ch = '\n';
+		}
+		c = ch;
+		result = uiomove(&c, 1, uio);
+		if (result) {
+			break;
+		}
+		if (c=='\n') {
+			break;
 		}
 	}
-	lock_release(lk);
-	return 0;
+
+	spinlock_acquire(&cs->cs_inlock);
+	cs->cs_reader = NULL;
+	spinlock_release(&cs->cs_inlock);
+	wchan_wakeall(cs->cs_inwchan);
+
+	if (result == EINTR && uio->uio_resid < startresid) {
+		result = 0;
+	}
+	return result;
+}
+
+static
+int
+con_io(struct device *dev, struct uio *uio)
+{
+	int result;
+
+	if (uio->uio_rw==UIO_READ) {
+		return con_read(dev->d_data, uio);
+	}
+
+	KASSERT(con_userlock_write != NULL);
+	lock_acquire(con_userlock_write);
+	result = con_write(dev->d_data, uio);
+	lock_release(con_userlock_write);
+	return result;
 }
 
 static
@@ -398,8 +601,8 @@ attach_console_to_vfs(struct con_softc *cs)
 int
 config_con(struct con_softc *cs, int unit)
 {
-	struct semaphore *rsem, *wsem;
-	struct lock *rlk, *wlk;
+	struct wchan *inwchan, *outwchan;
+	struct lock *wlk;
 
 	/*
 	 * Only allow one system console.
@@ -414,36 +617,39 @@ config_con(struct con_softc *cs, int unit)
 	}
 	KASSERT(the_console==NULL);
 
-	rsem = sem_create("console read", 0);
-	if (rsem == NULL) {
+	inwchan = wchan_create("console read");
+	if (inwchan == NULL) {
 		return ENOMEM;
 	}
-	wsem = sem_create("console write", 1);
-	if (wsem == NULL) {
-		sem_destroy(rsem);
-		return ENOMEM;
-	}
-	rlk = lock_create("console-lock-read");
-	if (rlk == NULL) {
-		sem_destroy(rsem);
-		sem_destroy(wsem);
+	outwchan = wchan_create("console write");
+	if (outwchan == NULL) {
+		wchan_destroy(inwchan);
 		return ENOMEM;
 	}
 	wlk = lock_create("console-lock-write");
 	if (wlk == NULL) {
-		lock_destroy(rlk);
-		sem_destroy(rsem);
-		sem_destroy(wsem);
+		wchan_destroy(inwchan);
+		wchan_destroy(outwchan);
 		return ENOMEM;
 	}
 
-	cs->cs_rsem = rsem; 
-	cs->cs_wsem = wsem; 
+	spinlock_init(&cs->cs_inlock);
+	spinlock_register(&cs->cs_inlock, "console input");
+	cs->cs_inwchan = inwchan;
+	cs->cs_reader = NULL;
 	cs->cs_gotchars_head = 0;
 	cs->cs_gotchars_tail = 0;
 
+	spinlock_init(&cs->cs_outlock);
+	spinlock_register(&cs->cs_outlock, "console output");
+	cs->cs_outwchan = outwchan;
+	cs->cs_outhead = 0;
+	cs->cs_outtail = 0;
+	cs->cs_outcount = 0;
+	cs->cs_outbusy = false;
+	cs->cs_outwakeup = false;
+
 	the_console = cs;
-	con_userlock_read = rlk;
 	con_userlock_write = wlk;
 
 	flush_delay_buf();
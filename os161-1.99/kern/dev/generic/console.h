@@ -35,9 +35,17 @@
  *
  * devdata, send, and sendpolled are provided by the underlying
  * device, and are to be initialized by the attach routine.
+ *
+ * Output goes through a ring buffer: writers queue characters and
+ * return, and the device's write-done interrupt (con_start) sends the
+ * next one. cs_outbusy is true while a character is with the device;
+ * whoever sets it is the only one who may call cs_send.
  */
 
+#include <spinlock.h>
+
 #define CONSOLE_INPUT_BUFFER_SIZE 32
+#define CONSOLE_OUTPUT_BUFFER_SIZE 1024
 
 struct con_softc {
 	/* initialized by attach routine */
@@ -48,11 +56,21 @@ struct con_softc {
 	void (*cs_endpolling)(void *devdata);
 
 	/* initialized by config routine */
-	struct semaphore *cs_rsem;
-	struct semaphore *cs_wsem;
+	struct spinlock cs_inlock;	/* protects the input ring */
+	struct wchan *cs_inwchan;	/* readers waiting for input or a turn */
+	struct thread *cs_reader;	/* user read in progress */
 	unsigned char cs_gotchars[CONSOLE_INPUT_BUFFER_SIZE];
 	unsigned cs_gotchars_head;	/* next slot to put a char in */
 	unsigned cs_gotchars_tail;	/* next slot to take a char out */
+
+	struct spinlock cs_outlock;	/* protects the output ring */
+	struct wchan *cs_outwchan;	/* writers waiting for room */
+	unsigned char cs_outbuf[CONSOLE_OUTPUT_BUFFER_SIZE];
+	unsigned cs_outhead;		/* next slot to put a char in */
+	unsigned cs_outtail;		/* next slot to take a char out */
+	unsigned cs_outcount;		/* chars in the ring */
+	bool cs_outbusy;		/* device is sending one */
+	bool cs_outwakeup;		/* con_kick must wake writers */
 };
 
 /*
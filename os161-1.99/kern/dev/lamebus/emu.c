@@ -479,7 +479,8 @@ emufs_reclaim(struct vnode *v)
 	vfs_biglock_acquire();
 	lock_acquire(ef->ef_emu->e_lock);
 
-	if (ev->ev_v.vn_refcount != 1) {
+	if (vnode_decref_unlesslast(&ev->ev_v)) {
+		/* consumed the reference VOP_DECREF gave us */
 		lock_release(ef->ef_emu->e_lock);
 		vfs_biglock_release();
 		return EBUSY;
@@ -900,12 +900,8 @@ sfs_reclaim(struct vnode *v)
 	 * decision was made to reclaim it. (You must also synchronize
 	 * this with sfs_loadvnode.)
 	 */
-	if (v->vn_refcount != 1) {
-
-		/* consume the reference VOP_DECREF gave us */
-		KASSERT(v->vn_refcount>1);
-		v->vn_refcount--;
-
+	if (vnode_decref_unlesslast(v)) {
+		/* consumed the reference VOP_DECREF gave us */
 		vfs_biglock_release();
 		return EBUSY;
 	}
@@ -1657,7 +1653,12 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	unsigned i, num;
 	int result;
 
-	/* Look in the vnodes table */
+	/*
+	 * Look in the vnodes table. This isn't an RCU reader like the
+	 * mount list lookups: every sfs operation holds vfs_biglock,
+	 * so nothing could run beside it anyway.
+	 */
+	KASSERT(vfs_biglock_do_i_hold());
 	num = vnodearray_num(sfs->sfs_vnodes);
 
 	/* Linear search. Is this too slow? You decide. */
@@ -36,9 +36,13 @@
 
 
 #include <vm.h>
+#include <spinlock.h>
 
 struct vnode;
 
+/* Maximum number of extra thread stacks in one address space. */
+#define AS_NTHREADSTACKS 16
+
 
 /* 
  * Address space - data structure associated with the virtual memory
@@ -56,6 +60,14 @@ struct addrspace {
   size_t as_npages2;
   paddr_t as_stackpbase;
   bool done;
+
+  /*
+   * Stacks for additional user threads. Physical memory for a slot
+   * is allocated the first time it is used and kept for reuse.
+   */
+  struct spinlock as_tstacklock;	/* protects the bitmap */
+  uint32_t as_tstackused;		/* bitmap of slots in use */
+  paddr_t as_tstackpbase[AS_NTHREADSTACKS];
 };
 
 /*
@@ -92,6 +104,17 @@ struct addrspace {
  *    as_define_stack - set up the stack region in the address space.
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
+ *
+ *    as_define_threadstack - set up a stack for an additional thread.
+ *                Hands back its initial stack pointer, which also
+ *                names the stack to as_release_threadstack.
+ *
+ *    as_release_threadstack - give back a stack obtained from
+ *                as_define_threadstack once no thread uses it.
+ *
+ *    as_trim_threadstacks - release every thread stack except the
+ *                one containing STACKPTR (if any). Used after as_copy
+ *                in fork, where only the forking thread survives.
  */
 
 struct addrspace *as_create(void);
@@ -108,6 +131,12 @@ int               as_define_region(struct addrspace *as,
 int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
+int               as_define_threadstack(struct addrspace *as,
+                                        vaddr_t *initstackptr);
+void              as_release_threadstack(struct addrspace *as,
+                                         vaddr_t initstackptr);
+void              as_trim_threadstacks(struct addrspace *as,
+                                       vaddr_t stackptr);
 
 
 /*
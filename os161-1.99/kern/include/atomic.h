@@ -0,0 +1,108 @@
+#ifndef _ATOMIC_H_
+#define _ATOMIC_H_
+
+/*
+ * Atomic operations on ints, for counters and flags that would
+ * otherwise need a lock of their own. The machine-dependent header
+ * supplies single attempts; these loop until one succeeds.
+ *
+ *    atomic_get(p)            - read *P.
+ *    atomic_set(p, v)         - store V in *P.
+ *    atomic_add(p, inc)       - add INC to *P; returns the new value.
+ *    atomic_inc(p), atomic_dec(p)
+ *                             - atomic_add of 1 and -1.
+ *    atomic_cas(p, old, new)  - if *P is OLD, replace it with NEW.
+ *                               Returns the value *P had; the swap
+ *                               happened if that is OLD.
+ *    atomic_swap(p, new)      - fetch-and-store: store NEW in *P and
+ *                               return the old value.
+ *
+ * None of these disables interrupts, so they may be used from
+ * interrupt handlers and with or without spinlocks held.
+ */
+
+#include <cdefs.h>
+
+/* Inlining support - for making sure an out-of-line copy gets built */
+#ifndef ATOMIC_INLINE
+#define ATOMIC_INLINE INLINE
+#endif
+
+/* Get the machine-dependent bits. */
+#include <machine/atomic.h>
+
+int atomic_get(volatile int *p);
+void atomic_set(volatile int *p, int v);
+int atomic_add(volatile int *p, int inc);
+int atomic_inc(volatile int *p);
+int atomic_dec(volatile int *p);
+int atomic_cas(volatile int *p, int old, int new);
+int atomic_swap(volatile int *p, int new);
+
+////////////////////////////////////////////////////////////
+
+ATOMIC_INLINE
+int
+atomic_get(volatile int *p)
+{
+	return *p;
+}
+
+ATOMIC_INLINE
+void
+atomic_set(volatile int *p, int v)
+{
+	*p = v;
+}
+
+ATOMIC_INLINE
+int
+atomic_add(volatile int *p, int inc)
+{
+	int old;
+
+	while (!atomic_tryadd(p, inc, &old)) {
+		/* retry */
+	}
+	return old + inc;
+}
+
+ATOMIC_INLINE
+int
+atomic_inc(volatile int *p)
+{
+	return atomic_add(p, 1);
+}
+
+ATOMIC_INLINE
+int
+atomic_dec(volatile int *p)
+{
+	return atomic_add(p, -1);
+}
+
+ATOMIC_INLINE
+int
+atomic_cas(volatile int *p, int old, int new)
+{
+	int seen;
+
+	while (!atomic_trycas(p, old, new, &seen)) {
+		/* retry */
+	}
+	return seen;
+}
+
+ATOMIC_INLINE
+int
+atomic_swap(volatile int *p, int new)
+{
+	int old;
+
+	while (!atomic_tryswap(p, new, &old)) {
+		/* retry */
+	}
+	return old;
+}
+
+#endif /* _ATOMIC_H_ */
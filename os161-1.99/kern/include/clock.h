@@ -38,8 +38,9 @@
  * hardclock() is called on every CPU HZ times a second, possibly only
  * when the CPU is not idle, for scheduling.
  *
- * timerclock() is called on one CPU once a second to allow simple
- * timed operations. (This is a fairly simpleminded interface.)
+ * timerclock() is called on one CPU once every timer tick (see
+ * LT_GRANULARITY in dev/lamebus/ltimer.h) and runs any callouts that
+ * have come due.
  *
  * gettime() may be used to fetch the current time of day.
  * getinterval() computes the time from time1 to time2.
@@ -58,6 +59,12 @@
 
 void hardclock_bootstrap(void);
 
+/*
+ * If true (the default), hardclock doesn't preempt a thread holding
+ * a sleeping lock right away; see clock.c.
+ */
+extern bool clock_preemptdefer;
+
 void hardclock(void);
 void timerclock(void);
 
@@ -67,11 +74,54 @@ void getinterval(time_t secs1, uint32_t nsecs,
                  time_t secs2, uint32_t nsecs2,
                  time_t *rsecs, uint32_t *rnsecs);
 
+/*
+ * clock_ticks() returns the number of timer ticks since boot. It
+ * wraps; compare tick values by subtracting them.
+ *
+ * clock_timetoticks() converts a time interval to timer ticks,
+ * rounding up. The result is at most CLOCK_MAXTICKS, so it fits in
+ * an int and can be handed to clocknap() or callout_schedule().
+ */
+#define CLOCK_MAXTICKS	0x7fffffff
+
+uint32_t clock_ticks(void);
+uint32_t clock_timetoticks(time_t secs, uint32_t nsecs);
+
+/*
+ * Callouts.
+ *
+ * A callout calls co_func(co_arg) from the timer interrupt once the
+ * requested number of timer ticks has elapsed. The function runs in
+ * interrupt context and so must not sleep.
+ *
+ * callout_init     - set up a callout; it is not pending.
+ * callout_schedule - arrange for the callout to fire in TICKS ticks
+ *                    (at least 1). Reschedules it if already pending.
+ * callout_stop     - cancel the callout. Returns true if it was still
+ *                    pending, false if it already fired. Waits for the
+ *                    function to finish if it is running, so afterwards
+ *                    the callout may be freed. Must not be called while
+ *                    holding anything the function needs.
+ *
+ * The struct is public only so callouts can be embedded in other
+ * structures or allocated on the stack; the fields belong to clock.c.
+ */
+struct callout {
+	struct callout *co_next;	/* timing wheel linkage */
+	struct callout *co_prev;
+	uint32_t co_expires;		/* tick at which to fire */
+	void (*co_func)(void *);	/* function to call */
+	void *co_arg;			/* argument for co_func */
+	bool co_pending;		/* true if on the wheel */
+};
+
+void callout_init(struct callout *co, void (*func)(void *), void *arg);
+void callout_schedule(struct callout *co, uint32_t ticks);
+bool callout_stop(struct callout *co);
+
 /*
  * clocksleep() suspends execution for the requested number of seconds,
  * like userlevel sleep(3). (Don't confuse it with wchan_sleep.)
- *
- *  this will be more efficient than clocknap() for longer sleeps
  */
 void clocksleep(int seconds);
 
@@ -35,6 +35,8 @@
 #include <threadlist.h>
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
 
+struct sysstat;
+
 
 /*
  * Per-cpu structure
@@ -60,6 +62,23 @@ struct cpu {
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
+	struct sysstat *c_sysstat;	/* System calls made; see sysstat.h */
+
+	/*
+	 * Exited threads kept for reuse (see thread.c). Used by this
+	 * cpu, except that thread_cache_reclaim may empty it from
+	 * anywhere.
+	 */
+	struct threadlist c_threadcache;
+	struct spinlock c_threadcache_lock;
+
+	/*
+	 * RCU (see rcu.c). c_rcu_qs counts this cpu's quiescent states
+	 * and is only written by this cpu; c_rcu_snap is its value when
+	 * the current grace period began, protected by the RCU lock.
+	 */
+	volatile unsigned c_rcu_qs;
+	unsigned c_rcu_snap;
 
 	/*
 	 * Accessed by other cpus.
@@ -67,6 +86,7 @@ struct cpu {
 	 */
 	bool c_isidle;			/* True if this cpu is idle */
 	struct threadlist c_runqueue;	/* Run queue for this cpu */
+	uint64_t c_pass;		/* Pass of last thread dispatched */
 	struct spinlock c_runqueue_lock;
 
 	/*
@@ -105,6 +125,14 @@ struct cpu {
  * for the cpu.
  */
 struct cpu *cpu_create(unsigned hardware_number);
+
+/*
+ * Number of cpus, and the cpu with software number N, for code
+ * outside thread.c that needs to visit every cpu.
+ */
+unsigned cpu_count(void);
+struct cpu *cpu_bynumber(unsigned n);
+
 void cpu_machdep_init(struct cpu *);
 /*ASMLINKAGE*/ void cpu_start_secondary(void);
 void cpu_hatch(unsigned software_number);
@@ -0,0 +1,15 @@
+#ifndef _KERN_FUTEX_H_
+#define _KERN_FUTEX_H_
+
+/*
+ * Operations for futex(). Shared with userland.
+ *
+ * FUTEX_WAIT - if *addr is still val, sleep until a FUTEX_WAKE on
+ *              addr. Fails with EAGAIN if *addr has changed.
+ * FUTEX_WAKE - wake up to val threads sleeping on addr. Returns the
+ *              number woken.
+ */
+#define FUTEX_WAIT	0
+#define FUTEX_WAKE	1
+
+#endif /* _KERN_FUTEX_H_ */
@@ -67,6 +67,9 @@ struct rusage {
 	__counter_t ru_nsignals;	/* signals delivered (count) */
 	__counter_t ru_nvcsw;		/* voluntary context switches (count)*/
 	__counter_t ru_nivcsw;		/* involuntary ditto (count) */
+	struct timeval ru_wtime;	/* time runnable but not running */
+	__counter_t ru_inbytes;		/* bytes read by I/O calls */
+	__counter_t ru_outbytes;	/* bytes written by I/O calls */
 };
 
 /* limit codes for getrusage/setrusage */
@@ -0,0 +1,34 @@
+#ifndef _KERN_SPAWN_H_
+#define _KERN_SPAWN_H_
+
+/*
+ * Descriptor actions for spawn(). Shared with userland.
+ *
+ * The child starts with a copy of the parent's descriptors; the
+ * actions are then carried out on the child's table in order, before
+ * the program is loaded. If one fails, spawn fails with its error and
+ * there is no child.
+ *
+ * SPAWN_FDCLOSE - close sfa_fd.
+ * SPAWN_FDDUP2  - make sfa_fd refer to what sfa_srcfd does, as dup2.
+ * SPAWN_FDOPEN  - open sfa_path with sfa_flags and sfa_mode, as open,
+ *                 and put the result at sfa_fd, closing what was there.
+ *
+ * At most SPAWN_MAXFDACTIONS actions may be given.
+ */
+#define SPAWN_FDCLOSE	0
+#define SPAWN_FDDUP2	1
+#define SPAWN_FDOPEN	2
+
+#define SPAWN_MAXFDACTIONS	16
+
+struct spawn_fdaction {
+	int sfa_op;
+	int sfa_fd;
+	int sfa_srcfd;			/* for SPAWN_FDDUP2 */
+	const char *sfa_path;		/* for SPAWN_FDOPEN */
+	int sfa_flags;			/* for SPAWN_FDOPEN */
+	__mode_t sfa_mode;		/* for SPAWN_FDOPEN */
+};
+
+#endif /* _KERN_SPAWN_H_ */
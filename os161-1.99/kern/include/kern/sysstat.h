@@ -0,0 +1,27 @@
+#ifndef _KERN_SYSSTAT_H_
+#define _KERN_SYSSTAT_H_
+
+/*
+ * System call statistics, as returned by __sysstat(). Shared with
+ * userland.
+ *
+ * There is one record per system call number, below SYSSTAT_NCALLS.
+ * ss_calls counts calls made, including ones that never return (like
+ * _exit). The rest covers only calls that came back: ss_errors is how
+ * many failed, and ss_hist is a log2 histogram of how long they took.
+ * ss_hist[0] counts calls under a microsecond, and ss_hist[i] counts
+ * calls that took from 2^(i-1) to 2^i - 1 microseconds. The last
+ * bucket also holds anything slower.
+ */
+
+#define SYSSTAT_NCALLS		128
+#define SYSSTAT_NBUCKETS	24
+
+struct sysstat {
+	__counter_t ss_calls;
+	__counter_t ss_errors;
+	__counter_t ss_totalus;		/* time taken, in microseconds */
+	__u32 ss_hist[SYSSTAT_NBUCKETS];
+};
+
+#endif /* _KERN_SYSSTAT_H_ */
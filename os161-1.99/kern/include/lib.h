@@ -125,6 +125,7 @@ uint32_t random(void);
  */
 void *kmalloc(size_t size);
 void kfree(void *ptr);
+void kheap_bootstrap(void);
 void kheap_printstats(void);
 
 /*
@@ -157,11 +158,15 @@ const char *strerror(int errcode);
  * putch_prepare and putch_complete should be called around a series
  * of putch() calls, if printing in polling mode is a possibility.
  * kprintf does this.
+ *
+ * getch_wakeup wakes threads blocked reading the console, for when
+ * their process is getting rid of them (see uthread_cancelled).
  */
 void putch(int ch);
 void putch_prepare(void);
 void putch_complete(void);
 int getch(void);
+void getch_wakeup(void);
 void beep(void);
 
 /*
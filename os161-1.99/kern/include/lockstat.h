@@ -0,0 +1,46 @@
+#ifndef _LOCKSTAT_H_
+#define _LOCKSTAT_H_
+
+/*
+ * Lock statistics ("options lockstat").
+ *
+ * Each struct lock and struct spinlock points at a record for the
+ * place it was created (spinlock_register counts as a creation site
+ * too, so named spinlocks get records of their own). A record counts
+ * acquisitions, how many had to wait, and the total and longest wait
+ * and hold times. All locks made at one site share its record; the
+ * name shown is that of the first.
+ *
+ * Without the option none of this is compiled in, and the lock
+ * structures and functions are exactly as before.
+ *
+ * lockstat_bootstrap   - start timing; call once the clock is attached.
+ *                        Until then only the counts are kept.
+ * lockstat_get         - find or make the record for a site. Returns
+ *                        NULL if the table is full.
+ * lockstat_now         - current time in ns, or 0 before bootstrap.
+ * lockstat_acquired    - account for an acquisition that started at
+ *                        START (a lockstat_now value) and succeeded at
+ *                        NOW; CONTENDED if it had to wait.
+ * lockstat_released    - account for a hold from ACQUIRED until now.
+ * lockstat_print       - print the NTOP most contended records, and
+ *                        optionally zero all of them.
+ */
+
+#include "opt-lockstat.h"
+
+#if OPT_LOCKSTAT
+
+struct lockstat;
+
+void lockstat_bootstrap(void);
+struct lockstat *lockstat_get(const char *name, const char *file, int line);
+uint64_t lockstat_now(void);
+void lockstat_acquired(struct lockstat *ls, bool contended,
+		       uint64_t start, uint64_t now);
+void lockstat_released(struct lockstat *ls, uint64_t acquired);
+void lockstat_print(unsigned ntop, bool reset);
+
+#endif /* OPT_LOCKSTAT */
+
+#endif /* _LOCKSTAT_H_ */
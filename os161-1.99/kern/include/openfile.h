@@ -0,0 +1,63 @@
+#ifndef _OPENFILE_H_
+#define _OPENFILE_H_
+
+/*
+ * Open files and per-process file descriptor tables.
+ *
+ * An openfile is what open() makes: a vnode, the access mode, and the
+ * seek position. Descriptors are just slots in the process's p_files
+ * array pointing at one. dup2 and fork make more descriptors for the
+ * same openfile, which then share its offset, so it is refcounted.
+ *
+ * of_offsetlock protects of_offset and is held across each read or
+ * write that uses it, so I/O through one openfile is atomic with
+ * respect to the offset. Every openfile has its own; files that can't
+ * seek (the console) don't take it at all.
+ *
+ * p_lock protects the descriptor slots. Looking a descriptor up takes
+ * a reference on the openfile, which the caller drops with
+ * openfile_decref when done, so a concurrent close can't free it out
+ * from under a read.
+ */
+
+struct vnode;
+struct lock;
+struct proc;
+
+struct openfile {
+	struct vnode *of_vnode;
+	int of_accmode;			/* O_RDONLY, O_WRONLY or O_RDWR */
+	bool of_append;			/* O_APPEND */
+	bool of_seekable;		/* VOP_TRYSEEK allows it */
+	struct lock *of_offsetlock;	/* protects of_offset */
+	off_t of_offset;
+	volatile int of_refcount;
+};
+
+/* Open PATH (which may be destroyed) with open()'s FLAGS and MODE. */
+int openfile_open(char *path, int flags, mode_t mode, struct openfile **ret);
+
+void openfile_incref(struct openfile *of);
+void openfile_decref(struct openfile *of);
+
+/* Give PROC's descriptors the same openfiles as FROM's. */
+void filetable_copy(struct proc *from, struct proc *proc);
+
+/* Open the console as PROC's standard input, output and error. */
+int filetable_openconsole(struct proc *proc);
+
+/* Close all of PROC's descriptors. */
+void filetable_closeall(struct proc *proc);
+
+/*
+ * Operations on the current process's descriptors. fd_get returns a
+ * reference. fd_alloc installs OF, consuming the caller's reference,
+ * in the lowest free slot. fd_replace puts OF (a new reference) in
+ * slot FD, closing whatever was there.
+ */
+int fd_get(int fd, struct openfile **ret);
+int fd_alloc(struct openfile *of, int *fd);
+void fd_replace(int fd, struct openfile *of);
+int fd_close(int fd);
+
+#endif /* _OPENFILE_H_ */
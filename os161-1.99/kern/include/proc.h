@@ -39,14 +39,34 @@
 #include <spinlock.h>
 #include <thread.h> /* required for struct threadarray */
 #include <array.h>
+#include <rcu.h>
+#include <limits.h>
 #include "opt-A2.h"
 
 struct addrspace;
 struct vnode;
+struct openfile;
+struct lock;
+struct cv;
 #ifdef UW
 struct semaphore;
 #endif // UW
 
+/*
+ * Resource usage, in raw units: hardclocks, timer ticks, counts and
+ * bytes. getrusage converts it.
+ */
+struct procusage {
+	uint32_t pu_utime;		/* hardclocks in user mode */
+	uint32_t pu_stime;		/* hardclocks in the kernel */
+	uint32_t pu_waitticks;		/* timer ticks spent runnable */
+	uint32_t pu_nvcsw;		/* voluntary context switches */
+	uint32_t pu_nivcsw;		/* involuntary context switches */
+	uint32_t pu_minflt;		/* vm faults */
+	uint64_t pu_inbytes;		/* bytes read into user space */
+	uint64_t pu_outbytes;		/* bytes written from user space */
+};
+
 /*
  * Process structure.
  */
@@ -60,15 +80,25 @@ struct proc {
 
 	/* VFS */
 	struct vnode *p_cwd;		/* current working directory */
+	struct openfile *p_files[OPEN_MAX];	/* by fd; see openfile.h */
 
-#ifdef UW
-  /* a vnode to refer to the console device */
-  /* this is a quick-and-dirty way to get console writes working */
-  /* you will probably need to change this when implementing file-related
-     system calls, since each process will need to keep track of all files
-     it has opened, not just the console. */
-  struct vnode *console;                /* a vnode for the console device */
-#endif
+	/* scheduling */
+	unsigned p_tickets;		/* CPU share; see thread.c */
+
+	/* accounting; protected by p_lock */
+	struct procusage p_usage;	/* threads that have left */
+	struct procusage p_childusage;	/* children waited for */
+
+	struct proc *p_reapnext;	/* on the reaper's list */
+
+	/* user-level threads; see thread_syscalls.c */
+	struct lock *p_uthread_lock;	/* protects the following */
+	struct cv *p_uthread_cv;	/* broadcast when a thread exits */
+	struct array *p_uthreads;	/* struct uthread, one per thread_create */
+	int p_nexttid;			/* next thread id to hand out */
+	volatile bool p_exiting;	/* other threads should die */
+	struct thread *volatile p_stopper; /* thread in uthread_stopall */
+	unsigned p_nparked;		/* threads parked for p_stopper */
 
 	/* add more material here as needed */
 	#if OPT_A2
@@ -78,6 +108,13 @@ struct proc {
   #endif /* OPT_A2 */
 };
 
+/*
+ * Bounds on p_tickets. A process's threads get CPU time in proportion
+ * to its tickets relative to everyone else's.
+ */
+#define PROC_TICKETS_DEFAULT	100
+#define PROC_TICKETS_MAX	10000
+
 /* This is the process structure for the kernel and for kernel-only threads. */
 extern struct proc *kproc;
 
@@ -95,12 +132,27 @@ struct proc *proc_create_runprogram(const char *name);
 /* Destroy a process. */
 void proc_destroy(struct proc *proc);
 
+/* Start the thread that destroys exited processes. */
+void proc_reaper_bootstrap(void);
+
+/* Detach the current thread, the last, and hand its process to the reaper. */
+void proc_exit(void);
+
 /* Attach a thread to a process. Must not already have a process. */
 int proc_addthread(struct proc *proc, struct thread *t);
 
 /* Detach a thread from its process. */
 void proc_remthread(struct thread *t);
 
+/* Resource usage of a process's threads, present and past. */
+void proc_getusage(struct proc *proc, struct procusage *pu);
+
+/* The same plus that of its children: what its parent gets at exit. */
+void proc_exitusage(struct proc *proc, struct procusage *pu);
+
+/* Add FROM into TO. */
+void procusage_add(struct procusage *to, const struct procusage *from);
+
 /* Fetch the address space of the current process. */
 struct addrspace *curproc_getas(void);
 
@@ -113,17 +165,50 @@ struct addrspace *curproc_setas(struct addrspace *);
 struct processInfo {
 	pid_t process;
 	volatile bool active;
-	int exitStatus;
+	volatile int exitStatus;
 	pid_t parent;
+	struct procusage usage;		/* at exit, with its children's */
+	struct cv *exitcv;		/* signalled when it exits */
+	struct cv *childcv;		/* signalled when a child exits */
+	struct processInfo *children;	/* our running children */
+	struct processInfo *zombies;	/* our exited, unwaited children */
+	struct processInfo *sibling;	/* next on parent's list */
+	struct processInfo **siblingp;	/* what points at us there */
+	struct rcu_head rcu;		/* for freeing it after removal */
+	struct proc *proc;		/* until proc_destroy, or NULL */
 };
 
 void removeProcess(pid_t pid);
 
 struct processInfo* findProcess(pid_t pid);
 
-extern struct array *processes; 
-extern struct cv *waitQ;
-extern struct lock *arrayLock;
-extern struct lock *processGenLock;
+void processExited(pid_t pid, int exitStatus,
+		   const struct procusage *usage);
+
+void processSetParent(pid_t child, pid_t parent);
+
+int processFindExited(pid_t parent, pid_t pid, struct processInfo **ret);
+
+int processPeekChild(pid_t parent, pid_t pid, bool *exited);
+
+void processReap(pid_t pid);
+
+void processWakeWaiters(pid_t pid);
+
+int processSetShare(pid_t pid, unsigned tickets, unsigned *old);
+
+/*
+ * Record of a user thread created with thread_create, kept until it
+ * has been joined. The process's first thread has no record (and is
+ * thread id 0).
+ */
+struct uthread {
+	int ut_tid;			/* thread id */
+	vaddr_t ut_stack;		/* initial user stack pointer */
+	bool ut_exited;			/* true once it has exited */
+	int ut_status;			/* value passed to thread_exit */
+};
+
+extern struct lock *processesLock;
 
 #endif /* _PROC_H_ */
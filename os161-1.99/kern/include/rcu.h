@@ -0,0 +1,55 @@
+#ifndef _RCU_H_
+#define _RCU_H_
+
+/*
+ * Quiescent-state-based reclamation (a simple RCU).
+ *
+ * For tables that are read far more than they are changed. Readers
+ * bracket their traversal with rcu_read_lock and rcu_read_unlock,
+ * which only bump a per-thread counter: no lock, no atomic operation,
+ * no shared cache line. Inside, a reader must not sleep, and the
+ * timer won't preempt it.
+ *
+ * Writers serialize among themselves with an ordinary lock, and
+ * change the structure so that a reader sees either the old or the
+ * new version but never a broken one: fill in a new element first,
+ * then make it reachable with rcu_assign; unlink an old element
+ * before getting rid of it. Something unlinked may still be in use
+ * by readers that got to it earlier, so it is handed to rcu_call
+ * rather than freed, and rcu_call's function runs once every cpu has
+ * passed through a quiescent state - a context switch, or a timer
+ * tick outside any read section - after which no reader can still
+ * have it. rcu_synchronize just waits for that to happen.
+ *
+ * Callbacks are run by whoever next calls rcu_call or
+ * rcu_synchronize after their grace period is over, in thread
+ * context, so they may kfree and take locks.
+ */
+
+struct rcu_head {
+	struct rcu_head *rh_next;
+	void (*rh_func)(void *);
+	void *rh_arg;
+};
+
+void rcu_bootstrap(void);
+
+void rcu_read_lock(void);
+void rcu_read_unlock(void);
+bool rcu_read_held(void);
+
+void rcu_call(struct rcu_head *rh, void (*func)(void *), void *arg);
+void rcu_synchronize(void);
+
+/* For thread_switch and hardclock: this cpu holds no read sections. */
+void rcu_quiescent(void);
+
+/*
+ * Store a pointer that readers will follow, after everything it
+ * points to is initialized. System/161 doesn't reorder memory
+ * accesses, so this only needs to stop the compiler doing it.
+ */
+#define rcu_assign(ptr, val) \
+	do { __asm volatile("" ::: "memory"); (ptr) = (val); } while (0)
+
+#endif /* _RCU_H_ */
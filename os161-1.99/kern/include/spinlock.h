@@ -45,24 +45,50 @@
 /* Get the machine-dependent bits. */
 #include <machine/spinlock.h>
 
+#include <lockstat.h>
+
 /*
  * Basic spinlock.
  *
  * Note that spinlocks are held by CPUs, not by threads.
  *
+ * This is a ticket lock: each acquirer takes the next number from
+ * lk_next and waits until lk_owner reaches it, so CPUs get the lock
+ * in the order they asked for it.
+ *
+ * The statistics are updated only by the holder, so they need no
+ * further locking; readers take whatever they get.
+ *
  * This structure is made public so spinlocks do not have to be
  * malloc'd; however, code that uses spinlocks should not look inside
  * the structure directly but always use the spinlock API functions.
  */
 struct spinlock {
-	volatile spinlock_data_t lk_lock; /* The memory word where we spin. */
+	volatile spinlock_data_t lk_next; /* Next ticket to hand out. */
+	volatile spinlock_data_t lk_owner; /* Ticket now holding the lock. */
 	struct cpu *lk_holder;		/* CPU holding this lock. */
+
+	unsigned lk_acquires;		/* Times acquired */
+	unsigned lk_contended;		/* ...of which had to wait */
+	uint64_t lk_spins;		/* Total spin iterations waiting */
+#if OPT_LOCKSTAT
+	struct lockstat *lk_stat;	/* Record for our creation site */
+	uint64_t lk_acqtime;		/* When the holder got it */
+#endif
 };
 
 /*
  * Initializer for cases where a spinlock needs to be static or global.
+ * (Such locks have no lockstat record unless registered.)
  */
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#if OPT_LOCKSTAT
+#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, \
+				  SPINLOCK_DATA_INITIALIZER, NULL, 0, 0, 0, \
+				  NULL, 0 }
+#else
+#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, \
+				  SPINLOCK_DATA_INITIALIZER, NULL, 0, 0, 0 }
+#endif
 
 /*
  * Spinlock functions.
@@ -74,9 +100,21 @@ struct spinlock {
  * release	Release the lock. May re-enable interrupts.
  *
  * do_i_hold	Check if the current CPU holds the lock.
+ *
+ * register	Give the lock a name and add it to the list printed by
+ *		spinlock_printstats. For long-lived, interesting locks;
+ *		the list is small and entries are never removed.
+ * printstats	Print the statistics of the registered locks, and
+ *		optionally reset them.
  */
 
+#if OPT_LOCKSTAT
+/* With lock statistics, remember where each lock was set up. */
+void spinlock_init_at(struct spinlock *lk, const char *file, int line);
+#define spinlock_init(lk) spinlock_init_at(lk, __FILE__, __LINE__)
+#else
 void spinlock_init(struct spinlock *lk);
+#endif
 void spinlock_cleanup(struct spinlock *lk);
 
 void spinlock_acquire(struct spinlock *lk);
@@ -84,5 +122,15 @@ void spinlock_release(struct spinlock *lk);
 
 bool spinlock_do_i_hold(struct spinlock *lk);
 
+#if OPT_LOCKSTAT
+void spinlock_register_at(struct spinlock *lk, const char *name,
+			  const char *file, int line);
+#define spinlock_register(lk, name) \
+	spinlock_register_at(lk, name, __FILE__, __LINE__)
+#else
+void spinlock_register(struct spinlock *lk, const char *name);
+#endif
+void spinlock_printstats(bool reset);
+
 
 #endif /* _SPINLOCK_H_ */
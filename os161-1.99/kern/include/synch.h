@@ -36,6 +36,7 @@
  
  
 #include <spinlock.h>
+#include <lockstat.h>
  
 /*
  * Dijkstra-style semaphore.
@@ -78,26 +79,45 @@ struct lock {
     struct spinlock lk_lock;
         struct thread *lk_thread;
         volatile bool lk_bool;
+        volatile unsigned lk_sleeps;    /* times someone slept for it */
+#if OPT_LOCKSTAT
+        struct lockstat *lk_stat;       /* record for our creation site */
+        uint64_t lk_acqtime;            /* when the holder got it */
+#endif
         // add what you need here
         // (don't forget to mark things volatile as needed)
 };
  
+#if OPT_LOCKSTAT
+/* With lock statistics, remember where each lock was made. */
+struct lock *lock_create_at(const char *name, const char *file, int line);
+#define lock_create(name) lock_create_at(name, __FILE__, __LINE__)
+#else
 struct lock *lock_create(const char *name);
+#endif
 void lock_acquire(struct lock *);
  
 /*
  * Operations:
  *    lock_acquire - Get the lock. Only one thread can hold the lock at the
- *                   same time.
+ *                   same time. If the holder is running on another cpu,
+ *                   spins briefly before sleeping.
  *    lock_release - Free the lock. Only the thread holding the lock may do
  *                   this.
  *    lock_do_i_hold - Return true if the current thread holds the lock;
  *                   false otherwise.
+ *    lock_tryacquire - Get the lock if it is free right now and return
+ *                   true; otherwise return false without blocking.
+ *    lock_acquire_timeout - Like lock_acquire, but give up after TICKS
+ *                   timer ticks. Returns 0 if the lock was acquired,
+ *                   ETIMEDOUT if not.
  *
  * These operations must be atomic. You get to write them.
  */
 void lock_release(struct lock *);
 bool lock_do_i_hold(struct lock *);
+bool lock_tryacquire(struct lock *);
+int lock_acquire_timeout(struct lock *, uint32_t ticks);
 void lock_destroy(struct lock *);
  
  
@@ -131,16 +151,69 @@ void cv_destroy(struct cv *);
  *                   waking up again, re-acquire the lock.
  *    cv_signal    - Wake up one thread that's sleeping on this CV.
  *    cv_broadcast - Wake up all threads sleeping on this CV.
+ *    cv_timedwait - Like cv_wait, but wake up anyway after TICKS timer
+ *                   ticks. Returns 0 if woken by cv_signal/cv_broadcast,
+ *                   ETIMEDOUT if the time ran out. The lock is held
+ *                   again on return either way.
  *
- * For all three operations, the current thread must hold the lock passed
+ * For all of these operations, the current thread must hold the lock passed
  * in. Note that under normal circumstances the same lock should be used
  * on all operations with any particular CV.
  *
  * These operations must be atomic. You get to write them.
  */
 void cv_wait(struct cv *cv, struct lock *lock);
+int cv_timedwait(struct cv *cv, struct lock *lock, uint32_t ticks);
 void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
  
  
+/*
+ * Reader-writer lock.
+ *
+ * Any number of readers can hold the lock at once, or one writer.
+ * Writers are preferred: once a writer is waiting, new readers wait
+ * behind it, so a steady stream of readers cannot starve it. The
+ * catch is that a thread must not take the read lock again while it
+ * already holds it, or it can deadlock against a waiting writer.
+ *
+ * The name field is for easier debugging. A copy of the name is made
+ * internally.
+ */
+struct rwlock {
+        char *rw_name;
+        struct spinlock rw_lock;
+        struct wchan *rw_rwchan;        /* readers wait here */
+        struct wchan *rw_wwchan;        /* writers wait here */
+        volatile unsigned rw_readers;   /* readers holding the lock */
+        volatile unsigned rw_wwaiting;  /* writers waiting for it */
+        struct thread *rw_writer;       /* writer holding it, or NULL */
+};
+
+struct rwlock *rwlock_create(const char *name);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read  - Get the lock for reading. Blocks while a
+ *                           writer holds the lock or is waiting for it.
+ *    rwlock_release_read  - Give up a read hold.
+ *    rwlock_acquire_write - Get the lock for writing. Blocks until no
+ *                           one else holds it.
+ *    rwlock_release_write - Give up the write hold.
+ *    rwlock_downgrade     - Turn the current thread's write hold into a
+ *                           read hold, without letting any writer in
+ *                           between. Release it with rwlock_release_read.
+ *    rwlock_do_i_hold_write - Return true if the current thread holds
+ *                           the lock for writing. (Readers are not
+ *                           tracked individually.)
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+void rwlock_downgrade(struct rwlock *);
+bool rwlock_do_i_hold_write(struct rwlock *);
+ 
+ 
 #endif /* _SYNCH_H_ */
@@ -50,6 +50,9 @@ void enter_forked_process(struct trapframe *tf);
 void enter_new_process(int argc, userptr_t argv, vaddr_t stackptr,
 		       vaddr_t entrypoint);
 
+/* Enter user mode in a new thread of an existing process. */
+void enter_new_thread(struct trapframe *tf);
+
 
 /*
  * Prototypes for IN-KERNEL entry points for system call implementations.
@@ -57,14 +60,62 @@ void enter_new_process(int argc, userptr_t argv, vaddr_t stackptr,
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(userptr_t user_req, userptr_t user_rem);
 
 #ifdef UW
-int sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval);
+int sys_open(userptr_t upath, int flags, mode_t mode, int *retval);
+int sys_read(int fdesc, userptr_t ubuf, size_t nbytes, int *retval);
+int sys_write(int fdesc, userptr_t ubuf, size_t nbytes, int *retval);
+int sys_readv(int fdesc, userptr_t uiov, int iovcnt, int *retval);
+int sys_writev(int fdesc, userptr_t uiov, int iovcnt, int *retval);
+int sys_pread(int fdesc, userptr_t ubuf, size_t nbytes, off_t pos,
+              int *retval);
+int sys_pwrite(int fdesc, userptr_t ubuf, size_t nbytes, off_t pos,
+               int *retval);
+int sys_close(int fdesc);
+int sys_lseek(int fdesc, off_t pos, int whence, off_t *retval);
+int sys_dup2(int oldfd, int newfd, int *retval);
+int sys_fstat(int fdesc, userptr_t ustat);
+int sys_fsync(int fdesc);
+int sys_ftruncate(int fdesc, off_t len);
+int sys_getdirentry(int fdesc, userptr_t ubuf, size_t buflen, int *retval);
+int sys_chdir(userptr_t upath);
+int sys___getcwd(userptr_t ubuf, size_t buflen, int *retval);
+int sys_mkdir(userptr_t upath, mode_t mode);
+int sys_rmdir(userptr_t upath);
+int sys_remove(userptr_t upath);
+int sys_rename(userptr_t uoldpath, userptr_t unewpath);
 void sys__exit(int exitcode);
 int sys_getpid(pid_t *retval);
 int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval);
 int sys_fork(struct trapframe* tf, pid_t* retval);
-int sys_execv(char* progname, char** args);
+int sys_execv(userptr_t upath, userptr_t uargv);
+int sys_spawn(userptr_t upath, userptr_t uargv, userptr_t uactions,
+              int nactions, pid_t *retval);
+int sys_getrusage(int who, userptr_t usage);
+int sys_setshare(pid_t pid, int tickets, int *retval);
+int sys___thread_create(struct trapframe *tf, userptr_t start,
+                        userptr_t func, userptr_t arg, int *retval);
+int sys_thread_exit(int status);
+int sys_thread_join(int tid, userptr_t status);
+int sys_futex(userptr_t uaddr, int op, int val, int *retval);
+int sys___sysstat(int callno, userptr_t ustat);
+
+/* thread_syscalls.c helpers */
+void uthread_exit(int status);
+void uthread_exitall(void);
+void uthread_stopall(void);
+void uthread_resumeall(void);
+void uthread_checkstop(void);
+bool uthread_cancelled(void);
+
+/* proc_syscalls.c helpers */
+void argbuf_bootstrap(void);
+
+/* futex.c helpers */
+struct addrspace;
+void futex_bootstrap(void);
+void futex_cancel(struct addrspace *as);
 
 #endif // UW
 
@@ -0,0 +1,31 @@
+#ifndef _SYSSTAT_H_
+#define _SYSSTAT_H_
+
+/*
+ * System call statistics; see <kern/sysstat.h> for what is kept.
+ *
+ * Each cpu has its own table (c_sysstat), which only that cpu writes,
+ * with interrupts off so a thread can't be moved mid-update. Reading
+ * merges all the cpus' tables without locking, so a total taken
+ * while calls are running may be a call or two out.
+ *
+ * sysstat_cpucreate - allocate a new cpu's table.
+ * sysstat_enter     - count a call as it starts; returns the time
+ *                     for sysstat_exit.
+ * sysstat_exit      - account for a call that is returning ERR.
+ * sysstat_get       - merged figures for one call number.
+ * sysstat_print     - print the calls that have been made, and
+ *                     optionally zero the tables.
+ */
+
+#include <kern/sysstat.h>
+
+struct cpu;
+
+void sysstat_cpucreate(struct cpu *c);
+uint64_t sysstat_enter(int callno);
+void sysstat_exit(int callno, int err, uint64_t start);
+void sysstat_get(int callno, struct sysstat *ss);
+void sysstat_print(bool reset);
+
+#endif /* _SYSSTAT_H_ */
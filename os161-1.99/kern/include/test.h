@@ -60,6 +60,12 @@ int threadtest3(int, char **);
 int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
+int cvtimedtest(int, char **);
+int locktimedtest(int, char **);
+int lockbench(int, char **);
+int rwtest(int, char **);
+int atomictest(int, char **);
+int rcutest(int, char **);
 
 #ifdef UW
 /* Another thread and synchronization test */
@@ -52,6 +52,9 @@ struct cpu;
 /* Mask for extracting the stack base address of a kernel stack pointer */
 #define STACK_MASK  (~(vaddr_t)(STACK_SIZE-1))
 
+/* Names shorter than this are stored in the thread itself */
+#define THREAD_NAMEBUF 16
+
 /* Macro to test if two addresses are on the same kernel stack */
 #define SAME_STACK(p1, p2)     (((p1) & STACK_MASK) == ((p2) & STACK_MASK))
 
@@ -71,6 +74,7 @@ struct thread {
 	 * debugger is messed up.
 	 */
 	char *t_name;			/* Name of this thread */
+	char t_namebuf[THREAD_NAMEBUF];	/* Storage for short names */
 	const char *t_wchan_name;	/* Name of wait channel, if sleeping */
 	threadstate_t t_state;		/* State this thread is in */
 
@@ -83,6 +87,8 @@ struct thread {
 	struct switchframe *t_context;	/* Saved register context (on stack) */
 	struct cpu *t_cpu;		/* CPU thread runs on */
 	struct proc *t_proc;		/* Process thread belongs to */
+	int t_tid;			/* User thread id within t_proc */
+	struct wchan *t_wchan;		/* Wait channel, if sleeping */
 
 	/*
 	 * Interrupt state fields.
@@ -98,9 +104,61 @@ struct thread {
 	 * rather than per-cpu or global?
 	 */
 	bool t_in_interrupt;		/* Are we in an interrupt? */
+	bool t_intr_fromuser;		/* Was that interrupt from usermode? */
 	int t_curspl;			/* Current spl*() state */
 	int t_iplhigh_count;		/* # of times IPL has been raised */
 
+	/*
+	 * Accounting fields.
+	 *
+	 * t_utime and t_stime count hardclock ticks that found the
+	 * thread running in user mode and in the kernel respectively.
+	 * t_waitticks is the total time (in timer ticks, see clock.h)
+	 * the thread has spent on a run queue waiting for a CPU.
+	 * t_minflt counts vm faults, and t_inbytes and t_outbytes the
+	 * bytes uiomove has moved to and from user space for it.
+	 * Updated only by the cpu the thread is on; readers take
+	 * whatever they get.
+	 */
+	unsigned t_utime;		/* hardclocks in user mode */
+	unsigned t_stime;		/* hardclocks in the kernel */
+	unsigned t_nvcsw;		/* voluntary context switches */
+	unsigned t_nivcsw;		/* involuntary context switches */
+	unsigned t_minflt;		/* vm faults */
+	uint64_t t_inbytes;		/* bytes read into user space */
+	uint64_t t_outbytes;		/* bytes written from user space */
+	uint32_t t_readystamp;		/* timer tick when made runnable */
+	uint32_t t_waitticks;		/* timer ticks spent runnable */
+	unsigned t_allindex;		/* index in the all-threads array */
+
+	/*
+	 * Stride scheduling (see thread.c). t_pass is the thread's
+	 * virtual time; it advances by the process's stride for each
+	 * hardclock tick the thread runs, and the run queue is kept
+	 * sorted by it. Protected by the run queue lock of t_cpu,
+	 * except that the running thread charges itself.
+	 */
+	uint64_t t_pass;
+
+	/*
+	 * Preemption deferral (see hardclock). t_locksheld counts the
+	 * sleeping locks (struct lock) the thread holds. While it is
+	 * nonzero, hardclock may skip the per-tick yield, counting the
+	 * skipped ticks in t_preemptdeferred and setting t_yieldpending;
+	 * lock_release then yields when the last lock is dropped. Only
+	 * touched by the thread itself and by interrupts on its cpu.
+	 */
+	unsigned t_locksheld;
+	unsigned t_preemptdeferred;
+	bool t_yieldpending;
+
+	/*
+	 * RCU read-section nesting depth (see rcu.h). While nonzero,
+	 * hardclock doesn't preempt the thread (it sets t_yieldpending
+	 * instead) and the thread must not sleep.
+	 */
+	unsigned t_rcunest;
+
 	/*
 	 * Public fields
 	 */
@@ -162,11 +220,36 @@ void thread_yield(void);
  */
 void schedule(void);
 
+/*
+ * Charge one hardclock tick to the stride scheduler's pass value for
+ * the current thread. Called from the timer interrupt.
+ */
+void thread_charge_pass(void);
+
+/*
+ * Take a yield that hardclock put off because we held a lock. Called
+ * by lock_release; does nothing if no yield is owed, or if it isn't
+ * safe to switch right now (spinlock held or interrupts off).
+ */
+void thread_yield_deferred(void);
+
 /*
  * Potentially migrate ready threads to other CPUs. Called from the
  * timer interrupt.
  */
 void thread_consider_migration(void);
 
+/*
+ * Print a table of all threads with their CPU accounting, busiest
+ * first. For the kernel menu.
+ */
+void thread_printstats(void);
+
+/*
+ * Free the exited threads kept for reuse on all cpus. Called when
+ * memory is short. Returns the number of threads freed.
+ */
+unsigned thread_cache_reclaim(void);
+
 
 #endif /* _THREAD_H_ */
@@ -52,7 +52,7 @@ struct stat;
  * need to worry about it.
  */
 struct vnode {
-	int vn_refcount;                /* Reference count */
+	volatile int vn_refcount;       /* Reference count (atomic) */
 	int vn_opencount;
 
 	struct fs *vn_fs;               /* Filesystem vnode belongs to */
@@ -276,9 +276,15 @@ void vnode_check(struct vnode *, const char *op);
 
 /*
  * Reference count manipulation (handled above filesystem level)
+ *
+ * The count is updated atomically; only dropping the last reference
+ * takes the big lock. vnode_decref_unlesslast is for VOP_RECLAIM,
+ * which must give its reference back (and return EBUSY) if it finds
+ * the vnode in use again.
  */
 void vnode_incref(struct vnode *);
 void vnode_decref(struct vnode *);
+bool vnode_decref_unlesslast(struct vnode *);
 
 #define VOP_INCREF(vn) 			vnode_incref(vn)
 #define VOP_DECREF(vn) 			vnode_decref(vn)
@@ -71,6 +71,13 @@ void wchan_unlock(struct wchan *wc);
  */
 void wchan_sleep(struct wchan *wc);
 
+/*
+ * Like wchan_sleep, but wake up by ourselves after NUM_TICKS timer
+ * ticks if nobody else has. Returns 0 if woken normally, ETIMEDOUT on
+ * timeout.
+ */
+int wchan_timedsleep(struct wchan *wc, uint32_t num_ticks);
+
 /*
  * Wake up one thread, or all threads, sleeping on a wait channel.
  * The queue should not already be locked.
@@ -81,5 +88,15 @@ void wchan_sleep(struct wchan *wc);
 void wchan_wakeone(struct wchan *wc);
 void wchan_wakeall(struct wchan *wc);
 
+/*
+ * Wake up one particular thread, if it is sleeping on the wait
+ * channel. Returns true if it was, false if it wasn't (e.g. because
+ * someone else already woke it). Unlike the other wakeup calls, the
+ * channel must already be locked, so the caller can update whatever
+ * condition the thread sleeps on atomically with the wakeup.
+ */
+struct thread;
+bool wchan_wakethread(struct wchan *wc, struct thread *target);
+
 
 #endif /* _WCHAN_H_ */
@@ -49,16 +49,16 @@
 #include <vnode.h>
 #include <vfs.h>
 #include <synch.h>
+#include <atomic.h>
+#include <rcu.h>
+#include <openfile.h>
 #include <kern/fcntl.h>  
 #include "opt-A2.h"
 #include <limits.h> // new
 #include <kern/errno.h>
 #include <thread.h>
 
-struct array *processes; 
-struct cv *waitQ;
-struct lock *arrayLock;
-struct lock *processGenLock;
+struct lock *processesLock;
 
 /*
  * The process for the kernel; this holds all the kernel-only threads.
@@ -69,34 +69,416 @@ struct proc *kproc;
  * Mechanism for making the kernel menu thread sleep while processes are running
  */
 #ifdef UW
-/* count of the number of processes, excluding kproc */
-static volatile unsigned int proc_count;
-/* provides mutual exclusion for proc_count */
-/* it would be better to use a lock here, but we use a semaphore because locks are not implemented in the base kernel */ 
-static struct semaphore *proc_count_mutex;
+/* count of the number of processes, excluding kproc; updated atomically */
+static volatile int proc_count;
 /* used to signal the kernel menu thread when there are no processes */
 struct semaphore *no_proc_sem;   
 #endif  // UW
 
+/*
+ * The process table.
+ *
+ * Records are found by pid through pidmap, a two-level radix array:
+ * the top level has a pointer to a leaf for each PIDMAP_LEAFSIZE
+ * pids, allocated when first needed and kept for good. Lookups that
+ * only look read it inside rcu_read_lock (see rcu.h) without taking
+ * any lock; see processPeekChild.
+ *
+ * Each record is also on one of its parent's two lists of children:
+ * children while it runs, zombies once it has exited and until it is
+ * waited for. So exiting only has to visit the process's own
+ * children, and waiting for any child only has to look at the head of
+ * the zombie list. Each record has its own exit cv, which
+ * processReap sleeps on, and a child cv, which waitpid sleeps on.
+ * It also points at its struct proc until proc_destroy, so another
+ * process's proc can be found by pid (see processSetShare).
+ *
+ * Everything that changes the table - adding and removing records,
+ * and setting their fields - holds processesLock, as does anything
+ * that needs a consistent view or has to sleep. A removed record is
+ * taken out of the map and the list, and kfree'd by RCU once no
+ * reader can still be looking at it.
+ *
+ * pidused has a bit for each pid, set while the pid has a record.
+ * New pids are handed out in order from pidcursor, which goes round
+ * the whole range, so a pid is not used again until every other one
+ * has been; the search looks at a word of the bitmap at a time.
+ *
+ * processesLock is also the lock for those cvs.
+ */
+#define PIDMAP_LEAFBITS		8
+#define PIDMAP_LEAFSIZE		(1 << PIDMAP_LEAFBITS)
+#define PIDMAP_TOPSIZE		((PID_MAX >> PIDMAP_LEAFBITS) + 1)
+#define PIDUSED_WORDS		((PID_MAX + 32) / 32)
+
+static struct processInfo **pidmap[PIDMAP_TOPSIZE];
+static uint32_t pidused[PIDUSED_WORDS];
+static pid_t pidcursor;
+
+static void pidmap_init(void) {
+	unsigned i;
+
+	for (i = 0; i < PIDMAP_TOPSIZE; i++) {
+		pidmap[i] = NULL;
+	}
+	for (i = 0; i < PIDUSED_WORDS; i++) {
+		pidused[i] = 0;
+	}
+	/* never hand out pids below PID_MIN or above PID_MAX */
+	for (i = 0; i < PID_MIN; i++) {
+		pidused[i / 32] |= (uint32_t)1 << (i % 32);
+	}
+	for (i = PID_MAX + 1; i < PIDUSED_WORDS * 32; i++) {
+		pidused[i / 32] |= (uint32_t)1 << (i % 32);
+	}
+	pidcursor = PID_MIN;
+}
+
+/*
+ * Find a free pid, starting at pidcursor, and mark it used. Returns
+ * -1 if there are none. The word the cursor is in gets looked at
+ * twice: first from the cursor up, and at the end of the lap below it.
+ */
+static pid_t pid_alloc(void) {
+	unsigned start, w, i, bit;
+	uint32_t bits;
+	pid_t pid;
+
+	KASSERT(lock_do_i_hold(processesLock));
+
+	start = pidcursor / 32;
+	for (i = 0; i <= PIDUSED_WORDS; i++) {
+		w = (start + i) % PIDUSED_WORDS;
+		bits = pidused[w];
+		if (i == 0) {
+			bits |= ((uint32_t)1 << (pidcursor % 32)) - 1;
+		}
+		if (bits == 0xffffffff) {
+			continue;
+		}
+		for (bit = 0; bits & ((uint32_t)1 << bit); bit++) {
+			/* find the first clear bit */
+		}
+		pidused[w] |= (uint32_t)1 << bit;
+		pid = w * 32 + bit;
+		pidcursor = (pid == PID_MAX) ? PID_MIN : pid + 1;
+		return pid;
+	}
+	return -1;
+}
+
+static void pid_free(pid_t pid) {
+	KASSERT(lock_do_i_hold(processesLock));
+	KASSERT(pidused[pid / 32] & ((uint32_t)1 << (pid % 32)));
+
+	pidused[pid / 32] &= ~((uint32_t)1 << (pid % 32));
+}
+
 struct processInfo* findProcess(pid_t pid) {
-	struct processInfo* p; 
+	struct processInfo **leaf;
+
+	KASSERT(rcu_read_held() || lock_do_i_hold(processesLock));
 
-	for (unsigned int i = 0; i < array_num(processes); i++)	{
-		p=array_get(processes, i);
-		if (p->process == pid) { return p;}
+	if (pid < PID_MIN || pid > PID_MAX) {
+		return NULL;
+	}
+	leaf = pidmap[pid >> PIDMAP_LEAFBITS];
+	if (leaf == NULL) {
+		return NULL;
 	}
-	return NULL;
+	return leaf[pid & (PIDMAP_LEAFSIZE - 1)];
+}
+
+/*
+ * Give P a pid and put it in the table. Returns the pid, or -1 if
+ * there are no pids (or no memory for the map) left.
+ */
+static pid_t addProcess(struct processInfo *p) {
+	struct processInfo **leaf;
+	pid_t pid;
+	unsigned i;
+
+	KASSERT(lock_do_i_hold(processesLock));
+
+	pid = pid_alloc();
+	if (pid == -1) {
+		return -1;
+	}
+
+	leaf = pidmap[pid >> PIDMAP_LEAFBITS];
+	if (leaf == NULL) {
+		leaf = kmalloc(PIDMAP_LEAFSIZE * sizeof(*leaf));
+		if (leaf == NULL) {
+			pid_free(pid);
+			return -1;
+		}
+		for (i = 0; i < PIDMAP_LEAFSIZE; i++) {
+			leaf[i] = NULL;
+		}
+		rcu_assign(pidmap[pid >> PIDMAP_LEAFBITS], leaf);
+	}
+
+	p->process = pid;
+	p->parent = -1;
+	p->children = NULL;
+	p->zombies = NULL;
+	p->sibling = NULL;
+	p->siblingp = NULL;
+
+	/* fully set up; now let readers see it */
+	rcu_assign(leaf[pid & (PIDMAP_LEAFSIZE - 1)], p);
+	return pid;
+}
+
+static void freeProcessInfo(void *ptr) {
+	struct processInfo *p = ptr;
+
+	cv_destroy(p->exitcv);
+	cv_destroy(p->childcv);
+	kfree(p);
+}
+
+/*
+ * Take P off whichever of its parent's lists it is on.
+ */
+static void unlinkChild(struct processInfo *p) {
+	KASSERT(lock_do_i_hold(processesLock));
+
+	if (p->siblingp != NULL) {
+		*p->siblingp = p->sibling;
+		if (p->sibling != NULL) {
+			p->sibling->siblingp = p->siblingp;
+		}
+		p->sibling = NULL;
+		p->siblingp = NULL;
+	}
+}
+
+/*
+ * Put P on the front of the list *HEADP.
+ */
+static void linkChild(struct processInfo *p, struct processInfo **headp) {
+	KASSERT(lock_do_i_hold(processesLock));
+	KASSERT(p->siblingp == NULL);
+
+	p->sibling = *headp;
+	p->siblingp = headp;
+	if (*headp != NULL) {
+		(*headp)->siblingp = &p->sibling;
+	}
+	*headp = p;
+}
+
+/*
+ * Make PARENT the parent of CHILD, which has none yet.
+ */
+void processSetParent(pid_t child, pid_t parent) {
+	struct processInfo *c, *p;
+
+	lock_acquire(processesLock);
+	c = findProcess(child);
+	p = findProcess(parent);
+	KASSERT(c != NULL && p != NULL);
+	KASSERT(c->parent == -1);
+
+	c->parent = parent;
+	linkChild(c, &p->children);
+	lock_release(processesLock);
 }
 
 void removeProcess(pid_t pid) {
-	struct processInfo* p; 
+	struct processInfo *p;
+
+	KASSERT(lock_do_i_hold(processesLock));
+
+	p = findProcess(pid);
+	if (p == NULL) {
+		return;
+	}
+
+	/* orphans are unlinked when their parent exits */
+	KASSERT(p->children == NULL && p->zombies == NULL);
+
+	pidmap[pid >> PIDMAP_LEAFBITS][pid & (PIDMAP_LEAFSIZE - 1)] = NULL;
+	unlinkChild(p);
+	pid_free(pid);
+
+	/* readers may still have it */
+	rcu_call(&p->rcu, freeProcessInfo, p);
+}
+
+/*
+ * Record that process PID has exited with EXITSTATUS (already encoded
+ * with _MKWAIT_*), orphan its children, and wake up its parent if it
+ * has one. Children that have already exited are nobody's business
+ * any more and go away, as does PID itself if it has no parent.
+ */
+void processExited(pid_t pid, int exitStatus,
+		   const struct procusage *usage) {
+	struct processInfo *p, *c, *next, *parent;
+
+	lock_acquire(processesLock);
+	p = findProcess(pid);
+	p->exitStatus = exitStatus;
+	if (usage != NULL) {
+		p->usage = *usage;
+	}
+	p->active = false;
+
+	for (c = p->children; c != NULL; c = next) {
+		next = c->sibling;
+		c->parent = -1;
+		c->sibling = NULL;
+		c->siblingp = NULL;
+	}
+	p->children = NULL;
+	for (c = p->zombies; c != NULL; c = next) {
+		next = c->sibling;
+		c->parent = -1;
+		c->sibling = NULL;
+		c->siblingp = NULL;
+		removeProcess(c->process);
+	}
+	p->zombies = NULL;
+
+	if (p->parent == -1) {
+		removeProcess(pid);
+	}
+	else {
+		parent = findProcess(p->parent);
+		unlinkChild(p);
+		linkChild(p, &parent->zombies);
+		cv_broadcast(p->exitcv, processesLock);
+		cv_broadcast(parent->childcv, processesLock);
+	}
+	lock_release(processesLock);
+}
+
+/*
+ * Wait for child PID to exit and throw its record away: for a child
+ * whose exit status nobody is going to ask for. Does nothing if
+ * another thread has already collected it.
+ */
+void processReap(pid_t pid) {
+	struct processInfo *p;
+
+	lock_acquire(processesLock);
+	while ((p = findProcess(pid)) != NULL && p->active) {
+		cv_wait(p->exitcv, processesLock);
+	}
+	if (p != NULL) {
+		removeProcess(pid);
+	}
+	lock_release(processesLock);
+}
+
+/*
+ * Wake any thread of process PID waiting for a child, so that it
+ * notices its own process is exiting or execing (see waitpid).
+ */
+void processWakeWaiters(pid_t pid) {
+	lock_acquire(processesLock);
+	cv_broadcast(findProcess(pid)->childcv, processesLock);
+	lock_release(processesLock);
+}
 
-	for (unsigned int i = 0; i < array_num(processes); i++) {
-		p = array_get(processes, i);
-		if (p->process == pid) {
-			array_remove(processes, i);
+/*
+ * Give process PID TICKETS scheduler tickets and return the old number
+ * in *OLD. Returns ESRCH if there is no such process, or it has exited.
+ * Holding processesLock keeps proc_destroy from freeing the proc under
+ * us.
+ */
+int processSetShare(pid_t pid, unsigned tickets, unsigned *old) {
+	struct processInfo *p;
+	struct proc *proc;
+	int result;
+
+	lock_acquire(processesLock);
+	p = findProcess(pid);
+	proc = (p != NULL && p->active) ? p->proc : NULL;
+	if (proc == NULL) {
+		result = ESRCH;
+	}
+	else {
+		spinlock_acquire(&proc->p_lock);
+		*old = proc->p_tickets;
+		proc->p_tickets = tickets;
+		spinlock_release(&proc->p_lock);
+		result = 0;
+	}
+	lock_release(processesLock);
+	return result;
+}
+
+/*
+ * Find a child of process PARENT that has exited: PID itself, or any
+ * child if PID is -1. Returns 0 and sets *RET to the record (or NULL
+ * if there are children but none has exited yet), or returns an error:
+ * ESRCH if PID doesn't exist, ECHILD if it isn't PARENT's child or
+ * PARENT has no children at all.
+ */
+int processFindExited(pid_t parent, pid_t pid, struct processInfo **ret) {
+	struct processInfo *p;
+
+	KASSERT(lock_do_i_hold(processesLock));
+
+	if (pid == -1) {
+		p = findProcess(parent);
+		if (p->zombies != NULL) {
+			*ret = p->zombies;
+			return 0;
 		}
+		*ret = NULL;
+		return (p->children == NULL) ? ECHILD : 0;
+	}
+
+	p = findProcess(pid);
+	if (p == NULL) {
+		return ESRCH;
+	}
+	if (p->parent != parent) {
+		return ECHILD;
 	}
+	*ret = p->active ? NULL : p;
+	return 0;
+}
+
+/*
+ * Lockless check for waitpid: would processFindExited fail, and has
+ * the child (PID, or any child if PID is -1) already exited? Returns
+ * the same errors, and otherwise sets *EXITED. The answer may be out
+ * of date by the time it is used, but only in ways a waitpid that
+ * ran a moment earlier or later could also have seen: PARENT is the
+ * caller's own process, so only its own threads can reap its
+ * children, and a child's parent doesn't change while it is alive.
+ */
+int processPeekChild(pid_t parent, pid_t pid, bool *exited) {
+	struct processInfo *p;
+	int result = 0;
+
+	rcu_read_lock();
+	if (pid == -1) {
+		p = findProcess(parent);
+		*exited = p->zombies != NULL;
+		if (!*exited && p->children == NULL) {
+			result = ECHILD;
+		}
+	}
+	else {
+		p = findProcess(pid);
+		if (p == NULL) {
+			result = ESRCH;
+		}
+		else if (p->parent != parent) {
+			result = ECHILD;
+		}
+		else {
+			*exited = !p->active;
+		}
+	}
+	rcu_read_unlock();
+
+	return result;
 }
 
 /*
@@ -107,6 +489,7 @@ struct proc *
 proc_create(const char *name)
 {
 	struct proc *proc;
+	int i;
 
 	proc = kmalloc(sizeof(*proc));
 	if (proc == NULL) {
@@ -127,9 +510,39 @@ proc_create(const char *name)
 	/* VFS fields */
 	proc->p_cwd = NULL;
 
-#ifdef UW
-	proc->console = NULL;
-#endif // UW
+	proc->p_tickets = PROC_TICKETS_DEFAULT;
+	bzero(&proc->p_usage, sizeof(proc->p_usage));
+	bzero(&proc->p_childusage, sizeof(proc->p_childusage));
+
+	/* user thread fields */
+	proc->p_uthread_lock = lock_create(name);
+	proc->p_uthread_cv = cv_create(name);
+	proc->p_uthreads = array_create();
+	if (proc->p_uthread_lock == NULL || proc->p_uthread_cv == NULL ||
+	    proc->p_uthreads == NULL) {
+		if (proc->p_uthread_lock != NULL) {
+			lock_destroy(proc->p_uthread_lock);
+		}
+		if (proc->p_uthread_cv != NULL) {
+			cv_destroy(proc->p_uthread_cv);
+		}
+		if (proc->p_uthreads != NULL) {
+			array_destroy(proc->p_uthreads);
+		}
+		threadarray_cleanup(&proc->p_threads);
+		spinlock_cleanup(&proc->p_lock);
+		kfree(proc->p_name);
+		kfree(proc);
+		return NULL;
+	}
+	proc->p_nexttid = 1;
+	proc->p_exiting = false;
+	proc->p_stopper = NULL;
+	proc->p_nparked = 0;
+	proc->p_reapnext = NULL;
+	for (i=0; i<OPEN_MAX; i++) {
+		proc->p_files[i] = NULL;
+	}
 
 	return proc;
 }
@@ -140,9 +553,13 @@ proc_create(const char *name)
 void
 proc_destroy(struct proc *proc)
 {
+#ifdef UW
+	int count;
+#endif
+
 	/*
          * note: some parts of the process structure, such as the address space,
-         *  are destroyed in sys_exit, before we get here
+         *  are destroyed by the reaper (see proc_exit), before we get here
          *
          * note: depending on where this function is called from, curproc may not
          * be defined because the calling thread may have already detached itself
@@ -152,6 +569,20 @@ proc_destroy(struct proc *proc)
 	KASSERT(proc != NULL);
 	KASSERT(proc != kproc);
 
+#if OPT_A2
+	/* setshare can't find it any more */
+	if (proc->pid != -1) {
+		struct processInfo *p;
+
+		lock_acquire(processesLock);
+		p = findProcess(proc->pid);
+		if (p != NULL && p->proc == proc) {
+			p->proc = NULL;
+		}
+		lock_release(processesLock);
+	}
+#endif
+
 	/*
 	 * We don't take p_lock in here because we must have the only
 	 * reference to this structure. (Otherwise it would be
@@ -185,11 +616,16 @@ proc_destroy(struct proc *proc)
 	}
 #endif // UW
 
-#ifdef UW
-	if (proc->console) {
-	  vfs_close(proc->console);
+	filetable_closeall(proc);
+
+	/* Unjoined thread records are simply discarded. */
+	while (array_num(proc->p_uthreads) > 0) {
+		kfree(array_get(proc->p_uthreads, 0));
+		array_remove(proc->p_uthreads, 0);
 	}
-#endif // UW
+	array_destroy(proc->p_uthreads);
+	cv_destroy(proc->p_uthread_cv);
+	lock_destroy(proc->p_uthread_lock);
 
 	threadarray_cleanup(&proc->p_threads);
 	spinlock_cleanup(&proc->p_lock);
@@ -202,19 +638,104 @@ proc_destroy(struct proc *proc)
         /* note: kproc is not included in the process count, but proc_destroy
 	   is never called on kproc (see KASSERT above), so we're OK to decrement
 	   the proc_count unconditionally here */
-	P(proc_count_mutex); 
-	KASSERT(proc_count > 0);
-	proc_count--;
+	count = atomic_dec(&proc_count);
+	KASSERT(count >= 0);
 	/* signal the kernel menu thread if the process count has reached zero */
-	if (proc_count == 0) {
+	if (count == 0) {
 	  V(no_proc_sem);
 	}
-	V(proc_count_mutex);
 #endif // UW
 	
 
 }
 
+/*
+ * The reaper.
+ *
+ * A process's last thread doesn't tear the process down itself: once
+ * its exit status is recorded (and its parent can have it), it just
+ * detaches from the process and puts it on the reaper's list. The
+ * reaper thread destroys the address spaces and processes on the list
+ * in batches, off the exiting cpu's path.
+ */
+static struct lock *reaper_lock;
+static struct cv *reaper_cv;
+static struct proc *reaper_list;
+
+static
+void
+proc_reaper(void *unused1, unsigned long unused2)
+{
+	struct proc *list, *proc;
+	struct addrspace *as;
+
+	(void)unused1;
+	(void)unused2;
+
+	lock_acquire(reaper_lock);
+	while (1) {
+		while (reaper_list == NULL) {
+			cv_wait(reaper_cv, reaper_lock);
+		}
+		list = reaper_list;
+		reaper_list = NULL;
+		lock_release(reaper_lock);
+
+		while (list != NULL) {
+			proc = list;
+			list = proc->p_reapnext;
+
+			KASSERT(threadarray_num(&proc->p_threads) == 0);
+			as = proc->p_addrspace;
+			proc->p_addrspace = NULL;
+			if (as != NULL) {
+				as_destroy(as);
+			}
+			proc_destroy(proc);
+		}
+
+		lock_acquire(reaper_lock);
+	}
+}
+
+void
+proc_reaper_bootstrap(void)
+{
+	int result;
+
+	reaper_lock = lock_create("reaper");
+	reaper_cv = cv_create("reaper");
+	if (reaper_lock == NULL || reaper_cv == NULL) {
+		panic("proc_reaper_bootstrap: out of memory\n");
+	}
+	reaper_list = NULL;
+
+	result = thread_fork("reaper", NULL, proc_reaper, NULL, 0);
+	if (result) {
+		panic("proc_reaper_bootstrap: thread_fork: %s\n",
+		      strerror(result));
+	}
+}
+
+void
+proc_exit(void)
+{
+	struct proc *proc = curproc;
+
+	KASSERT(proc != NULL && proc != kproc);
+	KASSERT(threadarray_num(&proc->p_threads) == 1);
+
+	/* the address space goes with the process */
+	as_deactivate();
+	proc_remthread(curthread);
+
+	lock_acquire(reaper_lock);
+	proc->p_reapnext = reaper_list;
+	reaper_list = proc;
+	cv_signal(reaper_cv, reaper_lock);
+	lock_release(reaper_lock);
+}
+
 /*
  * Create the process structure for the kernel.
  */
@@ -222,11 +743,8 @@ void
 proc_bootstrap(void)
 {
 	#if OPT_A2
-	arrayLock = lock_create("arrayLock");
-  processGenLock = lock_create("processGenLock");
-  waitQ = cv_create("waitQ");
-	processes = array_create();
-  array_init(processes);
+	processesLock = lock_create("processesLock");
+	pidmap_init();
 
 	#endif
   kproc = proc_create("[kernel]");
@@ -235,10 +753,6 @@ proc_bootstrap(void)
   }
 #ifdef UW
   proc_count = 0;
-  proc_count_mutex = sem_create("proc_count_mutex",1);
-  if (proc_count_mutex == NULL) {
-    panic("could not create proc_count_mutex semaphore\n");
-  }
   no_proc_sem = sem_create("no_proc_sem",0);
   if (no_proc_sem == NULL) {
     panic("could not create no_proc_sem semaphore\n");
@@ -256,7 +770,6 @@ struct proc *
 proc_create_runprogram(const char *name)
 {
 	struct proc *proc;
-	char *console_path;
 
 	proc = proc_create(name);
 	if (proc == NULL) {
@@ -264,41 +777,52 @@ proc_create_runprogram(const char *name)
 	}
 
 	#if OPT_A2
-	lock_acquire(processGenLock);
-	pid_t potentialPID = -1;
-	for(int i= PID_MIN; i <= PID_MAX; i++) {
-		if (findProcess(i) == NULL) {
-			potentialPID = i;
-			break;
+	struct processInfo* p = kmalloc(sizeof(struct processInfo));
+	if (p != NULL) {
+		p->exitcv = cv_create("exitcv");
+		p->childcv = cv_create("childcv");
+		if (p->exitcv == NULL || p->childcv == NULL) {
+			if (p->exitcv != NULL) {
+				cv_destroy(p->exitcv);
+			}
+			if (p->childcv != NULL) {
+				cv_destroy(p->childcv);
+			}
+			kfree(p);
+			p = NULL;
+		}
+	}
+	if (p == NULL) {
+		proc->pid = -1;
+	}
+	else {
+		p->active = true;
+		p->exitStatus = -1;
+		p->proc = proc;
+
+		lock_acquire(processesLock);
+		proc->pid = addProcess(p);
+		lock_release(processesLock);
+		if (proc->pid == -1) {
+			cv_destroy(p->exitcv);
+			cv_destroy(p->childcv);
+			kfree(p);
 		}
 	}
-	proc->pid = potentialPID;
-
-	struct processInfo* p=kmalloc(sizeof(struct processInfo));
-
-	p->process = potentialPID;
-	p->parent = -1;
-	p->active = true;
-	p->exitStatus = -1;
-
-	lock_release(processGenLock);
-
-	lock_acquire(arrayLock);
-	array_add(processes,p, NULL);
-	lock_release(arrayLock);
 	#endif
 
-#ifdef UW
-	/* open the console - this should always succeed */
-	console_path = kstrdup("con:");
-	if (console_path == NULL) {
-	  panic("unable to copy console path name during process creation\n");
+	/*
+	 * Descriptors come from the creator; the first process, started
+	 * from the menu, gets the console.
+	 */
+	if (curproc == kproc) {
+		if (filetable_openconsole(proc)) {
+			panic("unable to open the console during process creation\n");
+		}
 	}
-	if (vfs_open(console_path,O_WRONLY,0,&(proc->console))) {
-	  panic("unable to open the console during process creation\n");
+	else {
+		filetable_copy(curproc, proc);
 	}
-	kfree(console_path);
-#endif // UW
 	  
 	/* VM fields */
 
@@ -327,9 +851,7 @@ proc_create_runprogram(const char *name)
 	/* increment the count of processes */
         /* we are assuming that all procs, including those created by fork(),
            are created using a call to proc_create_runprogram  */
-	P(proc_count_mutex); 
-	proc_count++;
-	V(proc_count_mutex);
+	atomic_inc(&proc_count);
 #endif // UW
 	return proc;
 }
@@ -355,6 +877,23 @@ proc_addthread(struct proc *proc, struct thread *t)
 	return 0;
 }
 
+/*
+ * Add thread T's usage into PU.
+ */
+static
+void
+procusage_addthread(struct procusage *pu, struct thread *t)
+{
+	pu->pu_utime += t->t_utime;
+	pu->pu_stime += t->t_stime;
+	pu->pu_waitticks += t->t_waitticks;
+	pu->pu_nvcsw += t->t_nvcsw;
+	pu->pu_nivcsw += t->t_nivcsw;
+	pu->pu_minflt += t->t_minflt;
+	pu->pu_inbytes += t->t_inbytes;
+	pu->pu_outbytes += t->t_outbytes;
+}
+
 /*
  * Remove a thread from its process. Either the thread or the process
  * might or might not be current.
@@ -374,6 +913,8 @@ proc_remthread(struct thread *t)
 	for (i=0; i<num; i++) {
 		if (threadarray_get(&proc->p_threads, i) == t) {
 			threadarray_remove(&proc->p_threads, i);
+			/* its usage stays with the process */
+			procusage_addthread(&proc->p_usage, t);
 			spinlock_release(&proc->p_lock);
 			t->t_proc = NULL;
 			return;
@@ -384,6 +925,42 @@ proc_remthread(struct thread *t)
 	panic("Thread (%p) has escaped from its process (%p)\n", t, proc);
 }
 
+void
+procusage_add(struct procusage *to, const struct procusage *from)
+{
+	to->pu_utime += from->pu_utime;
+	to->pu_stime += from->pu_stime;
+	to->pu_waitticks += from->pu_waitticks;
+	to->pu_nvcsw += from->pu_nvcsw;
+	to->pu_nivcsw += from->pu_nivcsw;
+	to->pu_minflt += from->pu_minflt;
+	to->pu_inbytes += from->pu_inbytes;
+	to->pu_outbytes += from->pu_outbytes;
+}
+
+void
+proc_getusage(struct proc *proc, struct procusage *pu)
+{
+	unsigned i, num;
+
+	spinlock_acquire(&proc->p_lock);
+	*pu = proc->p_usage;
+	num = threadarray_num(&proc->p_threads);
+	for (i=0; i<num; i++) {
+		procusage_addthread(pu, threadarray_get(&proc->p_threads, i));
+	}
+	spinlock_release(&proc->p_lock);
+}
+
+void
+proc_exitusage(struct proc *proc, struct procusage *pu)
+{
+	proc_getusage(proc, pu);
+	spinlock_acquire(&proc->p_lock);
+	procusage_add(pu, &proc->p_childusage);
+	spinlock_release(&proc->p_lock);
+}
+
 /*
  * Fetch the address space of the current process. Caution: it isn't
  * refcounted. If you implement multithreaded processes, make sure to
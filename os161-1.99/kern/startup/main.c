@@ -38,10 +38,12 @@
 #include <lib.h>
 #include <spl.h>
 #include <clock.h>
+#include <rcu.h>
 #include <thread.h>
 #include <proc.h>
 #include <current.h>
 #include <synch.h>
+#include <lockstat.h>
 #include <vm.h>
 #include <mainbus.h>
 #include <vfs.h>
@@ -107,10 +109,14 @@ boot(void)
 
 	/* Early initialization. */
 	ram_bootstrap();
+	kheap_bootstrap();
 	proc_bootstrap();
 	thread_bootstrap();
+	rcu_bootstrap();
 	hardclock_bootstrap();
 	vfs_bootstrap();
+	futex_bootstrap();
+	argbuf_bootstrap();
 
 	/* Probe and initialize devices. Interrupts should come on. */
 	kprintf("Device probe...\n");
@@ -120,11 +126,16 @@ boot(void)
 	/* Now do pseudo-devices. */
 	pseudoconfig();
 	kprintf("\n");
+#if OPT_LOCKSTAT
+	/* the clock is attached now */
+	lockstat_bootstrap();
+#endif
 
 	/* Late phase of initialization. */
 	vm_bootstrap();
 	kprintf_bootstrap();
 	thread_start_cpus();
+	proc_reaper_bootstrap();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
 	vfs_setbootfs("emu0");
@@ -38,6 +38,8 @@
 #include <thread.h>
 #include <proc.h>
 #include <synch.h>
+#include <lockstat.h>
+#include <sysstat.h>
 #include <vfs.h>
 #include <sfs.h>
 #include <syscall.h>
@@ -213,6 +215,21 @@ cmd_dbthreads(int nargs, char **args)
 	return 0;
 }
 
+/*
+ * Command for printing per-thread cpu accounting.
+ */
+static
+int
+cmd_ps(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	thread_printstats();
+
+	return 0;
+}
+
 /*
  * Command for changing directory.
  */
@@ -399,6 +416,83 @@ cmd_bootfs(int nargs, char **args)
 	return vfs_setbootfs(device);
 }
 
+/*
+ * Command for printing (and optionally resetting) spinlock statistics.
+ */
+static
+int
+cmd_spinstats(int nargs, char **args)
+{
+	bool reset = false;
+
+	if (nargs == 2 && !strcmp(args[1], "reset")) {
+		reset = true;
+	}
+	else if (nargs != 1) {
+		kprintf("Usage: sl [reset]\n");
+		return EINVAL;
+	}
+
+	spinlock_printstats(reset);
+
+	return 0;
+}
+
+/*
+ * Command for printing (and optionally resetting) lock contention
+ * statistics.
+ */
+
+#define LOCKSTAT_TOP	20
+
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	bool reset = false;
+
+	if (nargs == 2 && !strcmp(args[1], "reset")) {
+		reset = true;
+	}
+	else if (nargs != 1) {
+		kprintf("Usage: ls [reset]\n");
+		return EINVAL;
+	}
+
+#if OPT_LOCKSTAT
+	lockstat_print(LOCKSTAT_TOP, reset);
+#else
+	(void)reset;
+	kprintf("Lock statistics are not compiled in "
+		"(use \"options lockstat\")\n");
+#endif
+
+	return 0;
+}
+
+/*
+ * Command for printing (and optionally resetting) system call counts
+ * and latencies.
+ */
+static
+int
+cmd_sysstat(int nargs, char **args)
+{
+	bool reset = false;
+
+	if (nargs == 2 && !strcmp(args[1], "reset")) {
+		reset = true;
+	}
+	else if (nargs != 1) {
+		kprintf("Usage: ss [reset]\n");
+		return EINVAL;
+	}
+
+	sysstat_print(reset);
+
+	return 0;
+}
+
 static
 int
 cmd_kheapstats(int nargs, char **args)
@@ -480,6 +574,12 @@ static const char *testmenu[] = {
 	"[sy1] Semaphore test                ",
 	"[sy2] Lock test             (1)     ",
 	"[sy3] CV test               (1)     ",
+	"[sy4] CV timed wait test    (1)     ",
+	"[sy5] Lock timeout test     (1)     ",
+	"[sy6] Lock contention bench (1)     ",
+	"[sy7] Rwlock test           (1)     ",
+	"[sy8] Atomic ops test               ",
+	"[sy9] RCU test              (1)     ",
 #ifdef UW
 	"[uw1] UW lock test          (1)     ",
 	"[uw2] UW vmstats test       (3)     ",
@@ -511,6 +611,7 @@ cmd_testmenu(int n, char **a)
 
 static const char *mainmenu[] = {
 	"[dth] Enable DB_THREADS             ",
+	"[ps] Thread CPU usage               ",
 	"[?o] Operations menu                ",
 	"[?t] Tests menu                     ",
 #if OPT_SYNCHPROBS
@@ -521,6 +622,9 @@ static const char *mainmenu[] = {
 #endif /* UW */
 #endif
 	"[kh] Kernel heap stats              ",
+	"[sl] Spinlock stats [reset]         ",
+	"[ls] Lock contention stats [reset]  ",
+	"[ss] System call stats [reset]      ",
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -553,6 +657,7 @@ static struct {
 
 	/* operations */
 	{ "dth",	cmd_dbthreads },
+	{ "ps",		cmd_ps },
 	{ "s",		cmd_shell },
 	{ "p",		cmd_prog },
 	{ "mount",	cmd_mount },
@@ -578,6 +683,9 @@ static struct {
 
 	/* stats */
 	{ "kh",         cmd_kheapstats },
+	{ "sl",		cmd_spinstats },
+	{ "ls",		cmd_lockstat },
+	{ "ss",		cmd_sysstat },
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -595,6 +703,12 @@ static struct {
 	/* synchronization assignment tests */
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
+	{ "sy4",	cvtimedtest },
+	{ "sy5",	locktimedtest },
+	{ "sy6",	lockbench },
+	{ "sy7",	rwtest },
+	{ "sy8",	atomictest },
+	{ "sy9",	rcutest },
 #ifdef UW
 	{ "uw1",	uwlocktest1 },
 	{ "uw2",	uwvmstatstest },
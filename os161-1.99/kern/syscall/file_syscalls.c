@@ -1,60 +1,537 @@
 #include <types.h>
 #include <kern/errno.h>
-#include <kern/unistd.h>
+#include <kern/fcntl.h>
+#include <kern/seek.h>
+#include <kern/stat.h>
+#include <limits.h>
 #include <lib.h>
 #include <uio.h>
+#include <copyinout.h>
+#include <synch.h>
 #include <syscall.h>
 #include <vnode.h>
 #include <vfs.h>
 #include <current.h>
 #include <proc.h>
+#include <openfile.h>
 
-/* handler for write() system call                  */
 /*
- * n.b.
- * This implementation handles only writes to standard output 
- * and standard error, both of which go to the console.
- * Also, it does not provide any synchronization, so writes
- * are not atomic.
+ * File system calls. Descriptors are looked up in the process's
+ * table (see openfile.c), which hands back a reference on the open
+ * file; everything else goes straight to VFS.
+ */
+
+/* copy a pathname in from user space; the caller frees it */
+static
+int
+copyinpath(userptr_t upath, char **ret)
+{
+  char *path;
+  int result;
+
+  path = kmalloc(PATH_MAX);
+  if (path == NULL) {
+    return ENOMEM;
+  }
+  result = copyinstr(upath, path, PATH_MAX, NULL);
+  if (result) {
+    kfree(path);
+    return result;
+  }
+  *ret = path;
+  return 0;
+}
+
+/* set up U to refer to a user buffer */
+static
+void
+uio_user(struct uio *u, struct iovec *iov, userptr_t ubuf, size_t len,
+         off_t offset, enum uio_rw rw)
+{
+  iov->iov_ubase = ubuf;
+  iov->iov_len = len;
+  u->uio_iov = iov;
+  u->uio_iovcnt = 1;
+  u->uio_offset = offset;
+  u->uio_resid = len;
+  u->uio_segflg = UIO_USERSPACE;
+  u->uio_rw = rw;
+  u->uio_space = curproc->p_addrspace;
+}
+
+/*
+ * The guts of all the read and write calls: move data between the
+ * file and the IOVCNT user buffers in IOV, as one uio.
  *
- * You will need to improve this implementation
+ * With POS of -1 this uses the file's offset. For files that can
+ * seek, the offset lock is held across the I/O so that it and the
+ * offset update are atomic; the console doesn't use an offset and is
+ * left to its own locking. Otherwise (pread and pwrite) the I/O is
+ * at POS, the offset is neither used nor changed, and the lock isn't
+ * taken, so positional readers of one descriptor run in parallel.
  */
+#define FILEIO_MAX 0x7fffffff	/* the most retval can hold */
 
+static
 int
-sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
+file_io(int fd, struct iovec *iov, unsigned iovcnt, off_t pos,
+        enum uio_rw rw, int *retval)
 {
-  struct iovec iov;
+  struct openfile *of;
   struct uio u;
+  struct stat st;
+  bool useoffset;
+  size_t total;
+  unsigned i;
+  int res;
+
+  /* the result has to fit in retval */
+  total = 0;
+  for (i=0; i<iovcnt; i++) {
+    if (iov[i].iov_len > FILEIO_MAX - total) {
+      return EINVAL;
+    }
+    total += iov[i].iov_len;
+  }
+
+  res = fd_get(fd, &of);
+  if (res) {
+    return res;
+  }
+  if ((rw == UIO_READ && of->of_accmode == O_WRONLY) ||
+      (rw == UIO_WRITE && of->of_accmode == O_RDONLY)) {
+    openfile_decref(of);
+    return EBADF;
+  }
+  if (pos != -1 && !of->of_seekable) {
+    openfile_decref(of);
+    return ESPIPE;
+  }
+
+  useoffset = pos == -1 && of->of_seekable;
+  if (useoffset) {
+    lock_acquire(of->of_offsetlock);
+    if (rw == UIO_WRITE && of->of_append) {
+      res = VOP_STAT(of->of_vnode, &st);
+      if (res) {
+        goto out;
+      }
+      of->of_offset = st.st_size;
+    }
+    pos = of->of_offset;
+  }
+  else if (pos == -1) {
+    pos = 0;
+  }
+
+  u.uio_iov = iov;
+  u.uio_iovcnt = iovcnt;
+  u.uio_offset = pos;
+  u.uio_resid = total;
+  u.uio_segflg = UIO_USERSPACE;
+  u.uio_rw = rw;
+  u.uio_space = curproc->p_addrspace;
+  if (rw == UIO_READ) {
+    res = VOP_READ(of->of_vnode, &u);
+  }
+  else {
+    res = VOP_WRITE(of->of_vnode, &u);
+  }
+  if (res == 0) {
+    if (useoffset) {
+      of->of_offset = u.uio_offset;
+    }
+    /* pass back the number of bytes actually transferred */
+    *retval = total - u.uio_resid;
+  }
+
+ out:
+  if (useoffset) {
+    lock_release(of->of_offsetlock);
+  }
+  openfile_decref(of);
+  return res;
+}
+
+/*
+ * readv() and writev(). Small vectors are copied onto the stack;
+ * bigger ones, up to IOV_MAX, are kmalloc'd.
+ */
+#define IOV_ONSTACK 8
+
+static
+int
+file_iov(int fd, userptr_t uiov, int iovcnt, enum uio_rw rw, int *retval)
+{
+  struct iovec stackiov[IOV_ONSTACK], *iov;
+  int res;
+
+  if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+    return EINVAL;
+  }
+  if (iovcnt <= IOV_ONSTACK) {
+    iov = stackiov;
+  }
+  else {
+    iov = kmalloc(iovcnt * sizeof(*iov));
+    if (iov == NULL) {
+      return ENOMEM;
+    }
+  }
+
+  /* the user's iov_base/iov_len have the same layout as ours */
+  res = copyin(uiov, iov, iovcnt * sizeof(*iov));
+  if (res == 0) {
+    res = file_io(fd, iov, iovcnt, -1, rw, retval);
+  }
+
+  if (iov != stackiov) {
+    kfree(iov);
+  }
+  return res;
+}
+
+int
+sys_open(userptr_t upath, int flags, mode_t mode, int *retval)
+{
+  struct openfile *of;
+  char *path;
   int res;
 
+  res = copyinpath(upath, &path);
+  if (res) {
+    return res;
+  }
+  res = openfile_open(path, flags, mode, &of);
+  kfree(path);
+  if (res) {
+    return res;
+  }
+  res = fd_alloc(of, retval);
+  if (res) {
+    openfile_decref(of);
+  }
+  return res;
+}
+
+int
+sys_read(int fdesc, userptr_t ubuf, size_t nbytes, int *retval)
+{
+  struct iovec iov;
+
+  DEBUG(DB_SYSCALL,"Syscall: read(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
+  iov.iov_ubase = ubuf;
+  iov.iov_len = nbytes;
+  return file_io(fdesc, &iov, 1, -1, UIO_READ, retval);
+}
+
+int
+sys_write(int fdesc, userptr_t ubuf, size_t nbytes, int *retval)
+{
+  struct iovec iov;
+
   DEBUG(DB_SYSCALL,"Syscall: write(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
-  
-  /* only stdout and stderr writes are currently implemented */
-  if (!((fdesc==STDOUT_FILENO)||(fdesc==STDERR_FILENO))) {
-    return EUNIMP;
+  iov.iov_ubase = ubuf;
+  iov.iov_len = nbytes;
+  return file_io(fdesc, &iov, 1, -1, UIO_WRITE, retval);
+}
+
+int
+sys_readv(int fdesc, userptr_t uiov, int iovcnt, int *retval)
+{
+  return file_iov(fdesc, uiov, iovcnt, UIO_READ, retval);
+}
+
+int
+sys_writev(int fdesc, userptr_t uiov, int iovcnt, int *retval)
+{
+  return file_iov(fdesc, uiov, iovcnt, UIO_WRITE, retval);
+}
+
+int
+sys_pread(int fdesc, userptr_t ubuf, size_t nbytes, off_t pos, int *retval)
+{
+  struct iovec iov;
+
+  if (pos < 0) {
+    return EINVAL;
   }
-  KASSERT(curproc != NULL);
-  KASSERT(curproc->console != NULL);
-  KASSERT(curproc->p_addrspace != NULL);
+  iov.iov_ubase = ubuf;
+  iov.iov_len = nbytes;
+  return file_io(fdesc, &iov, 1, pos, UIO_READ, retval);
+}
 
-  /* set up a uio structure to refer to the user program's buffer (ubuf) */
+int
+sys_pwrite(int fdesc, userptr_t ubuf, size_t nbytes, off_t pos, int *retval)
+{
+  struct iovec iov;
+
+  if (pos < 0) {
+    return EINVAL;
+  }
   iov.iov_ubase = ubuf;
   iov.iov_len = nbytes;
-  u.uio_iov = &iov;
-  u.uio_iovcnt = 1;
-  u.uio_offset = 0;  /* not needed for the console */
-  u.uio_resid = nbytes;
-  u.uio_segflg = UIO_USERSPACE;
-  u.uio_rw = UIO_WRITE;
-  u.uio_space = curproc->p_addrspace;
+  return file_io(fdesc, &iov, 1, pos, UIO_WRITE, retval);
+}
 
-  res = VOP_WRITE(curproc->console,&u);
+int
+sys_close(int fdesc)
+{
+  return fd_close(fdesc);
+}
+
+int
+sys_lseek(int fdesc, off_t pos, int whence, off_t *retval)
+{
+  struct openfile *of;
+  struct stat st;
+  off_t newpos;
+  int res;
+
+  res = fd_get(fdesc, &of);
   if (res) {
     return res;
   }
+  if (!of->of_seekable) {
+    openfile_decref(of);
+    return ESPIPE;
+  }
+
+  lock_acquire(of->of_offsetlock);
+  switch (whence) {
+  case SEEK_SET:
+    newpos = pos;
+    break;
+  case SEEK_CUR:
+    newpos = of->of_offset + pos;
+    break;
+  case SEEK_END:
+    res = VOP_STAT(of->of_vnode, &st);
+    newpos = (res == 0) ? st.st_size + pos : 0;
+    break;
+  default:
+    newpos = 0;
+    res = EINVAL;
+    break;
+  }
+  if (res == 0 && newpos < 0) {
+    res = EINVAL;
+  }
+  if (res == 0) {
+    of->of_offset = newpos;
+    *retval = newpos;
+  }
+  lock_release(of->of_offsetlock);
+
+  openfile_decref(of);
+  return res;
+}
 
-  /* pass back the number of bytes actually written */
-  *retval = nbytes - u.uio_resid;
-  KASSERT(*retval >= 0);
+int
+sys_dup2(int oldfd, int newfd, int *retval)
+{
+  struct openfile *of;
+  int res;
+
+  if (newfd < 0 || newfd >= OPEN_MAX) {
+    return EBADF;
+  }
+  res = fd_get(oldfd, &of);
+  if (res) {
+    return res;
+  }
+  if (oldfd == newfd) {
+    openfile_decref(of);
+  }
+  else {
+    /* our reference becomes newfd's */
+    fd_replace(newfd, of);
+  }
+  *retval = newfd;
+  return 0;
+}
+
+int
+sys_fstat(int fdesc, userptr_t ustat)
+{
+  struct openfile *of;
+  struct stat st;
+  int res;
+
+  res = fd_get(fdesc, &of);
+  if (res) {
+    return res;
+  }
+  res = VOP_STAT(of->of_vnode, &st);
+  openfile_decref(of);
+  if (res) {
+    return res;
+  }
+  return copyout(&st, ustat, sizeof(st));
+}
+
+int
+sys_fsync(int fdesc)
+{
+  struct openfile *of;
+  int res;
+
+  res = fd_get(fdesc, &of);
+  if (res) {
+    return res;
+  }
+  res = VOP_FSYNC(of->of_vnode);
+  openfile_decref(of);
+  return res;
+}
+
+int
+sys_ftruncate(int fdesc, off_t len)
+{
+  struct openfile *of;
+  int res;
+
+  if (len < 0) {
+    return EINVAL;
+  }
+  res = fd_get(fdesc, &of);
+  if (res) {
+    return res;
+  }
+  if (of->of_accmode == O_RDONLY) {
+    res = EBADF;
+  }
+  else {
+    res = VOP_TRUNCATE(of->of_vnode, len);
+  }
+  openfile_decref(of);
+  return res;
+}
+
+int
+sys_getdirentry(int fdesc, userptr_t ubuf, size_t buflen, int *retval)
+{
+  struct openfile *of;
+  struct iovec iov;
+  struct uio u;
+  int res;
+
+  res = fd_get(fdesc, &of);
+  if (res) {
+    return res;
+  }
+  if (of->of_accmode == O_WRONLY) {
+    openfile_decref(of);
+    return EBADF;
+  }
+
+  /* the offset is the directory slot, which getdirentry advances */
+  lock_acquire(of->of_offsetlock);
+  uio_user(&u, &iov, ubuf, buflen, of->of_offset, UIO_READ);
+  res = VOP_GETDIRENTRY(of->of_vnode, &u);
+  if (res == 0) {
+    of->of_offset = u.uio_offset;
+    *retval = buflen - u.uio_resid;
+  }
+  lock_release(of->of_offsetlock);
+
+  openfile_decref(of);
+  return res;
+}
+
+int
+sys_chdir(userptr_t upath)
+{
+  char *path;
+  int res;
+
+  res = copyinpath(upath, &path);
+  if (res) {
+    return res;
+  }
+  res = vfs_chdir(path);
+  kfree(path);
+  return res;
+}
+
+int
+sys___getcwd(userptr_t ubuf, size_t buflen, int *retval)
+{
+  struct iovec iov;
+  struct uio u;
+  int res;
+
+  uio_user(&u, &iov, ubuf, buflen, 0, UIO_READ);
+  res = vfs_getcwd(&u);
+  if (res) {
+    return res;
+  }
+  *retval = buflen - u.uio_resid;
   return 0;
 }
+
+int
+sys_mkdir(userptr_t upath, mode_t mode)
+{
+  char *path;
+  int res;
+
+  res = copyinpath(upath, &path);
+  if (res) {
+    return res;
+  }
+  res = vfs_mkdir(path, mode);
+  kfree(path);
+  return res;
+}
+
+int
+sys_rmdir(userptr_t upath)
+{
+  char *path;
+  int res;
+
+  res = copyinpath(upath, &path);
+  if (res) {
+    return res;
+  }
+  res = vfs_rmdir(path);
+  kfree(path);
+  return res;
+}
+
+int
+sys_remove(userptr_t upath)
+{
+  char *path;
+  int res;
+
+  res = copyinpath(upath, &path);
+  if (res) {
+    return res;
+  }
+  res = vfs_remove(path);
+  kfree(path);
+  return res;
+}
+
+int
+sys_rename(userptr_t uoldpath, userptr_t unewpath)
+{
+  char *oldpath, *newpath;
+  int res;
+
+  res = copyinpath(uoldpath, &oldpath);
+  if (res) {
+    return res;
+  }
+  res = copyinpath(unewpath, &newpath);
+  if (res) {
+    kfree(oldpath);
+    return res;
+  }
+  res = vfs_rename(oldpath, newpath);
+  kfree(oldpath);
+  kfree(newpath);
+  return res;
+}
@@ -0,0 +1,213 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/futex.h>
+#include <lib.h>
+#include <syscall.h>
+#include <current.h>
+#include <proc.h>
+#include <thread.h>
+#include <wchan.h>
+#include <copyinout.h>
+#include <synch.h>
+
+/*
+ * Futexes: sleeping on a word of user memory.
+ *
+ * A waiter is keyed on (address space, user address) and hashed into
+ * one of FUTEX_NBUCKETS buckets. Each bucket has a sleep lock, which
+ * is held while reading the user word so that a waker can't slip in
+ * between the check and the sleep, a list of the waiters, and one
+ * wchan they all sleep on. Wakers pick out their waiters by key and
+ * wake exactly those threads with wchan_wakethread, so unrelated
+ * futexes that share a bucket don't see each other's wakeups.
+ *
+ * The waiter records live on the sleeping threads' stacks. Only the
+ * thread that wakes a waiter removes it from the list.
+ *
+ * When a process is getting rid of or stopping its threads
+ * (uthread_exitall, uthread_stopall), futex_cancel wakes any of them
+ * sleeping here, and their futex call fails with EINTR.
+ */
+
+#define FUTEX_NBUCKETS 64
+
+struct futex_waiter {
+  struct addrspace *fw_as;
+  vaddr_t fw_addr;
+  struct thread *fw_thread;
+  bool fw_cancelled;
+  struct futex_waiter *fw_next;
+};
+
+struct futex_bucket {
+  struct lock *fb_lock;
+  struct wchan *fb_wchan;
+  struct futex_waiter *fb_waiters;
+};
+
+static struct futex_bucket futex_table[FUTEX_NBUCKETS];
+
+static
+struct futex_bucket *
+futex_hash(struct addrspace *as, vaddr_t addr)
+{
+  unsigned h;
+
+  h = ((uintptr_t)as >> 4) ^ (addr >> 2);
+  h ^= h >> 11;
+  return &futex_table[h % FUTEX_NBUCKETS];
+}
+
+void
+futex_bootstrap(void)
+{
+  unsigned i;
+
+  for (i = 0; i < FUTEX_NBUCKETS; i++) {
+    futex_table[i].fb_lock = lock_create("futex");
+    futex_table[i].fb_wchan = wchan_create("futex");
+    if (futex_table[i].fb_lock == NULL ||
+        futex_table[i].fb_wchan == NULL) {
+      panic("futex_bootstrap: out of memory\n");
+    }
+    futex_table[i].fb_waiters = NULL;
+  }
+}
+
+static
+int
+futex_wait(struct addrspace *as, vaddr_t addr, int val)
+{
+  struct futex_bucket *fb;
+  struct futex_waiter w;
+  int cur;
+  int result;
+
+  fb = futex_hash(as, addr);
+
+  lock_acquire(fb->fb_lock);
+  result = copyin((const_userptr_t)addr, &cur, sizeof(cur));
+  if (result) {
+    lock_release(fb->fb_lock);
+    return result;
+  }
+  if (cur != val) {
+    lock_release(fb->fb_lock);
+    return EAGAIN;
+  }
+  /*
+   * futex_cancel's callers set p_exiting or p_stopper before it
+   * scans the buckets, so either it finds us on the list or we see
+   * the flag here.
+   */
+  if (curproc->p_exiting || curproc->p_stopper != NULL) {
+    lock_release(fb->fb_lock);
+    return EINTR;
+  }
+
+  w.fw_as = as;
+  w.fw_addr = addr;
+  w.fw_thread = curthread;
+  w.fw_cancelled = false;
+  w.fw_next = fb->fb_waiters;
+  fb->fb_waiters = &w;
+
+  /* hold the wchan across the release so no wakeup is missed */
+  wchan_lock(fb->fb_wchan);
+  lock_release(fb->fb_lock);
+  wchan_sleep(fb->fb_wchan);
+
+  return w.fw_cancelled ? EINTR : 0;
+}
+
+/*
+ * Wake up to MAX waiters in bucket FB that belong to AS and are waiting
+ * on ADDR (or on any address, if ANYADDR), marking them cancelled if
+ * CANCEL. Returns the number woken.
+ */
+static
+unsigned
+futex_wakeup(struct futex_bucket *fb, struct addrspace *as, vaddr_t addr,
+             bool anyaddr, unsigned max, bool cancel)
+{
+  struct futex_waiter **wp, *w;
+  unsigned n = 0;
+
+  KASSERT(lock_do_i_hold(fb->fb_lock));
+
+  wchan_lock(fb->fb_wchan);
+  wp = &fb->fb_waiters;
+  while (*wp != NULL && n < max) {
+    w = *wp;
+    if (w->fw_as != as || (!anyaddr && w->fw_addr != addr)) {
+      wp = &w->fw_next;
+      continue;
+    }
+    *wp = w->fw_next;
+    w->fw_cancelled = cancel;
+    /* the waiter went to sleep before it let go of the bucket lock */
+    if (!wchan_wakethread(fb->fb_wchan, w->fw_thread)) {
+      panic("futex: waiter not asleep\n");
+    }
+    n++;
+  }
+  wchan_unlock(fb->fb_wchan);
+
+  return n;
+}
+
+static
+int
+futex_wake(struct addrspace *as, vaddr_t addr, int val, int *retval)
+{
+  struct futex_bucket *fb;
+
+  if (val < 0) {
+    return EINVAL;
+  }
+
+  fb = futex_hash(as, addr);
+  lock_acquire(fb->fb_lock);
+  *retval = futex_wakeup(fb, as, addr, false, val, false);
+  lock_release(fb->fb_lock);
+
+  return 0;
+}
+
+/*
+ * Wake every thread of address space AS sleeping in futex, and make
+ * their calls fail with EINTR. The caller has set p_exiting or
+ * p_stopper.
+ */
+void
+futex_cancel(struct addrspace *as)
+{
+  unsigned i;
+
+  for (i = 0; i < FUTEX_NBUCKETS; i++) {
+    lock_acquire(futex_table[i].fb_lock);
+    futex_wakeup(&futex_table[i], as, 0, true, (unsigned)-1, true);
+    lock_release(futex_table[i].fb_lock);
+  }
+}
+
+int
+sys_futex(userptr_t uaddr, int op, int val, int *retval)
+{
+  struct addrspace *as = curproc->p_addrspace;
+  vaddr_t addr = (vaddr_t)uaddr;
+
+  *retval = 0;
+
+  if (addr % sizeof(int) != 0) {
+    return EINVAL;
+  }
+
+  switch (op) {
+  case FUTEX_WAIT:
+    return futex_wait(as, addr, val);
+  case FUTEX_WAKE:
+    return futex_wake(as, addr, val, retval);
+  }
+  return EINVAL;
+}
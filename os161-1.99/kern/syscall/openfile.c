@@ -0,0 +1,209 @@
+/*
+ * Open files and descriptor tables. See openfile.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <limits.h>
+#include <lib.h>
+#include <atomic.h>
+#include <synch.h>
+#include <vnode.h>
+#include <vfs.h>
+#include <current.h>
+#include <proc.h>
+#include <openfile.h>
+
+int
+openfile_open(char *path, int flags, mode_t mode, struct openfile **ret)
+{
+	struct openfile *of;
+	struct vnode *vn;
+	int result;
+
+	switch (flags & O_ACCMODE) {
+	    case O_RDONLY:
+	    case O_WRONLY:
+	    case O_RDWR:
+		break;
+	    default:
+		return EINVAL;
+	}
+
+	of = kmalloc(sizeof(*of));
+	if (of == NULL) {
+		return ENOMEM;
+	}
+	of->of_offsetlock = lock_create("openfile");
+	if (of->of_offsetlock == NULL) {
+		kfree(of);
+		return ENOMEM;
+	}
+
+	result = vfs_open(path, flags, mode, &vn);
+	if (result) {
+		lock_destroy(of->of_offsetlock);
+		kfree(of);
+		return result;
+	}
+
+	of->of_vnode = vn;
+	of->of_accmode = flags & O_ACCMODE;
+	of->of_append = (flags & O_APPEND) != 0;
+	of->of_seekable = VOP_TRYSEEK(vn, 0) == 0;
+	of->of_offset = 0;
+	of->of_refcount = 1;
+
+	*ret = of;
+	return 0;
+}
+
+void
+openfile_incref(struct openfile *of)
+{
+	atomic_inc(&of->of_refcount);
+}
+
+void
+openfile_decref(struct openfile *of)
+{
+	if (atomic_dec(&of->of_refcount) > 0) {
+		return;
+	}
+	vfs_close(of->of_vnode);
+	lock_destroy(of->of_offsetlock);
+	kfree(of);
+}
+
+void
+filetable_copy(struct proc *from, struct proc *proc)
+{
+	struct openfile *of;
+	int fd;
+
+	/* PROC is new, so nobody else can be looking at its table */
+	spinlock_acquire(&from->p_lock);
+	for (fd=0; fd<OPEN_MAX; fd++) {
+		of = from->p_files[fd];
+		if (of != NULL) {
+			openfile_incref(of);
+		}
+		proc->p_files[fd] = of;
+	}
+	spinlock_release(&from->p_lock);
+}
+
+int
+filetable_openconsole(struct proc *proc)
+{
+	static const int modes[3] = { O_RDONLY, O_WRONLY, O_WRONLY };
+	char path[5];
+	int fd, result;
+
+	for (fd=0; fd<3; fd++) {
+		/* vfs_open may scribble on the path */
+		strcpy(path, "con:");
+		result = openfile_open(path, modes[fd], 0,
+				       &proc->p_files[fd]);
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
+
+void
+filetable_closeall(struct proc *proc)
+{
+	int fd;
+
+	for (fd=0; fd<OPEN_MAX; fd++) {
+		if (proc->p_files[fd] != NULL) {
+			openfile_decref(proc->p_files[fd]);
+			proc->p_files[fd] = NULL;
+		}
+	}
+}
+
+int
+fd_get(int fd, struct openfile **ret)
+{
+	struct proc *proc = curproc;
+	struct openfile *of;
+
+	if (fd < 0 || fd >= OPEN_MAX) {
+		return EBADF;
+	}
+	spinlock_acquire(&proc->p_lock);
+	of = proc->p_files[fd];
+	if (of != NULL) {
+		openfile_incref(of);
+	}
+	spinlock_release(&proc->p_lock);
+
+	if (of == NULL) {
+		return EBADF;
+	}
+	*ret = of;
+	return 0;
+}
+
+int
+fd_alloc(struct openfile *of, int *ret)
+{
+	struct proc *proc = curproc;
+	int fd;
+
+	spinlock_acquire(&proc->p_lock);
+	for (fd=0; fd<OPEN_MAX; fd++) {
+		if (proc->p_files[fd] == NULL) {
+			proc->p_files[fd] = of;
+			spinlock_release(&proc->p_lock);
+			*ret = fd;
+			return 0;
+		}
+	}
+	spinlock_release(&proc->p_lock);
+	return EMFILE;
+}
+
+void
+fd_replace(int fd, struct openfile *of)
+{
+	struct proc *proc = curproc;
+	struct openfile *old;
+
+	KASSERT(fd >= 0 && fd < OPEN_MAX);
+
+	spinlock_acquire(&proc->p_lock);
+	old = proc->p_files[fd];
+	proc->p_files[fd] = of;
+	spinlock_release(&proc->p_lock);
+
+	/* closing may sleep, so not under the spinlock */
+	if (old != NULL) {
+		openfile_decref(old);
+	}
+}
+
+int
+fd_close(int fd)
+{
+	struct proc *proc = curproc;
+	struct openfile *of;
+
+	if (fd < 0 || fd >= OPEN_MAX) {
+		return EBADF;
+	}
+	spinlock_acquire(&proc->p_lock);
+	of = proc->p_files[fd];
+	proc->p_files[fd] = NULL;
+	spinlock_release(&proc->p_lock);
+
+	if (of == NULL) {
+		return EBADF;
+	}
+	openfile_decref(of);
+	return 0;
+}
@@ -2,7 +2,11 @@
 #include <kern/errno.h>
 #include <kern/unistd.h>
 #include <kern/wait.h>
+#include <kern/time.h>
+#include <kern/resource.h>
+#include <kern/spawn.h>
 #include <lib.h>
+#include <clock.h>
 #include <syscall.h>
 #include <current.h>
 #include <proc.h>
@@ -15,6 +19,7 @@
 #include <limits.h>
 #include <kern/fcntl.h>
 #include <vfs.h>
+#include <openfile.h>
 #include <test.h>
 
   /* this implementation of sys__exit does not do anything with the exit code */
@@ -22,34 +27,14 @@
 void forkHelper(void* newtrapframe, unsigned long x); // helper declaration
 
 void sys__exit(int exitcode) {
-  struct addrspace *as;
-  struct proc *p = curproc;
-
-  #if OPT_A2
-  lock_acquire(arrayLock);
-  struct processInfo* pInfo= findProcess(curproc->pid);
-  pInfo->active = false;
-  pInfo->exitStatus = _MKWAIT_EXIT(exitcode);
+  struct procusage usage;
 
-  for (unsigned int i=0; i<array_num(processes); i++) {
-    pInfo = array_get(processes,i);
-
-    if (pInfo->parent == curproc->pid && pInfo->active == false) {
-      removeProcess(pInfo->process);
-    }
-    if (pInfo->parent == curproc->pid) {
-      pInfo->parent = -1;
-    }
-  }
-  pInfo= findProcess(curproc->pid);
-  if (pInfo->parent == -1) { // no parent
-    removeProcess(curproc->pid);
-  }
-  else {
-    cv_broadcast(waitQ,arrayLock);
-  }
+  /* get rid of any other threads first */
+  uthread_exitall();
 
-  lock_release(arrayLock);
+  #if OPT_A2
+  proc_exitusage(curproc, &usage);
+  processExited(curproc->pid, _MKWAIT_EXIT(exitcode), &usage);
 
   #else
   /* for now, just include this to keep the compiler from complaining about
@@ -61,25 +46,13 @@ void sys__exit(int exitcode) {
   DEBUG(DB_SYSCALL,"Syscall: _exit(%d)\n",exitcode);
 
   KASSERT(curproc->p_addrspace != NULL);
-  as_deactivate();
-  /*
-   * clear p_addrspace before calling as_destroy. Otherwise if
-   * as_destroy sleeps (which is quite possible) when we
-   * come back we'll be calling as_activate on a
-   * half-destroyed address space. This tends to be
-   * messily fatal.
-   */
-  as = curproc_setas(NULL);
-  as_destroy(as);
-  //kprintf("detaching thread from pid %d\n", curproc->pid);
-  /* detach this thread from its process */
+  /* detach this thread from its process, and leave the address space
+     and the process to the reaper */
   /* note: curproc cannot be used after this call */
-  proc_remthread(curthread);
+  /* when the reaper destroys the last user process in the system,
+     proc_destroy() will wake up the kernel menu thread */
+  proc_exit();
 
-  /* if this is the last user process in the system, proc_destroy()
-     will wake up the kernel menu thread */
-  proc_destroy(p);
-  
   thread_exit();
   /* thread_exit() does not return, so we should never get here */
   panic("return from thread_exit in sys_exit\n");
@@ -104,8 +77,11 @@ sys_waitpid(pid_t pid,
 	    int options,
 	    pid_t *retval)
 {
+  struct processInfo *p;
+  struct procusage usage;
   int exitstatus;
   int result;
+  bool exited;
 
   /* this is just a stub implementation that always reports an
      exit status of 0, regardless of the actual exit status of
@@ -115,38 +91,58 @@ sys_waitpid(pid_t pid,
 
      Fix this!
   */
-  lock_acquire(arrayLock);
-  struct processInfo* p = findProcess(pid);
-
-  if (options != 0) { // The <em>options</em> argument should be 0
-    lock_release(arrayLock);
+  if ((options & ~WNOHANG) != 0) { // WNOHANG is the only option
     return EINVAL;
   }
-  if (p == NULL) {
-    lock_release(arrayLock);
-    return ESRCH; // argument named a nonexistent process
-  }
-  if (p->parent != curproc->pid) {
-    lock_release(arrayLock);
-    return ECHILD; // named a process	current proc was not interested	in
+
+  // bad pids, and WNOHANG polls of children still running, don't
+  // need the table lock at all
+  result = processPeekChild(curproc->pid, pid, &exited);
+  if (result == 0 && !exited && (options & WNOHANG) && status != NULL) {
+    *retval = 0;
+    return 0;
   }
-  if (status == NULL) {
-    lock_release(arrayLock);
-    return EFAULT;
+  if (result) {
+    return result;
   }
-  // how to check if status ptr is valid? EFAULT
-
 
-  while (p->active == true) {
-    cv_wait(waitQ, arrayLock);
+  // sleep on our own cv, which every child's exit signals, so that
+  // processWakeWaiters can get us out if our process is exiting or
+  // execing; the child is looked up again each time, since another
+  // of our threads may have collected it meanwhile
+  lock_acquire(processesLock);
+  while (1) {
+    result = processFindExited(curproc->pid, pid, &p);
+    if (result == 0 && status == NULL) {
+      result = EFAULT;
+    }
+    if (result || p != NULL || (options & WNOHANG)) {
+      break;
+    }
+    if (uthread_cancelled()) {
+      result = EINTR;
+      break;
+    }
+    cv_wait(findProcess(curproc->pid)->childcv, processesLock);
+  }
+  if (result || p == NULL) {
+    // nothing has exited yet, for WNOHANG
+    lock_release(processesLock);
+    *retval = 0;
+    return result;
   }
-  // if nobody is watching a process that has exited, remove process
-  // set exit status after process exits
+  pid = p->process;
   exitstatus = p->exitStatus;
+  usage = p->usage;
   removeProcess(pid);
-  result = copyout((void *)&exitstatus,status,sizeof(int));
+  lock_release(processesLock);
+
+  // the child's usage now counts as ours, for RUSAGE_CHILDREN
+  spinlock_acquire(&curproc->p_lock);
+  procusage_add(&curproc->p_childusage, &usage);
+  spinlock_release(&curproc->p_lock);
 
-  lock_release(arrayLock);
+  result = copyout((void *)&exitstatus,status,sizeof(int));
   if (result) {
     return(result);
   }
@@ -160,6 +156,19 @@ void forkHelper(void* newtrapframe, unsigned long x) {
   enter_forked_process((struct trapframe *) newtrapframe);
 }
 
+/*
+ * Undo a fork that failed after the child was made our child: it
+ * has to exit and be collected like any other, or waitpid(-1) would
+ * wait for it forever.
+ */
+static void forkFailed(struct proc *child) {
+  pid_t pid = child->pid;
+
+  processExited(pid, _MKWAIT_EXIT(255), NULL);
+  processReap(pid);
+  proc_destroy(child);
+}
+
 int sys_fork(struct trapframe* tf, pid_t* retval) {
   struct proc* child = proc_create_runprogram(curproc->p_name);
   if (child == NULL) { 
@@ -171,19 +180,27 @@ int sys_fork(struct trapframe* tf, pid_t* retval) {
   }
 
   // set parent
-  struct processInfo* childInfo = findProcess(child->pid);
-  childInfo->parent = curproc->pid;
+  processSetParent(child->pid, curproc->pid);
+
+  // the child starts with the parent's CPU share
+  child->p_tickets = curproc->p_tickets;
 
   // trap frame 
   struct trapframe* newtf = kmalloc(sizeof(struct trapframe));
+  if (newtf == NULL) {
+    forkFailed(child);
+    return ENOMEM;
+  }
   *newtf = *tf;
 
   as_copy(curproc->p_addrspace, &child->p_addrspace);
   if (child->p_addrspace==NULL){
     kfree(newtf);
-    proc_destroy(child);
+    forkFailed(child);
     return ENOMEM;
   }
+  // only the calling thread is copied; drop the other threads' stacks
+  as_trim_threadstacks(child->p_addrspace, tf->tf_sp);
 
   //memcpy(newtf,tf, sizeof(struct trapframe));
   int result = thread_fork(curthread->t_name, child, forkHelper, newtf, 0);
@@ -191,7 +208,8 @@ int sys_fork(struct trapframe* tf, pid_t* retval) {
   if(result != 0) {
     kfree(newtf);
     as_destroy(child->p_addrspace);
-    proc_destroy(child);
+    child->p_addrspace = NULL;
+    forkFailed(child);
     return result;
   }
 
@@ -201,96 +219,584 @@ int sys_fork(struct trapframe* tf, pid_t* retval) {
   return 0;
 }
 
-int sys_execv(char* progname, char** args) {
- // CHECK FOR ERRORS
-  if (progname == NULL || args == NULL) {
-    return EFAULT;
+/*
+ * Argument buffers for execv and spawn.
+ *
+ * Each is ARG_MAX bytes, too big to kmalloc on every exec (and under
+ * dumbvm, memory that big is never given back), so they are kept in
+ * a small pool: allocated the first time they're needed and then
+ * reused. When all ARGBUF_POOLSIZE are in use, callers wait.
+ */
+#define ARGBUF_POOLSIZE 4
+
+static struct lock *argbuf_lock;
+static struct cv *argbuf_cv;
+static char *argbuf_free[ARGBUF_POOLSIZE];
+static unsigned argbuf_nfree;		/* entries in argbuf_free */
+static unsigned argbuf_nalloc;		/* buffers allocated so far */
+
+void
+argbuf_bootstrap(void)
+{
+  argbuf_lock = lock_create("argbuf");
+  argbuf_cv = cv_create("argbuf");
+  if (argbuf_lock == NULL || argbuf_cv == NULL) {
+    panic("argbuf_bootstrap: out of memory\n");
+  }
+  argbuf_nfree = 0;
+  argbuf_nalloc = 0;
+}
+
+static char *
+argbuf_get(void)
+{
+  char *buf;
+
+  lock_acquire(argbuf_lock);
+  while (argbuf_nfree == 0 && argbuf_nalloc == ARGBUF_POOLSIZE) {
+    cv_wait(argbuf_cv, argbuf_lock);
+  }
+  if (argbuf_nfree > 0) {
+    buf = argbuf_free[--argbuf_nfree];
+    lock_release(argbuf_lock);
+    return buf;
   }
-  if (strlen(progname) > PATH_MAX){
-    return E2BIG;
+  // room in the pool for another one
+  argbuf_nalloc++;
+  lock_release(argbuf_lock);
+
+  buf = kmalloc(ARG_MAX);
+  if (buf == NULL) {
+    lock_acquire(argbuf_lock);
+    argbuf_nalloc--;
+    cv_signal(argbuf_cv, argbuf_lock);
+    lock_release(argbuf_lock);
   }
+  return buf;
+}
+
+static void
+argbuf_put(char *buf)
+{
+  lock_acquire(argbuf_lock);
+  KASSERT(argbuf_nfree < argbuf_nalloc);
+  argbuf_free[argbuf_nfree++] = buf;
+  cv_signal(argbuf_cv, argbuf_lock);
+  lock_release(argbuf_lock);
+}
 
-  // see runprogram.c
+/*
+ * Argument vectors for execv and spawn.
+ *
+ * argv_copyin copies a user argv into an argument buffer laid out the
+ * way it will go on the new program's stack: the pointer array,
+ * null-terminated, followed by the strings. Until argv_copyout knows
+ * where the block will go, the pointers hold offsets into the block.
+ * argv_copyout fixes them up and copies the whole thing out at once.
+ */
+static int
+argv_copyin(userptr_t uargv, char *buf, int *argcret, size_t *lenret)
+{
+  vaddr_t *ptrs = (vaddr_t *)buf;
+  size_t maxptrs = ARG_MAX / sizeof(vaddr_t);
+  size_t off, got;
+  int argc, i;
   int result;
-  struct addrspace *as;
-  struct addrspace *oldas;
-  struct vnode *v;
-  vaddr_t entrypoint, stackptr;
 
+  // the pointers first, so we know where the strings start
+  for (argc = 0; ; argc++) {
+    if ((size_t)argc >= maxptrs) {
+      return E2BIG;
+    }
+    result = copyin((userptr_t)((vaddr_t)uargv + argc * sizeof(vaddr_t)),
+                    &ptrs[argc], sizeof(vaddr_t));
+    if (result) {
+      return result;
+    }
+    if (ptrs[argc] == 0) {
+      break;
+    }
+  }
 
-  int argc = 0;
-  if (args != NULL) {
-    while (args[argc] != NULL) {
-      argc++;
+  off = (argc + 1) * sizeof(vaddr_t);
+  for (i = 0; i < argc; i++) {
+    result = copyinstr((userptr_t)ptrs[i], buf + off, ARG_MAX - off, &got);
+    if (result == ENAMETOOLONG) {
+      return E2BIG;
     }
+    if (result) {
+      return result;
+    }
+    ptrs[i] = off;
+    off += got;
   }
 
-  char** argsMem = kmalloc((argc + 1) * sizeof(char));
-  // set null terminator
-  argsMem[argc] = NULL;
+  *argcret = argc;
+  *lenret = off;
+  return 0;
+}
+
+/*
+ * Put a block made by argv_copyin on the user stack below *STACKPTR.
+ * Hands back the new stack pointer and the user address of argv.
+ */
+static int
+argv_copyout(char *buf, int argc, size_t len,
+             vaddr_t *stackptr, userptr_t *uargv)
+{
+  vaddr_t *ptrs = (vaddr_t *)buf;
+  vaddr_t base;
+  int i;
+  int result;
+
+  // keep the stack pointer 8-byte aligned
+  base = (*stackptr - len) & ~(vaddr_t)7;
+  for (i = 0; i < argc; i++) {
+    ptrs[i] += base;
+  }
 
-  for (int i = 0; i < argc; i++) {
-    argsMem[i] = kmalloc((strlen(args[i]) + 1) * sizeof(char));
-    copyinstr((userptr_t)args[i], argsMem[i], strlen(args[i]) + 1, NULL);
+  result = copyout(buf, (userptr_t)base, len);
+  if (result) {
+    return result;
   }
+  *stackptr = base;
+  *uargv = (userptr_t)base;
+  return 0;
+}
+
+/*
+ * execv: replace the calling process's program with PATH, passing it
+ * ARGV. Any other threads in the process are stopped while the new
+ * image loads, then killed once it has; if loading fails they carry
+ * on. Does not return on success.
+ */
+int
+sys_execv(userptr_t upath, userptr_t uargv)
+{
+  struct addrspace *as, *oldas;
+  struct vnode *v;
+  vaddr_t entrypoint, stackptr;
+  userptr_t newargv;
+  char *path, *argbuf;
+  size_t arglen;
+  int argc;
+  int result;
 
-  char* temp = kstrdup(progname);
-  if (temp == NULL) { return ENOMEM;}
+  path = kmalloc(PATH_MAX);
+  if (path == NULL) {
+    return ENOMEM;
+  }
+  argbuf = argbuf_get();
+  if (argbuf == NULL) {
+    kfree(path);
+    return ENOMEM;
+  }
 
-  result = vfs_open(temp, O_RDONLY, 0, &v);
-  if (result) { 
-    kfree(temp);
+  result = copyinstr(upath, path, PATH_MAX, NULL);
+  if (result == 0) {
+    result = argv_copyin(uargv, argbuf, &argc, &arglen);
+  }
+  if (result == 0) {
+    result = vfs_open(path, O_RDONLY, 0, &v);
+  }
+  kfree(path);
+  if (result) {
+    argbuf_put(argbuf);
     return result;
   }
-  kfree(temp);
 
-  // make new address space
   as = as_create();
-  if (as == NULL) { return ENOMEM;}
+  if (as == NULL) {
+    vfs_close(v);
+    argbuf_put(argbuf);
+    return ENOMEM;
+  }
+
+  // nobody else may run in the old image while we swap it out
+  uthread_stopall();
 
-  oldas=curproc_setas(as);
+  oldas = curproc_setas(as);
   as_activate();
 
   result = load_elf(v, &entrypoint);
+  vfs_close(v);
+  if (result == 0) {
+    result = as_define_stack(as, &stackptr);
+  }
+  if (result == 0) {
+    result = argv_copyout(argbuf, argc, arglen, &stackptr, &newargv);
+  }
+  argbuf_put(argbuf);
   if (result) {
-    vfs_close(v);
+    // go back to the old image
+    curproc_setas(oldas);
+    as_activate();
+    as_destroy(as);
+    uthread_resumeall();
     return result;
   }
-  vfs_close(v);
 
-  result = as_define_stack(as, &stackptr);
-  if (result) { return result;}
-  // must increment stack pointer to be 8-byte aligned, see hint page for a2b
-  stackptr -= stackptr % 8;
+  // the new image starts with just this thread
+  uthread_exitall();
+  as_destroy(oldas);
+  enter_new_process(argc, newargv, stackptr, entrypoint);
+
+  panic("function enter_new_process in execv failed @proc_syscalls.c");
+  return EINVAL;
+}
+
+/*
+ * What sys_spawn hands to the new process's thread, and what the
+ * thread hands back. Lives on the parent's stack, so the child must
+ * not touch it after the V.
+ */
+struct spawnargs {
+  char *sa_path;
+  char *sa_argbuf;
+  int sa_argc;
+  size_t sa_arglen;
+  struct spawn_fdaction *sa_actions;   // paths copied into the kernel
+  int sa_nactions;
+  struct semaphore *sa_done;
+  int sa_result;
+};
+
+static void
+spawn_freeactions(struct spawn_fdaction *acts, int nactions)
+{
+  int i;
+
+  if (acts == NULL) {
+    return;
+  }
+  for (i = 0; i < nactions; i++) {
+    kfree((char *)acts[i].sfa_path);
+  }
+  kfree(acts);
+}
+
+/*
+ * Copy in NACTIONS descriptor actions from UACTIONS, with the paths
+ * for SPAWN_FDOPEN, checking what can be checked without a table.
+ */
+static int
+spawn_copyinactions(userptr_t uactions, int nactions,
+                    struct spawn_fdaction **ret)
+{
+  struct spawn_fdaction *acts;
+  const_userptr_t upath;
+  char *path;
+  int i, result;
+
+  *ret = NULL;
+  if (nactions == 0) {
+    return 0;
+  }
+  if (nactions < 0 || nactions > SPAWN_MAXFDACTIONS) {
+    return EINVAL;
+  }
+  acts = kmalloc(nactions * sizeof(*acts));
+  if (acts == NULL) {
+    return ENOMEM;
+  }
+  result = copyin(uactions, acts, nactions * sizeof(*acts));
+  if (result) {
+    kfree(acts);
+    return result;
+  }
+
+  // replace each user path with a kernel copy, or NULL
+  for (i = 0; i < nactions && result == 0; i++) {
+    upath = (const_userptr_t)acts[i].sfa_path;
+    acts[i].sfa_path = NULL;
+    if (acts[i].sfa_fd < 0 || acts[i].sfa_fd >= OPEN_MAX) {
+      result = EBADF;
+    }
+    else if (acts[i].sfa_op == SPAWN_FDOPEN) {
+      path = kmalloc(PATH_MAX);
+      if (path == NULL) {
+        result = ENOMEM;
+      }
+      else {
+        result = copyinstr(upath, path, PATH_MAX, NULL);
+        if (result) {
+          kfree(path);
+        }
+        else {
+          acts[i].sfa_path = path;
+        }
+      }
+    }
+    else if (acts[i].sfa_op != SPAWN_FDCLOSE &&
+             acts[i].sfa_op != SPAWN_FDDUP2) {
+      result = EINVAL;
+    }
+  }
+  if (result) {
+    // the ones we didn't get to still hold user pointers
+    for (; i < nactions; i++) {
+      acts[i].sfa_path = NULL;
+    }
+    spawn_freeactions(acts, nactions);
+    return result;
+  }
+  *ret = acts;
+  return 0;
+}
+
+/*
+ * Carry out the descriptor actions on the current (new) process's
+ * table, in order, stopping at the first that fails.
+ */
+static int
+spawn_doactions(const struct spawn_fdaction *acts, int nactions)
+{
+  struct openfile *of;
+  int i, result;
+
+  for (i = 0; i < nactions; i++) {
+    switch (acts[i].sfa_op) {
+    case SPAWN_FDCLOSE:
+      result = fd_close(acts[i].sfa_fd);
+      break;
+    case SPAWN_FDDUP2:
+      result = fd_get(acts[i].sfa_srcfd, &of);
+      if (result == 0) {
+        fd_replace(acts[i].sfa_fd, of);
+      }
+      break;
+    case SPAWN_FDOPEN:
+      // vfs_open may scribble on the path, but it's ours to spoil
+      result = openfile_open((char *)acts[i].sfa_path, acts[i].sfa_flags,
+                             acts[i].sfa_mode, &of);
+      if (result == 0) {
+        fd_replace(acts[i].sfa_fd, of);
+      }
+      break;
+    default:
+      panic("spawn: bad fd action %d\n", acts[i].sfa_op);
+    }
+    if (result) {
+      return result;
+    }
+  }
+  return 0;
+}
+
+/*
+ * First thing the new process's thread runs: set up its descriptors,
+ * load the program into the (empty) address space and go to user
+ * mode. If any of that fails, report it and exit; the parent throws
+ * the process away.
+ */
+static void
+spawnHelper(void *data, unsigned long unused)
+{
+  struct spawnargs *sa = data;
+  struct vnode *v;
+  vaddr_t entrypoint, stackptr;
+  userptr_t uargv;
+  int argc;
+  int result;
 
-  vaddr_t len;
-  vaddr_t argStack[argc + 1];
-  argStack[argc]=0;
+  (void)unused;
+  as_activate();
 
- // actual argument strings
-  for (int i = argc-1; i >= 0; i--) {
-    len = strlen(argsMem[i]) + 1;
-    stackptr -= len;
-    result = copyoutstr(argsMem[i], (userptr_t)stackptr, ARG_MAX,  &len);
-    if (result) { return result;}
+  result = spawn_doactions(sa->sa_actions, sa->sa_nactions);
+  if (result == 0) {
+    result = vfs_open(sa->sa_path, O_RDONLY, 0, &v);
+  }
+  if (result == 0) {
+    result = load_elf(v, &entrypoint);
+    vfs_close(v);
+  }
+  if (result == 0) {
+    result = as_define_stack(curproc->p_addrspace, &stackptr);
+  }
+  if (result == 0) {
+    result = argv_copyout(sa->sa_argbuf, sa->sa_argc, sa->sa_arglen,
+                          &stackptr, &uargv);
+  }
+  argc = sa->sa_argc;
+  sa->sa_result = result;
+  V(sa->sa_done);
 
-    argStack[i] = stackptr;
+  if (result) {
+    sys__exit(255);
   }
+  enter_new_process(argc, uargv, stackptr, entrypoint);
+  panic("enter_new_process returned in spawn\n");
+}
 
-  // pointers to copied arguments, note they are 4-byte items
-  // so stackptr must be incremented to be properly aligned
-  stackptr -= stackptr % 4;
-  for (int i = argc; i >= 0; i--) {
-    stackptr -= sizeof(vaddr_t);
+/*
+ * spawn: start PATH with arguments ARGV in a new child process. Unlike
+ * fork then execv, the child is built straight from the executable;
+ * the caller's address space is never copied. The child gets a copy
+ * of the caller's descriptors, changed by the NACTIONS actions at
+ * UACTIONS (see kern/spawn.h). Returns the child's pid once the
+ * program is loaded, or the error from an action or from loading it.
+ */
+int
+sys_spawn(userptr_t upath, userptr_t uargv, userptr_t uactions,
+          int nactions, pid_t *retval)
+{
+  struct spawnargs sa;
+  struct proc *child;
+  struct addrspace *as;
+  pid_t pid;
+  int result;
 
-    result = copyout(&argStack[i],(userptr_t)stackptr, sizeof(vaddr_t));
-    if (result) { return result;}
+  sa.sa_path = kmalloc(PATH_MAX);
+  sa.sa_argbuf = argbuf_get();
+  sa.sa_actions = NULL;
+  sa.sa_nactions = nactions;
+  sa.sa_done = sem_create("spawn", 0);
+  if (sa.sa_path == NULL || sa.sa_argbuf == NULL || sa.sa_done == NULL) {
+    result = ENOMEM;
+    goto out;
   }
 
-  userptr_t userAddress = (userptr_t)stackptr;
-  enter_new_process(argc, userAddress, stackptr, entrypoint);
-  
-  panic("function enter_new_process in execv failed @proc_syscalls.c");
-  return EINVAL;
+  result = copyinstr(upath, sa.sa_path, PATH_MAX, NULL);
+  if (result) {
+    goto out;
+  }
+  result = argv_copyin(uargv, sa.sa_argbuf, &sa.sa_argc, &sa.sa_arglen);
+  if (result) {
+    goto out;
+  }
+  result = spawn_copyinactions(uactions, nactions, &sa.sa_actions);
+  if (result) {
+    goto out;
+  }
+
+  as = as_create();
+  if (as == NULL) {
+    result = ENOMEM;
+    goto out;
+  }
+  child = proc_create_runprogram(sa.sa_path);
+  if (child == NULL) {
+    as_destroy(as);
+    result = ENPROC;
+    goto out;
+  }
+  if (child->pid == -1) {
+    as_destroy(as);
+    proc_destroy(child);
+    result = ENPROC;
+    goto out;
+  }
+  pid = child->pid;
+  child->p_addrspace = as;
+  child->p_tickets = curproc->p_tickets;
+  processSetParent(pid, curproc->pid);
+
+  result = thread_fork(sa.sa_path, child, spawnHelper, &sa, 0);
+  if (result) {
+    processExited(pid, _MKWAIT_EXIT(255), NULL);
+    processReap(pid);
+    as_destroy(as);
+    proc_destroy(child);
+    goto out;
+  }
+
+  // wait for the program to load; if it didn't, nobody wants the child
+  P(sa.sa_done);
+  result = sa.sa_result;
+  if (result) {
+    processReap(pid);
+  }
+  else {
+    *retval = pid;
+  }
+
+ out:
+  spawn_freeactions(sa.sa_actions, sa.sa_nactions);
+  if (sa.sa_done != NULL) {
+    sem_destroy(sa.sa_done);
+  }
+  if (sa.sa_argbuf != NULL) {
+    argbuf_put(sa.sa_argbuf);
+  }
+  kfree(sa.sa_path);
+  return result;
+}
+
+
+/*
+ * Convert a tick count at TICKSPERSEC ticks per second to a timeval.
+ */
+static void
+ticks_to_timeval(uint32_t ticks, uint32_t tickspersec, struct timeval *tv)
+{
+  tv->tv_sec = ticks / tickspersec;
+  tv->tv_usec = (ticks % tickspersec) * (1000000 / tickspersec);
+}
+
+/*
+ * getrusage: report the resource usage of the calling process (summed
+ * over its threads, including ones that have exited), or of all its
+ * children that have been waited for.
+ */
+int
+sys_getrusage(int who, userptr_t usage)
+{
+  struct procusage pu;
+  struct rusage ru;
+
+  switch (who) {
+  case RUSAGE_SELF:
+    proc_getusage(curproc, &pu);
+    break;
+  case RUSAGE_CHILDREN:
+    spinlock_acquire(&curproc->p_lock);
+    pu = curproc->p_childusage;
+    spinlock_release(&curproc->p_lock);
+    break;
+  default:
+    return EINVAL;
+  }
+
+  bzero(&ru, sizeof(ru));
+  ticks_to_timeval(pu.pu_utime, HZ, &ru.ru_utime);
+  ticks_to_timeval(pu.pu_stime, HZ, &ru.ru_stime);
+  ticks_to_timeval(pu.pu_waitticks, clock_timetoticks(1, 0), &ru.ru_wtime);
+  ru.ru_minflt = pu.pu_minflt;
+  ru.ru_nvcsw = pu.pu_nvcsw;
+  ru.ru_nivcsw = pu.pu_nivcsw;
+  ru.ru_inbytes = pu.pu_inbytes;
+  ru.ru_outbytes = pu.pu_outbytes;
+
+  return copyout(&ru, usage, sizeof(ru));
 }
 
+/*
+ * setshare: set the number of scheduler tickets (the CPU share) of
+ * process PID, or of the calling process if PID is 0, and return the
+ * old number.
+ */
+int
+sys_setshare(pid_t pid, int tickets, int *retval)
+{
+  unsigned old;
+  int result;
+
+  if (tickets < 1 || tickets > PROC_TICKETS_MAX) {
+    return EINVAL;
+  }
+
+  if (pid == 0) {
+    spinlock_acquire(&curproc->p_lock);
+    *retval = curproc->p_tickets;
+    curproc->p_tickets = tickets;
+    spinlock_release(&curproc->p_lock);
+    return 0;
+  }
+
+  result = processSetShare(pid, tickets, &old);
+  if (result) {
+    return result;
+  }
+  *retval = old;
+  return 0;
+}
@@ -0,0 +1,228 @@
+/*
+ * System call statistics. See sysstat.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/syscall.h>
+#include <lib.h>
+#include <copyinout.h>
+#include <clock.h>
+#include <spl.h>
+#include <cpu.h>
+#include <current.h>
+#include <syscall.h>
+#include <sysstat.h>
+
+/* Names for the menu's table; calls not listed print as numbers. */
+static const char *const sysstat_names[SYSSTAT_NCALLS] = {
+	[SYS_fork] = "fork",
+	[SYS_vfork] = "vfork",
+	[SYS_execv] = "execv",
+	[SYS__exit] = "_exit",
+	[SYS_waitpid] = "waitpid",
+	[SYS_getpid] = "getpid",
+	[SYS_getrusage] = "getrusage",
+	[SYS_open] = "open",
+	[SYS_dup2] = "dup2",
+	[SYS_close] = "close",
+	[SYS_read] = "read",
+	[SYS_pread] = "pread",
+	[SYS_readv] = "readv",
+	[SYS_getdirentry] = "getdirentry",
+	[SYS_write] = "write",
+	[SYS_pwrite] = "pwrite",
+	[SYS_writev] = "writev",
+	[SYS_lseek] = "lseek",
+	[SYS_ftruncate] = "ftruncate",
+	[SYS_fsync] = "fsync",
+	[SYS_remove] = "remove",
+	[SYS_mkdir] = "mkdir",
+	[SYS_rmdir] = "rmdir",
+	[SYS_rename] = "rename",
+	[SYS_chdir] = "chdir",
+	[SYS___getcwd] = "__getcwd",
+	[SYS_fstat] = "fstat",
+	[SYS___time] = "__time",
+	[SYS_nanosleep] = "nanosleep",
+	[SYS_reboot] = "reboot",
+	[SYS_setshare] = "setshare",
+	[SYS___thread_create] = "__thread_create",
+	[SYS_thread_exit] = "thread_exit",
+	[SYS_thread_join] = "thread_join",
+	[SYS_futex] = "futex",
+	[SYS_spawn] = "spawn",
+	[SYS___sysstat] = "__sysstat",
+};
+
+static
+uint64_t
+sysstat_now(void)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	gettime(&secs, &nsecs);
+	return (uint64_t)secs * 1000000000 + nsecs;
+}
+
+void
+sysstat_cpucreate(struct cpu *c)
+{
+	c->c_sysstat = kmalloc(SYSSTAT_NCALLS * sizeof(struct sysstat));
+	if (c->c_sysstat == NULL) {
+		panic("cpu_create: Out of memory\n");
+	}
+	bzero(c->c_sysstat, SYSSTAT_NCALLS * sizeof(struct sysstat));
+}
+
+uint64_t
+sysstat_enter(int callno)
+{
+	int spl;
+
+	if (callno < 0 || callno >= SYSSTAT_NCALLS) {
+		return 0;
+	}
+	spl = splhigh();
+	curcpu->c_sysstat[callno].ss_calls++;
+	splx(spl);
+
+	return sysstat_now();
+}
+
+void
+sysstat_exit(int callno, int err, uint64_t start)
+{
+	struct sysstat *ss;
+	uint64_t ns;
+	uint32_t us;
+	unsigned b;
+	int spl;
+
+	if (callno < 0 || callno >= SYSSTAT_NCALLS) {
+		return;
+	}
+
+	/* avoid 64-bit division unless the call took seconds */
+	ns = sysstat_now() - start;
+	if (ns <= 0xffffffff) {
+		us = (uint32_t)ns / 1000;
+	}
+	else {
+		us = ns / 1000;
+	}
+	for (b=0; b < SYSSTAT_NBUCKETS-1 && (us >> b) != 0; b++) {
+		/* nothing */
+	}
+
+	spl = splhigh();
+	ss = &curcpu->c_sysstat[callno];
+	if (err) {
+		ss->ss_errors++;
+	}
+	ss->ss_totalus += us;
+	ss->ss_hist[b]++;
+	splx(spl);
+}
+
+void
+sysstat_get(int callno, struct sysstat *ss)
+{
+	const struct sysstat *cs;
+	unsigned i, n, b;
+
+	KASSERT(callno >= 0 && callno < SYSSTAT_NCALLS);
+
+	bzero(ss, sizeof(*ss));
+	n = cpu_count();
+	for (i=0; i<n; i++) {
+		cs = &cpu_bynumber(i)->c_sysstat[callno];
+		ss->ss_calls += cs->ss_calls;
+		ss->ss_errors += cs->ss_errors;
+		ss->ss_totalus += cs->ss_totalus;
+		for (b=0; b<SYSSTAT_NBUCKETS; b++) {
+			ss->ss_hist[b] += cs->ss_hist[b];
+		}
+	}
+}
+
+/*
+ * Upper bound, in microseconds, of the histogram bucket holding the
+ * PCT'th percentile of the calls that returned.
+ */
+static
+uint32_t
+sysstat_percentile(const struct sysstat *ss, unsigned pct)
+{
+	uint64_t total, want, seen;
+	unsigned b;
+
+	total = 0;
+	for (b=0; b<SYSSTAT_NBUCKETS; b++) {
+		total += ss->ss_hist[b];
+	}
+	want = (total * pct + 99) / 100;
+	seen = 0;
+	for (b=0; b<SYSSTAT_NBUCKETS-1; b++) {
+		seen += ss->ss_hist[b];
+		if (seen >= want) {
+			break;
+		}
+	}
+	return (uint32_t)1 << b;
+}
+
+void
+sysstat_print(bool reset)
+{
+	struct sysstat ss;
+	uint64_t returned;
+	unsigned i, n, b;
+	int callno;
+	char num[16];
+	const char *name;
+
+	kprintf("%-16s %9s %8s %9s %9s %9s\n",
+		"call", "calls", "errors", "avg us", "p50 <us", "p99 <us");
+	for (callno=0; callno<SYSSTAT_NCALLS; callno++) {
+		sysstat_get(callno, &ss);
+		if (ss.ss_calls == 0) {
+			continue;
+		}
+		name = sysstat_names[callno];
+		if (name == NULL) {
+			snprintf(num, sizeof(num), "#%d", callno);
+			name = num;
+		}
+		returned = 0;
+		for (b=0; b<SYSSTAT_NBUCKETS; b++) {
+			returned += ss.ss_hist[b];
+		}
+		kprintf("%-16s %9llu %8llu %9llu %9u %9u\n", name,
+			ss.ss_calls, ss.ss_errors,
+			returned ? ss.ss_totalus / returned : 0,
+			sysstat_percentile(&ss, 50),
+			sysstat_percentile(&ss, 99));
+	}
+
+	if (reset) {
+		n = cpu_count();
+		for (i=0; i<n; i++) {
+			bzero(cpu_bynumber(i)->c_sysstat,
+			      SYSSTAT_NCALLS * sizeof(struct sysstat));
+		}
+	}
+}
+
+int
+sys___sysstat(int callno, userptr_t ustat)
+{
+	struct sysstat ss;
+
+	if (callno < 0 || callno >= SYSSTAT_NCALLS) {
+		return EINVAL;
+	}
+	sysstat_get(callno, &ss);
+	return copyout(&ss, ustat, sizeof(ss));
+}
@@ -0,0 +1,376 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <array.h>
+#include <syscall.h>
+#include <current.h>
+#include <proc.h>
+#include <thread.h>
+#include <addrspace.h>
+#include <copyinout.h>
+#include <synch.h>
+#include <machine/trapframe.h>
+
+/*
+ * User-level threads.
+ *
+ * Each user thread is just another kernel thread in the same proc,
+ * running on its own user stack from as_define_threadstack, so the
+ * scheduler can put them on different cpus. Threads made by
+ * thread_create get ids from 1 up and a struct uthread in
+ * p_uthreads, which thread_join uses to collect the exit status;
+ * the process's first thread is id 0 and has no record.
+ *
+ * p_uthread_lock protects the records, p_exiting, p_stopper and
+ * p_nparked, and is also held whenever a thread is added to or removed
+ * from p_threads, so that "am I the last thread?" has a stable answer.
+ *
+ * _exit gets rid of all the other threads by setting p_exiting and
+ * waiting; each thread notices it on its way back to user mode (see
+ * mips_trap) and exits. Threads blocked elsewhere in the kernel are
+ * collected when their call finishes; futex_cancel cuts short those
+ * waiting on a futex.
+ *
+ * execv can still fail after it has started loading the new image, so
+ * it first only stops the other threads: it sets p_stopper and they
+ * park in uthread_checkstop instead of exiting. Once the new image is
+ * in place it kills them with uthread_exitall; if the load fails,
+ * uthread_resumeall sends them back to user mode in the old image.
+ *
+ * Either way the other threads have to get back to the trap return
+ * path, so calls that could block indefinitely give up with EINTR
+ * once uthread_cancelled says so: thread_join, futex, waitpid (woken
+ * through processWakeWaiters) and console reads (getch_wakeup).
+ */
+
+/*
+ * Find the record for TID, and its index in p_uthreads.
+ */
+static
+struct uthread *
+uthread_find(struct proc *p, int tid, unsigned *index)
+{
+  struct uthread *ut;
+  unsigned i;
+
+  KASSERT(lock_do_i_hold(p->p_uthread_lock));
+
+  for (i = 0; i < array_num(p->p_uthreads); i++) {
+    ut = array_get(p->p_uthreads, i);
+    if (ut->ut_tid == tid) {
+      if (index != NULL) {
+        *index = i;
+      }
+      return ut;
+    }
+  }
+  return NULL;
+}
+
+/*
+ * First thing a new user thread runs.
+ */
+static
+void
+uthread_start(void *tf, unsigned long tid)
+{
+  curthread->t_tid = tid;
+  enter_new_thread(tf);
+}
+
+/*
+ * __thread_create: start a new thread in the current process at
+ * START, with FUNC and ARG as its first two arguments. libc passes
+ * its own trampoline as START, which calls FUNC(ARG) and then
+ * thread_exit. Returns the new thread id.
+ */
+int
+sys___thread_create(struct trapframe *tf, userptr_t start, userptr_t func,
+                    userptr_t arg, int *retval)
+{
+  struct proc *p = curproc;
+  struct uthread *ut;
+  struct trapframe *newtf;
+  vaddr_t stack;
+  int result;
+
+  ut = kmalloc(sizeof(*ut));
+  if (ut == NULL) {
+    return ENOMEM;
+  }
+  newtf = kmalloc(sizeof(*newtf));
+  if (newtf == NULL) {
+    kfree(ut);
+    return ENOMEM;
+  }
+
+  result = as_define_threadstack(p->p_addrspace, &stack);
+  if (result) {
+    kfree(newtf);
+    kfree(ut);
+    return result;
+  }
+
+  /* Start from our own registers, to inherit gp and the status bits. */
+  *newtf = *tf;
+  newtf->tf_epc = (vaddr_t)start;
+  newtf->tf_a0 = (vaddr_t)func;
+  newtf->tf_a1 = (vaddr_t)arg;
+  newtf->tf_sp = stack;
+  newtf->tf_ra = 0;
+
+  lock_acquire(p->p_uthread_lock);
+  ut->ut_tid = p->p_nexttid++;
+  ut->ut_stack = stack;
+  ut->ut_exited = false;
+  ut->ut_status = 0;
+  result = array_add(p->p_uthreads, ut, NULL);
+  if (result) {
+    goto fail;
+  }
+  result = thread_fork(curthread->t_name, p, uthread_start, newtf,
+                       ut->ut_tid);
+  if (result) {
+    array_setsize(p->p_uthreads, array_num(p->p_uthreads) - 1);
+    goto fail;
+  }
+  *retval = ut->ut_tid;
+  lock_release(p->p_uthread_lock);
+
+  return 0;
+
+ fail:
+  lock_release(p->p_uthread_lock);
+  as_release_threadstack(p->p_addrspace, stack);
+  kfree(newtf);
+  kfree(ut);
+  return result;
+}
+
+/*
+ * End the current thread. If it's the last one in the process, this
+ * is _exit.
+ */
+void
+uthread_exit(int status)
+{
+  struct proc *p = curproc;
+  struct uthread *ut;
+
+  lock_acquire(p->p_uthread_lock);
+  if (threadarray_num(&p->p_threads) == 1) {
+    KASSERT(!p->p_exiting);
+    lock_release(p->p_uthread_lock);
+    sys__exit(status);
+  }
+
+  if (curthread->t_tid != 0) {
+    ut = uthread_find(p, curthread->t_tid, NULL);
+    KASSERT(ut != NULL);
+    ut->ut_exited = true;
+    ut->ut_status = status;
+    /*
+     * If everyone is going, the stacks go with the address space;
+     * after execv, p_addrspace is not even the one they came from.
+     */
+    if (!p->p_exiting) {
+      as_release_threadstack(p->p_addrspace, ut->ut_stack);
+    }
+  }
+
+  proc_remthread(curthread);
+  cv_broadcast(p->p_uthread_cv, p->p_uthread_lock);
+  lock_release(p->p_uthread_lock);
+
+  thread_exit();
+}
+
+/*
+ * True if another thread wants this one out of the kernel: the process
+ * is exiting, or another thread is stopping it for execv.
+ */
+bool
+uthread_cancelled(void)
+{
+  struct proc *p = curproc;
+
+  return p->p_exiting ||
+    (p->p_stopper != NULL && p->p_stopper != curthread);
+}
+
+/*
+ * Kick the other threads out of the waits they can be kicked out of.
+ */
+static
+void
+uthread_kick(struct proc *p)
+{
+  KASSERT(lock_do_i_hold(p->p_uthread_lock));
+
+  cv_broadcast(p->p_uthread_cv, p->p_uthread_lock);
+  futex_cancel(p->p_addrspace);
+  processWakeWaiters(p->pid);
+  getch_wakeup();
+}
+
+/*
+ * Wait out another thread's uthread_stopall, and exit if it (or
+ * anyone) has decided the process's other threads must go. Called
+ * with p_uthread_lock held; returns with it held.
+ */
+static
+void
+uthread_park(struct proc *p)
+{
+  KASSERT(lock_do_i_hold(p->p_uthread_lock));
+
+  if (p->p_stopper != NULL && p->p_stopper != curthread &&
+      !p->p_exiting) {
+    p->p_nparked++;
+    cv_broadcast(p->p_uthread_cv, p->p_uthread_lock);
+    while (p->p_stopper != NULL && !p->p_exiting) {
+      cv_wait(p->p_uthread_cv, p->p_uthread_lock);
+    }
+    p->p_nparked--;
+  }
+  if (p->p_exiting) {
+    lock_release(p->p_uthread_lock);
+    uthread_exit(0);
+  }
+}
+
+/*
+ * Called on the way back to user mode (see mips_trap) when another
+ * thread is stopping or killing the rest of the process.
+ */
+void
+uthread_checkstop(void)
+{
+  struct proc *p = curproc;
+
+  lock_acquire(p->p_uthread_lock);
+  uthread_park(p);
+  lock_release(p->p_uthread_lock);
+}
+
+/*
+ * Make every other thread in the current process park, and wait until
+ * they all have. They stay parked until uthread_exitall or
+ * uthread_resumeall. If some other thread is already doing this, wait
+ * for it to finish first.
+ */
+void
+uthread_stopall(void)
+{
+  struct proc *p = curproc;
+
+  lock_acquire(p->p_uthread_lock);
+  uthread_park(p);
+
+  p->p_stopper = curthread;
+  uthread_kick(p);
+  while (p->p_nparked + 1 < threadarray_num(&p->p_threads)) {
+    cv_wait(p->p_uthread_cv, p->p_uthread_lock);
+  }
+  lock_release(p->p_uthread_lock);
+}
+
+/*
+ * Undo uthread_stopall: let the parked threads go back to user mode.
+ */
+void
+uthread_resumeall(void)
+{
+  struct proc *p = curproc;
+
+  lock_acquire(p->p_uthread_lock);
+  KASSERT(p->p_stopper == curthread);
+  p->p_stopper = NULL;
+  cv_broadcast(p->p_uthread_cv, p->p_uthread_lock);
+  lock_release(p->p_uthread_lock);
+}
+
+/*
+ * Make every other thread in the current process exit, and wait for
+ * them to be gone. If some other thread is already doing this, we are
+ * one of the threads that must go. May follow our own uthread_stopall.
+ */
+void
+uthread_exitall(void)
+{
+  struct proc *p = curproc;
+  unsigned n;
+
+  lock_acquire(p->p_uthread_lock);
+  uthread_park(p);
+
+  p->p_exiting = true;
+  p->p_stopper = NULL;
+  /* this also releases anyone parked */
+  uthread_kick(p);
+  while (threadarray_num(&p->p_threads) > 1) {
+    cv_wait(p->p_uthread_cv, p->p_uthread_lock);
+  }
+  p->p_exiting = false;
+
+  /* Nobody is left to join the records. */
+  n = array_num(p->p_uthreads);
+  while (n > 0) {
+    kfree(array_get(p->p_uthreads, n - 1));
+    n--;
+  }
+  array_setsize(p->p_uthreads, 0);
+  curthread->t_tid = 0;
+
+  lock_release(p->p_uthread_lock);
+}
+
+int
+sys_thread_exit(int status)
+{
+  uthread_exit(status);
+  panic("return from uthread_exit\n");
+  return 0;
+}
+
+/*
+ * thread_join: wait for thread TID to exit and collect its status.
+ * Each thread can be joined once.
+ */
+int
+sys_thread_join(int tid, userptr_t status)
+{
+  struct proc *p = curproc;
+  struct uthread *ut;
+  unsigned index;
+  int exitstatus;
+
+  if (tid == curthread->t_tid) {
+    return EINVAL;
+  }
+
+  lock_acquire(p->p_uthread_lock);
+  /* look it up each time round; another joiner may have reaped it */
+  while ((ut = uthread_find(p, tid, &index)) != NULL &&
+         !ut->ut_exited && !p->p_exiting && p->p_stopper == NULL) {
+    cv_wait(p->p_uthread_cv, p->p_uthread_lock);
+  }
+  if (ut == NULL) {
+    lock_release(p->p_uthread_lock);
+    return ESRCH;
+  }
+  if (!ut->ut_exited) {
+    /* the process is going away or execing; so are we */
+    lock_release(p->p_uthread_lock);
+    return EINTR;
+  }
+  exitstatus = ut->ut_status;
+  array_remove(p->p_uthreads, index);
+  kfree(ut);
+  lock_release(p->p_uthread_lock);
+
+  if (status != NULL) {
+    return copyout(&exitstatus, status, sizeof(exitstatus));
+  }
+  return 0;
+}
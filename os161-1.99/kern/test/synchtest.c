@@ -32,8 +32,12 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <clock.h>
+#include <spinlock.h>
+#include <atomic.h>
+#include <rcu.h>
 #include <thread.h>
 #include <synch.h>
 #include <test.h>
@@ -68,6 +72,11 @@ cleanitems(void)
 	lock_destroy(testlock);
 	cv_destroy(testcv);
 	sem_destroy(donesem);
+	/* so inititems makes new ones next time */
+	testsem = NULL;
+	testlock = NULL;
+	testcv = NULL;
+	donesem = NULL;
 	}
 #endif
 
@@ -166,6 +175,20 @@ semtest(int nargs, char **args)
 	return 0;
 }
 
+/*
+ * Microseconds between two gettime() readings.
+ */
+static
+uint32_t
+elapsed_usec(time_t secs1, uint32_t nsecs1, time_t secs2, uint32_t nsecs2)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	getinterval(secs1, nsecs1, secs2, nsecs2, &secs, &nsecs);
+	return secs * 1000000 + nsecs / 1000;
+}
+
 static
 void
 fail(unsigned long num, const char *msg)
@@ -229,12 +252,15 @@ int
 locktest(int nargs, char **args)
 {
 	int i, result;
+	time_t secs1, secs2;
+	uint32_t nsecs1, nsecs2;
 
 	(void)nargs;
 	(void)args;
 
 	inititems();
 	kprintf("Starting lock test...\n");
+	gettime(&secs1, &nsecs1);
 
 	for (i=0; i<NTHREADS; i++) {
 		result = thread_fork("synchtest", NULL, locktestthread,
@@ -247,10 +273,13 @@ locktest(int nargs, char **args)
 	for (i=0; i<NTHREADS; i++) {
 		P(donesem);
 	}
+	gettime(&secs2, &nsecs2);
 
 #ifdef UW
   cleanitems();
 #endif
+	kprintf("Lock test took %u us\n",
+		elapsed_usec(secs1, nsecs1, secs2, nsecs2));
 	kprintf("Lock test done.\n");
 
 	return 0;
@@ -347,3 +376,881 @@ cvtest(int nargs, char **args)
 
 	return 0;
 }
+
+/*
+ * Timed wait tests.
+ *
+ * These check that timeouts fire, that they fire about when they
+ * should, and that a wakeup before the deadline is not reported as a
+ * timeout. A timed wait may return up to one tick early (the first
+ * tick is partial) and we allow it to be up to two ticks late.
+ */
+
+static const uint32_t timedticks[] = { 1, 2, 5, 10, 50 };
+#define NTIMEDTICKS (sizeof(timedticks) / sizeof(timedticks[0]))
+
+static
+bool
+check_timing(uint32_t ticks, uint32_t usec)
+{
+	uint32_t tickusec, lo, hi;
+
+	tickusec = 1000000 / clock_timetoticks(1, 0);
+	lo = (ticks - 1) * tickusec;
+	hi = (ticks + 2) * tickusec;
+
+	kprintf("  %3u ticks: expected %7u us, took %7u us\n",
+		ticks, ticks * tickusec, usec);
+	if (usec < lo || usec > hi) {
+		kprintf("  Timeout out of range [%u, %u] us\n", lo, hi);
+		return false;
+	}
+	return true;
+}
+
+static
+void
+cvtimedsignalthread(void *junk, unsigned long num)
+{
+	(void)junk;
+
+	clocknap(num);
+	lock_acquire(testlock);
+	testval1 = 1;
+	cv_signal(testcv, testlock);
+	lock_release(testlock);
+	V(donesem);
+}
+
+int
+cvtimedtest(int nargs, char **args)
+{
+	time_t secs1, secs2;
+	uint32_t nsecs1, nsecs2;
+	unsigned i;
+	int result, failures = 0;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	kprintf("Starting CV timed wait test...\n");
+
+	for (i=0; i<NTIMEDTICKS; i++) {
+		lock_acquire(testlock);
+		gettime(&secs1, &nsecs1);
+		result = cv_timedwait(testcv, testlock, timedticks[i]);
+		gettime(&secs2, &nsecs2);
+		if (!lock_do_i_hold(testlock)) {
+			panic("cv_timedwait returned without the lock\n");
+		}
+		lock_release(testlock);
+
+		if (result != ETIMEDOUT) {
+			kprintf("  cv_timedwait returned %d, expected "
+				"ETIMEDOUT\n", result);
+			failures++;
+		}
+		if (!check_timing(timedticks[i],
+				  elapsed_usec(secs1, nsecs1, secs2, nsecs2))) {
+			failures++;
+		}
+	}
+
+	/* Now make sure an early signal is not a timeout. */
+	testval1 = 0;
+	result = thread_fork("cvtimedtest", NULL, cvtimedsignalthread,
+			     NULL, 2);
+	if (result) {
+		panic("cvtimedtest: thread_fork failed: %s\n",
+		      strerror(result));
+	}
+	lock_acquire(testlock);
+	result = 0;
+	while (testval1 == 0 && result == 0) {
+		result = cv_timedwait(testcv, testlock, 100);
+	}
+	lock_release(testlock);
+	if (result != 0) {
+		kprintf("  Signalled cv_timedwait timed out\n");
+		failures++;
+	}
+	P(donesem);
+
+#ifdef UW
+	cleanitems();
+#endif
+	kprintf("CV timed wait test %s\n", failures ? "FAILED" : "done");
+	return 0;
+}
+
+static
+void
+locktimedholdthread(void *junk, unsigned long num)
+{
+	(void)junk;
+
+	lock_acquire(testlock);
+	V(donesem);
+	clocknap(num);
+	lock_release(testlock);
+	V(donesem);
+}
+
+int
+locktimedtest(int nargs, char **args)
+{
+	time_t secs1, secs2;
+	uint32_t nsecs1, nsecs2;
+	int result, failures = 0;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	kprintf("Starting lock timeout test...\n");
+
+	result = thread_fork("locktimedtest", NULL, locktimedholdthread,
+			     NULL, 30);
+	if (result) {
+		panic("locktimedtest: thread_fork failed: %s\n",
+		      strerror(result));
+	}
+	/* Wait until the other thread has the lock. */
+	P(donesem);
+
+	if (lock_tryacquire(testlock)) {
+		kprintf("  lock_tryacquire got a held lock\n");
+		lock_release(testlock);
+		failures++;
+	}
+
+	gettime(&secs1, &nsecs1);
+	result = lock_acquire_timeout(testlock, 5);
+	gettime(&secs2, &nsecs2);
+	if (result != ETIMEDOUT) {
+		kprintf("  lock_acquire_timeout returned %d, expected "
+			"ETIMEDOUT\n", result);
+		if (result == 0) {
+			lock_release(testlock);
+		}
+		failures++;
+	}
+	if (!check_timing(5, elapsed_usec(secs1, nsecs1, secs2, nsecs2))) {
+		failures++;
+	}
+
+	/* The holder lets go well before this deadline. */
+	result = lock_acquire_timeout(testlock, 500);
+	if (result != 0) {
+		kprintf("  lock_acquire_timeout failed on a lock that was "
+			"released: %d\n", result);
+		failures++;
+	}
+	else {
+		lock_release(testlock);
+	}
+	P(donesem);
+
+	if (!lock_tryacquire(testlock)) {
+		kprintf("  lock_tryacquire failed on a free lock\n");
+		failures++;
+	}
+	else {
+		lock_release(testlock);
+	}
+
+#ifdef UW
+	cleanitems();
+#endif
+	kprintf("Lock timeout test %s\n", failures ? "FAILED" : "done");
+	return 0;
+}
+
+/*
+ * Lock contention benchmark.
+ *
+ * LBTHREADS threads each take one lock LBLOOPS times, doing a little
+ * work while holding it and a little more between acquisitions: short
+ * critical sections under contention, like processesLock sees. Reports the
+ * elapsed time, for comparing lock implementations; it's only
+ * interesting with more than one cpu.
+ *
+ * It also reports how long the lock was held (a preempted holder
+ * shows up as a very long hold) and how many times threads had to
+ * sleep for it. "sy6 nodefer" runs with hardclock preempting lock
+ * holders immediately, for comparison.
+ */
+
+#define LBTHREADS	8
+#define LBLOOPS		2000
+#define LBHOLDWORK	20
+#define LBIDLEWORK	50
+
+static struct lock *benchlock;
+static volatile unsigned long benchcount;
+static uint64_t benchholdns;		/* protected by benchlock */
+static uint32_t benchmaxholdns;		/* likewise */
+
+static
+uint64_t
+bench_now(void)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	gettime(&secs, &nsecs);
+	return (uint64_t)secs * 1000000000 + nsecs;
+}
+
+static
+void
+lockbenchthread(void *junk, unsigned long num)
+{
+	volatile unsigned long spin;
+	uint64_t start;
+	uint32_t held;
+	int i, j;
+
+	(void)junk;
+	(void)num;
+
+	for (i=0; i<LBLOOPS; i++) {
+		lock_acquire(benchlock);
+		start = bench_now();
+		for (j=0; j<LBHOLDWORK; j++) {
+			benchcount++;
+		}
+		held = bench_now() - start;
+		benchholdns += held;
+		if (held > benchmaxholdns) {
+			benchmaxholdns = held;
+		}
+		lock_release(benchlock);
+		for (spin=0; spin<LBIDLEWORK; spin++) {
+			/* work outside the lock */
+		}
+	}
+	V(donesem);
+}
+
+int
+lockbench(int nargs, char **args)
+{
+	time_t secs1, secs2;
+	uint32_t nsecs1, nsecs2, usec;
+	bool olddefer;
+	int i, result;
+
+	olddefer = clock_preemptdefer;
+	if (nargs == 2 && !strcmp(args[1], "nodefer")) {
+		clock_preemptdefer = false;
+	}
+	else if (nargs != 1) {
+		kprintf("Usage: sy6 [nodefer]\n");
+		return EINVAL;
+	}
+
+	inititems();
+	benchlock = lock_create("benchlock");
+	if (benchlock == NULL) {
+		panic("lockbench: lock_create failed\n");
+	}
+	benchcount = 0;
+	benchholdns = 0;
+	benchmaxholdns = 0;
+	kprintf("Starting lock contention benchmark (preemption %s)...\n",
+		clock_preemptdefer ? "deferred while holding locks" :
+		"not deferred");
+
+	gettime(&secs1, &nsecs1);
+	for (i=0; i<LBTHREADS; i++) {
+		result = thread_fork("lockbench", NULL, lockbenchthread,
+				     NULL, i);
+		if (result) {
+			panic("lockbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<LBTHREADS; i++) {
+		P(donesem);
+	}
+	gettime(&secs2, &nsecs2);
+
+	usec = elapsed_usec(secs1, nsecs1, secs2, nsecs2);
+	kprintf("  %d threads x %d acquisitions: %u us, %u ns each\n",
+		LBTHREADS, LBLOOPS, usec,
+		usec / LBTHREADS * 1000 / LBLOOPS);
+	kprintf("  hold time: avg %llu ns, max %u us; %u sleeps for the lock\n",
+		benchholdns / (LBTHREADS * LBLOOPS), benchmaxholdns / 1000,
+		benchlock->lk_sleeps);
+	if (benchcount != (unsigned long)LBTHREADS * LBLOOPS * LBHOLDWORK) {
+		kprintf("  Count is %lu, expected %lu\n", benchcount,
+			(unsigned long)LBTHREADS * LBLOOPS * LBHOLDWORK);
+		kprintf("Lock contention benchmark FAILED\n");
+	}
+	else {
+		kprintf("Lock contention benchmark done.\n");
+	}
+
+	lock_destroy(benchlock);
+	benchlock = NULL;
+	clock_preemptdefer = olddefer;
+#ifdef UW
+	cleanitems();
+#endif
+	return 0;
+}
+
+/*
+ * Reader-writer lock test.
+ *
+ * First a correctness run: RWTHREADS threads mostly read and sometimes
+ * write (occasionally downgrading to a read hold afterwards), checking
+ * that a writer never overlaps anyone and that readers always see both
+ * halves of a write. Then a scaling run: 1, 2, 4, ... RWMAXREADERS
+ * threads do nothing but short read sections, once with an rwlock and
+ * once with a plain lock, and we report the times. With more than one
+ * cpu the rwlock times should stay roughly flat as readers are added.
+ */
+
+#define RWTHREADS	16
+#define RWLOOPS		200
+#define RWMAXREADERS	8
+#define RWSCALELOOPS	2000
+#define RWREADWORK	100
+
+static struct rwlock *testrw;
+static struct spinlock rwstatlock;
+static volatile unsigned rwinside;	/* threads holding testrw for read */
+static volatile unsigned rwmaxinside;	/* most seen at once */
+static volatile bool rwwriting;
+static volatile unsigned long rwfailures;
+
+static
+void
+rwreadcheck(unsigned long num)
+{
+	spinlock_acquire(&rwstatlock);
+	rwinside++;
+	if (rwinside > rwmaxinside) {
+		rwmaxinside = rwinside;
+	}
+	spinlock_release(&rwstatlock);
+
+	if (rwwriting || testval1 != testval2) {
+		kprintf("thread %lu: read overlapped a write\n", num);
+		rwfailures++;
+	}
+	thread_yield();
+	if (rwwriting || testval1 != testval2) {
+		kprintf("thread %lu: write during read\n", num);
+		rwfailures++;
+	}
+
+	spinlock_acquire(&rwstatlock);
+	rwinside--;
+	spinlock_release(&rwstatlock);
+}
+
+static
+void
+rwtestthread(void *junk, unsigned long num)
+{
+	int i;
+
+	(void)junk;
+
+	for (i=0; i<RWLOOPS; i++) {
+		if ((num + i) % 8 != 0) {
+			rwlock_acquire_read(testrw);
+			rwreadcheck(num);
+			rwlock_release_read(testrw);
+			continue;
+		}
+
+		rwlock_acquire_write(testrw);
+		if (rwwriting || rwinside != 0) {
+			kprintf("thread %lu: write overlapped\n", num);
+			rwfailures++;
+		}
+		rwwriting = true;
+		testval1 = num;
+		thread_yield();
+		testval2 = num;
+		rwwriting = false;
+
+		if (i % 16 == 0) {
+			rwlock_downgrade(testrw);
+			rwreadcheck(num);
+			rwlock_release_read(testrw);
+		}
+		else {
+			rwlock_release_write(testrw);
+		}
+	}
+	V(donesem);
+}
+
+static
+void
+rwscalethread(void *junk, unsigned long uselock)
+{
+	volatile unsigned long spin;
+	int i;
+
+	(void)junk;
+
+	for (i=0; i<RWSCALELOOPS; i++) {
+		if (uselock) {
+			lock_acquire(benchlock);
+		}
+		else {
+			rwlock_acquire_read(testrw);
+		}
+		for (spin=0; spin<RWREADWORK; spin++) {
+			/* look something up */
+		}
+		if (uselock) {
+			lock_release(benchlock);
+		}
+		else {
+			rwlock_release_read(testrw);
+		}
+	}
+	V(donesem);
+}
+
+static
+uint32_t
+rwscalerun(int nthreads, unsigned long uselock)
+{
+	time_t secs1, secs2;
+	uint32_t nsecs1, nsecs2;
+	int i, result;
+
+	gettime(&secs1, &nsecs1);
+	for (i=0; i<nthreads; i++) {
+		result = thread_fork("rwscale", NULL, rwscalethread,
+				     NULL, uselock);
+		if (result) {
+			panic("rwtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<nthreads; i++) {
+		P(donesem);
+	}
+	gettime(&secs2, &nsecs2);
+
+	return elapsed_usec(secs1, nsecs1, secs2, nsecs2);
+}
+
+int
+rwtest(int nargs, char **args)
+{
+	uint32_t rwusec, lockusec;
+	int i, result;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	testrw = rwlock_create("testrw");
+	if (testrw == NULL) {
+		panic("rwtest: rwlock_create failed\n");
+	}
+	benchlock = lock_create("benchlock");
+	if (benchlock == NULL) {
+		panic("rwtest: lock_create failed\n");
+	}
+	spinlock_init(&rwstatlock);
+	rwinside = rwmaxinside = 0;
+	rwwriting = false;
+	rwfailures = 0;
+	testval1 = testval2 = 0;
+
+	kprintf("Starting rwlock test...\n");
+	for (i=0; i<RWTHREADS; i++) {
+		result = thread_fork("rwtest", NULL, rwtestthread, NULL, i);
+		if (result) {
+			panic("rwtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<RWTHREADS; i++) {
+		P(donesem);
+	}
+	kprintf("  up to %u readers at once\n", rwmaxinside);
+
+	kprintf("Reader scaling, %d read sections per thread:\n",
+		RWSCALELOOPS);
+	for (i=1; i<=RWMAXREADERS; i*=2) {
+		rwusec = rwscalerun(i, 0);
+		lockusec = rwscalerun(i, 1);
+		kprintf("  %d readers: rwlock %u us, lock %u us\n",
+			i, rwusec, lockusec);
+	}
+
+	lock_destroy(benchlock);
+	benchlock = NULL;
+	rwlock_destroy(testrw);
+	testrw = NULL;
+	spinlock_cleanup(&rwstatlock);
+#ifdef UW
+	cleanitems();
+#endif
+	kprintf("Rwlock test %s\n", rwfailures ? "FAILED" : "done");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+//
+// atomictest: atomic.h counters from many threads at once, checked
+// for lost updates and timed against the same counter under a
+// spinlock.
+
+#define ATTHREADS	8
+#define ATLOOPS		5000
+
+#define AT_ADD		0
+#define AT_CAS		1
+#define AT_SPINLOCK	2
+
+static volatile int atcount;
+static struct spinlock atlock;
+
+static
+void
+atomicthread(void *junk, unsigned long how)
+{
+	int i, old;
+
+	(void)junk;
+
+	for (i=0; i<ATLOOPS; i++) {
+		switch (how) {
+		    case AT_ADD:
+			atomic_inc(&atcount);
+			break;
+		    case AT_CAS:
+			do {
+				old = atomic_get(&atcount);
+			} while (atomic_cas(&atcount, old, old + 1) != old);
+			break;
+		    case AT_SPINLOCK:
+			spinlock_acquire(&atlock);
+			atcount++;
+			spinlock_release(&atlock);
+			break;
+		}
+	}
+	V(donesem);
+}
+
+static
+bool
+atomicrun(const char *name, unsigned long how)
+{
+	time_t secs1, secs2;
+	uint32_t nsecs1, nsecs2;
+	int i, result;
+
+	atcount = 0;
+	gettime(&secs1, &nsecs1);
+	for (i=0; i<ATTHREADS; i++) {
+		result = thread_fork("atomictest", NULL, atomicthread,
+				     NULL, how);
+		if (result) {
+			panic("atomictest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<ATTHREADS; i++) {
+		P(donesem);
+	}
+	gettime(&secs2, &nsecs2);
+
+	kprintf("  %-8s count %d (expected %d), %u us\n", name, atcount,
+		ATTHREADS * ATLOOPS,
+		elapsed_usec(secs1, nsecs1, secs2, nsecs2));
+	return atcount == ATTHREADS * ATLOOPS;
+}
+
+int
+atomictest(int nargs, char **args)
+{
+	volatile int word;
+	bool ok = true;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	spinlock_init(&atlock);
+
+	kprintf("Starting atomic test...\n");
+
+	/* the single-threaded results first */
+	word = 5;
+	ok = ok && atomic_add(&word, 3) == 8;
+	ok = ok && atomic_cas(&word, 7, 1) == 8 && word == 8;
+	ok = ok && atomic_cas(&word, 8, 1) == 8 && word == 1;
+	ok = ok && atomic_swap(&word, 42) == 1 && word == 42;
+	ok = ok && atomic_dec(&word) == 41;
+	if (!ok) {
+		kprintf("  single-threaded checks failed\n");
+	}
+
+	ok = atomicrun("add", AT_ADD) && ok;
+	ok = atomicrun("cas", AT_CAS) && ok;
+	ok = atomicrun("spinlock", AT_SPINLOCK) && ok;
+
+	spinlock_cleanup(&atlock);
+#ifdef UW
+	cleanitems();
+#endif
+	kprintf("Atomic test %s\n", ok ? "done" : "FAILED");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+//
+// rcutest: readers walk a list under RCU while a writer keeps
+// replacing its nodes. Replaced nodes are poisoned just before RCU
+// frees them, so a reader that sees poison was let in on a node
+// after its grace period. Then time read-side scaling against the
+// rwlock and a plain lock, walking the same list.
+
+#define RCUNODES	16
+#define RCUREADERS	8
+#define RCUREADLOOPS	400
+#define RCUWRITES	300
+#define RCUMAXREADERS	8
+#define RCUSCALELOOPS	2000
+
+#define RCU_MODE_RCU	0
+#define RCU_MODE_RWLOCK	1
+#define RCU_MODE_LOCK	2
+
+struct rcunode {
+	int rn_key;
+	volatile int rn_val;		/* 2*rn_key, or -1 once freed */
+	struct rcunode *rn_next;
+	struct rcu_head rn_rcu;
+};
+
+static struct rcunode *rculist;
+static struct lock *rcuwritelock;
+static volatile bool rcuwriting;
+static volatile unsigned long rcufailures;
+
+static
+int
+rcuwalk(void)
+{
+	struct rcunode *rn;
+	int n = 0;
+
+	for (rn = rculist; rn != NULL; rn = rn->rn_next) {
+		if (rn->rn_val != 2 * rn->rn_key) {
+			rcufailures++;
+		}
+		n++;
+	}
+	return n;
+}
+
+static
+void
+rcufreenode(void *p)
+{
+	struct rcunode *rn = p;
+
+	rn->rn_val = -1;
+	kfree(rn);
+}
+
+static
+void
+rcureaderthread(void *junk, unsigned long num)
+{
+	int i;
+
+	(void)junk;
+	(void)num;
+
+	/* keep reading until the writer is done, at least RCUREADLOOPS */
+	for (i=0; i<RCUREADLOOPS || rcuwriting; i++) {
+		rcu_read_lock();
+		if (rcuwalk() != RCUNODES) {
+			rcufailures++;
+		}
+		rcu_read_unlock();
+		if (i % 16 == 0) {
+			thread_yield();
+		}
+	}
+	V(donesem);
+}
+
+static
+void
+rcuwriterthread(void *junk, unsigned long num)
+{
+	struct rcunode **pp, *old, *new;
+	int i, j;
+
+	(void)junk;
+	(void)num;
+
+	for (i=0; i<RCUWRITES; i++) {
+		new = kmalloc(sizeof(*new));
+		if (new == NULL) {
+			panic("rcutest: out of memory\n");
+		}
+		lock_acquire(rcuwritelock);
+		pp = &rculist;
+		for (j=0; j<i % RCUNODES; j++) {
+			pp = &(*pp)->rn_next;
+		}
+		old = *pp;
+		new->rn_key = old->rn_key;
+		new->rn_val = old->rn_val;
+		new->rn_next = old->rn_next;
+		rcu_assign(*pp, new);
+		lock_release(rcuwritelock);
+		rcu_call(&old->rn_rcu, rcufreenode, old);
+	}
+	rcuwriting = false;
+	V(donesem);
+}
+
+static
+void
+rcuscalethread(void *junk, unsigned long mode)
+{
+	int i;
+
+	(void)junk;
+
+	for (i=0; i<RCUSCALELOOPS; i++) {
+		switch (mode) {
+		    case RCU_MODE_RCU:
+			rcu_read_lock();
+			rcuwalk();
+			rcu_read_unlock();
+			break;
+		    case RCU_MODE_RWLOCK:
+			rwlock_acquire_read(testrw);
+			rcuwalk();
+			rwlock_release_read(testrw);
+			break;
+		    case RCU_MODE_LOCK:
+			lock_acquire(rcuwritelock);
+			rcuwalk();
+			lock_release(rcuwritelock);
+			break;
+		}
+	}
+	V(donesem);
+}
+
+static
+uint32_t
+rcuscalerun(int nthreads, unsigned long mode)
+{
+	time_t secs1, secs2;
+	uint32_t nsecs1, nsecs2;
+	int i, result;
+
+	gettime(&secs1, &nsecs1);
+	for (i=0; i<nthreads; i++) {
+		result = thread_fork("rcuscale", NULL, rcuscalethread,
+				     NULL, mode);
+		if (result) {
+			panic("rcutest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<nthreads; i++) {
+		P(donesem);
+	}
+	gettime(&secs2, &nsecs2);
+
+	return elapsed_usec(secs1, nsecs1, secs2, nsecs2);
+}
+
+int
+rcutest(int nargs, char **args)
+{
+	struct rcunode *rn;
+	uint32_t rcuusec, rwusec, lockusec;
+	int i, result;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	rcuwritelock = lock_create("rcuwritelock");
+	testrw = rwlock_create("testrw");
+	if (rcuwritelock == NULL || testrw == NULL) {
+		panic("rcutest: out of memory\n");
+	}
+	rculist = NULL;
+	for (i=RCUNODES-1; i>=0; i--) {
+		rn = kmalloc(sizeof(*rn));
+		if (rn == NULL) {
+			panic("rcutest: out of memory\n");
+		}
+		rn->rn_key = i;
+		rn->rn_val = 2 * i;
+		rn->rn_next = rculist;
+		rculist = rn;
+	}
+	rcufailures = 0;
+	rcuwriting = true;
+
+	kprintf("Starting RCU test...\n");
+	for (i=0; i<=RCUREADERS; i++) {
+		result = thread_fork("rcutest", NULL,
+				     i == 0 ? rcuwriterthread : rcureaderthread,
+				     NULL, i);
+		if (result) {
+			panic("rcutest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<=RCUREADERS; i++) {
+		P(donesem);
+	}
+	/* let the last replaced nodes go */
+	rcu_synchronize();
+	kprintf("  %d nodes replaced under %d readers, %lu bad reads\n",
+		RCUWRITES, RCUREADERS, rcufailures);
+
+	kprintf("Read-side scaling, %d walks of %d nodes per thread:\n",
+		RCUSCALELOOPS, RCUNODES);
+	for (i=1; i<=RCUMAXREADERS; i*=2) {
+		rcuusec = rcuscalerun(i, RCU_MODE_RCU);
+		rwusec = rcuscalerun(i, RCU_MODE_RWLOCK);
+		lockusec = rcuscalerun(i, RCU_MODE_LOCK);
+		kprintf("  %d readers: rcu %u us, rwlock %u us, lock %u us\n",
+			i, rcuusec, rwusec, lockusec);
+	}
+
+	while (rculist != NULL) {
+		rn = rculist;
+		rculist = rn->rn_next;
+		kfree(rn);
+	}
+	rwlock_destroy(testrw);
+	testrw = NULL;
+	lock_destroy(rcuwritelock);
+	rcuwritelock = NULL;
+#ifdef UW
+	cleanitems();
+#endif
+	kprintf("RCU test %s\n", rcufailures ? "FAILED" : "done");
+	return 0;
+}
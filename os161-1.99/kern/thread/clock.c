@@ -30,18 +30,23 @@
 #include <types.h>
 #include <lib.h>
 #include <cpu.h>
+#include <spinlock.h>
 #include <wchan.h>
 #include <clock.h>
 #include <thread.h>
+#include <rcu.h>
 #include <lamebus/ltimer.h>
 #include <current.h>
 
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution that one second.
+ * Timed operations are handled with callouts: a callout arranges for
+ * a function to be called from the timer interrupt once a given
+ * number of timer ticks (one every LT_GRANULARITY usec) has elapsed.
+ * Pending callouts are kept in a hashed timing wheel indexed by
+ * expiry tick, so each tick only has to look at one bucket and only
+ * the callouts that have actually expired get run.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
  * skimp on that because we have a known-good hardware clock.
@@ -53,25 +58,82 @@
  */
 #define SCHEDULE_HARDCLOCKS	4	/* Reschedule every 4 hardclocks. */
 #define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
+#define PREEMPT_DEFER_MAX	2	/* Put off preemption at most 2 ticks. */
 
 /*
- * Once a second, everything waiting on lbolt is awakened by CPU 0.
+ * Preempting a thread that holds a lock makes everyone who needs the
+ * lock sleep until it runs again, and they pile up behind it. So while
+ * the current thread holds any sleeping locks, hardclock skips the
+ * yield, for up to PREEMPT_DEFER_MAX ticks in a row; lock_release
+ * yields once the last one is dropped. Cleared to compare (see
+ * lockbench).
  */
-static struct wchan *lbolt;
+bool clock_preemptdefer = true;
+
+/*
+ * Number of timer ticks per second.
+ */
+#define TICKS_PER_SECOND	(1000000/LT_GRANULARITY)
+
 /*
- * Once every LT_GRANULARITY usec, everything on minibolt is awakenened by CPU 0
+ * Size of the timing wheel. Must be a power of 2. Callouts more than
+ * CALLWHEEL_SIZE ticks out share a bucket with nearer ones and are
+ * skipped over until their round comes up.
  */
-static struct wchan *minibolt;
+#define CALLWHEEL_SIZE		256
+#define CALLWHEEL_MASK		(CALLWHEEL_SIZE - 1)
 
-/* 
- * number of minibolts per second
+/*
+ * The wheel itself. Each bucket is the sentinel of a circular list
+ * of pending callouts. callout_expired holds callouts that timerclock
+ * has pulled off the wheel but not yet run. All of it, plus the tick
+ * counter, is protected by callout_lock.
  */
-#define MINI_PER_SECOND (1000000/LT_GRANULARITY);
+static struct callout callwheel[CALLWHEEL_SIZE];
+static struct callout callout_expired;
+static struct spinlock callout_lock;
+
+/* Callout whose function is running right now, if any. */
+static struct callout *volatile callout_running;
+
+/* Number of timer ticks since boot. */
+static volatile uint32_t clock_curticks;
 
 /*
- * minibolt countdown
+ * Threads in clocknap() sleep here. Each one is woken individually by
+ * its own callout.
  */
-static int minicount;
+static struct wchan *napchan;
+
+/*
+ * Circular list helpers for the wheel.
+ */
+static
+void
+callout_listinit(struct callout *head)
+{
+	head->co_next = head;
+	head->co_prev = head;
+}
+
+static
+void
+callout_link(struct callout *head, struct callout *co)
+{
+	co->co_prev = head->co_prev;
+	co->co_next = head;
+	head->co_prev->co_next = co;
+	head->co_prev = co;
+}
+
+static
+void
+callout_unlink(struct callout *co)
+{
+	co->co_prev->co_next = co->co_next;
+	co->co_next->co_prev = co->co_prev;
+	co->co_next = co->co_prev = NULL;
+}
 
 /*
  * Setup.
@@ -79,33 +141,63 @@ static int minicount;
 void
 hardclock_bootstrap(void)
 {
-	lbolt = wchan_create("lbolt");
-	if (lbolt == NULL) {
-		panic("Couldn't create lbolt\n");
+	unsigned i;
+
+	spinlock_init(&callout_lock);
+	spinlock_register(&callout_lock, "callout");
+	for (i=0; i<CALLWHEEL_SIZE; i++) {
+		callout_listinit(&callwheel[i]);
 	}
-	minibolt = wchan_create("minibolt");
-	if (minibolt == NULL) {
-		panic("Couldn't create minibolt\n");
+	callout_listinit(&callout_expired);
+	callout_running = NULL;
+	clock_curticks = 0;
+
+	napchan = wchan_create("clocknap");
+	if (napchan == NULL) {
+		panic("Couldn't create clocknap wchan\n");
 	}
-	minicount = MINI_PER_SECOND;
-	/* we assume MINI_PER_SECOND > 0 */
-	KASSERT(minicount > 0);
+	/* we assume TICKS_PER_SECOND > 0 */
+	KASSERT(TICKS_PER_SECOND > 0);
 }
 
 /*
  * This is called once every every LT_GRANULARITY usec, on one processor,
  * by the timer code.
+ *
+ * Advance the tick count and run whatever callouts have come due.
+ * Callout functions run in interrupt context with callout_lock
+ * released, so they may schedule or stop callouts themselves.
  */
 void
 timerclock(void)
 {
-	/* Broadcast on minibolt */
-	wchan_wakeall(minibolt);
-	/* Broadcast on lbolt if a second has elapsed */
-	if (--minicount <= 0) {
-	  minicount = MINI_PER_SECOND;
-	  wchan_wakeall(lbolt);
+	struct callout *bucket, *co, *next;
+
+	spinlock_acquire(&callout_lock);
+	clock_curticks++;
+
+	bucket = &callwheel[clock_curticks & CALLWHEEL_MASK];
+	for (co = bucket->co_next; co != bucket; co = next) {
+		next = co->co_next;
+		if ((int32_t)(co->co_expires - clock_curticks) <= 0) {
+			callout_unlink(co);
+			callout_link(&callout_expired, co);
+		}
+	}
+
+	while (callout_expired.co_next != &callout_expired) {
+		co = callout_expired.co_next;
+		callout_unlink(co);
+		co->co_pending = false;
+		callout_running = co;
+		spinlock_release(&callout_lock);
+
+		co->co_func(co->co_arg);
+
+		spinlock_acquire(&callout_lock);
+		callout_running = NULL;
 	}
+	spinlock_release(&callout_lock);
 }
 
 /*
@@ -120,26 +212,172 @@ hardclock(void)
 	 */
 
 	curcpu->c_hardclocks++;
+
+	/* Charge the tick to whoever is running, unless we're idle. */
+	if (!curcpu->c_isidle) {
+		if (curthread->t_intr_fromuser) {
+			curthread->t_utime++;
+		}
+		else {
+			curthread->t_stime++;
+		}
+		thread_charge_pass();
+	}
+
 	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
 		schedule();
 	}
 	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
 		thread_consider_migration();
 	}
+
+	/*
+	 * A tick outside any RCU read section is a quiescent state,
+	 * and one inside must not be preempted.
+	 */
+	if (curthread->t_rcunest > 0) {
+		curthread->t_yieldpending = true;
+		return;
+	}
+	rcu_quiescent();
+
+	if (clock_preemptdefer && curthread->t_locksheld > 0 &&
+	    curthread->t_preemptdeferred < PREEMPT_DEFER_MAX) {
+		curthread->t_preemptdeferred++;
+		curthread->t_yieldpending = true;
+		return;
+	}
 	thread_yield();
 }
 
+/*
+ * Return the number of timer ticks since boot.
+ */
+uint32_t
+clock_ticks(void)
+{
+	return clock_curticks;
+}
+
+/*
+ * Convert a time interval to timer ticks, rounding up. Intervals too
+ * long to count in ticks are clamped to CLOCK_MAXTICKS, which is far
+ * enough off (months at any sane LT_GRANULARITY) to mean "forever".
+ */
+uint32_t
+clock_timetoticks(time_t secs, uint32_t nsecs)
+{
+	uint32_t ticks;
+
+	KASSERT(secs >= 0);
+	KASSERT(nsecs < 1000000000);
+
+	if (secs >= CLOCK_MAXTICKS / TICKS_PER_SECOND) {
+		return CLOCK_MAXTICKS;
+	}
+	ticks = (uint32_t)secs * TICKS_PER_SECOND
+		+ DIVROUNDUP(nsecs, LT_GRANULARITY * 1000);
+	return ticks > CLOCK_MAXTICKS ? CLOCK_MAXTICKS : ticks;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Callouts.
+
+void
+callout_init(struct callout *co, void (*func)(void *), void *arg)
+{
+	co->co_next = co->co_prev = NULL;
+	co->co_expires = 0;
+	co->co_func = func;
+	co->co_arg = arg;
+	co->co_pending = false;
+}
+
+/*
+ * Arrange for the callout to fire NUM_TICKS ticks from now. If it
+ * was already pending, it is rescheduled.
+ */
+void
+callout_schedule(struct callout *co, uint32_t num_ticks)
+{
+	KASSERT(co->co_func != NULL);
+
+	if (num_ticks == 0) {
+		num_ticks = 1;
+	}
+
+	spinlock_acquire(&callout_lock);
+	if (co->co_pending) {
+		callout_unlink(co);
+	}
+	co->co_expires = clock_curticks + num_ticks;
+	callout_link(&callwheel[co->co_expires & CALLWHEEL_MASK], co);
+	co->co_pending = true;
+	spinlock_release(&callout_lock);
+}
+
+/*
+ * Cancel a callout. Returns true if it was still pending (so its
+ * function will now never be called) and false if it had already
+ * fired. If the function is running on the timer cpu right now, wait
+ * for it to finish, so that on return the caller can be sure the
+ * callout is no longer in use and may be freed.
+ *
+ * Because of that wait, don't call this while holding anything the
+ * callout function itself needs.
+ */
+bool
+callout_stop(struct callout *co)
+{
+	spinlock_acquire(&callout_lock);
+	if (co->co_pending) {
+		callout_unlink(co);
+		co->co_pending = false;
+		spinlock_release(&callout_lock);
+		return true;
+	}
+	while (callout_running == co) {
+		spinlock_release(&callout_lock);
+		spinlock_acquire(&callout_lock);
+	}
+	spinlock_release(&callout_lock);
+	return false;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Sleeping.
+
+/*
+ * State shared between a thread in clocknap() and its callout.
+ */
+struct napinfo {
+	struct thread *ni_thread;
+	volatile bool ni_done;
+};
+
+static
+void
+clocknap_expire(void *data)
+{
+	struct napinfo *ni = data;
+
+	wchan_lock(napchan);
+	ni->ni_done = true;
+	wchan_wakethread(napchan, ni->ni_thread);
+	wchan_unlock(napchan);
+}
+
 /*
  * Suspend execution for n seconds.
  */
 void
 clocksleep(int num_secs)
 {
-  while (num_secs > 0) {
-    wchan_lock(lbolt);
-    wchan_sleep(lbolt);
-    num_secs--;
-  }
+	if (num_secs > 0) {
+		clocknap(clock_timetoticks(num_secs, 0));
+	}
 }
 
 /*
@@ -149,9 +387,25 @@ clocksleep(int num_secs)
 void
 clocknap(int num_ticks)
 {
-  while (num_ticks > 0) {
-    wchan_lock(minibolt);
-    wchan_sleep(minibolt);
-    num_ticks--;
-  }
+	struct napinfo ni;
+	struct callout co;
+
+	if (num_ticks <= 0) {
+		return;
+	}
+
+	ni.ni_thread = curthread;
+	ni.ni_done = false;
+	callout_init(&co, clocknap_expire, &ni);
+	callout_schedule(&co, num_ticks);
+
+	wchan_lock(napchan);
+	while (!ni.ni_done) {
+		wchan_sleep(napchan);
+		wchan_lock(napchan);
+	}
+	wchan_unlock(napchan);
+
+	/* Make sure the timer cpu is completely done with co and ni. */
+	callout_stop(&co);
 }
@@ -0,0 +1,253 @@
+/*
+ * Lock statistics. See lockstat.h.
+ *
+ * The records are updated from inside spinlock_acquire and
+ * spinlock_release, so they can't be protected by spinlocks; each
+ * one has a bare test-and-set word of its own instead, taken with
+ * interrupts off.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <lockstat.h>
+
+#define LOCKSTAT_MAX		128	/* creation sites we can track */
+#define LOCKSTAT_NAMELEN	24
+
+struct lockstat {
+	volatile spinlock_data_t ls_lock;
+	char ls_name[LOCKSTAT_NAMELEN];
+	const char *ls_file;
+	int ls_line;
+	unsigned ls_acquires;
+	unsigned ls_contended;
+	uint64_t ls_waitns;		/* total wait, contended cases */
+	uint64_t ls_maxwaitns;
+	uint64_t ls_holdns;		/* total hold */
+	uint64_t ls_maxholdns;
+};
+
+static struct lockstat lockstat_table[LOCKSTAT_MAX];
+static unsigned lockstat_num;
+static unsigned lockstat_overflow;	/* sites that didn't fit */
+static volatile spinlock_data_t lockstat_tablelock = SPINLOCK_DATA_INITIALIZER;
+static bool lockstat_timing;
+
+static
+int
+lockstat_lock(volatile spinlock_data_t *sd)
+{
+	int spl;
+
+	spl = splhigh();
+	while (spinlock_data_get(sd) != 0 ||
+	       spinlock_data_testandset(sd) != 0) {
+		/* spin */
+	}
+	return spl;
+}
+
+static
+void
+lockstat_unlock(volatile spinlock_data_t *sd, int spl)
+{
+	spinlock_data_set(sd, 0);
+	splx(spl);
+}
+
+void
+lockstat_bootstrap(void)
+{
+	lockstat_timing = true;
+}
+
+struct lockstat *
+lockstat_get(const char *name, const char *file, int line)
+{
+	struct lockstat *ls;
+	unsigned i;
+	int spl;
+
+	spl = lockstat_lock(&lockstat_tablelock);
+	for (i=0; i<lockstat_num; i++) {
+		ls = &lockstat_table[i];
+		if (ls->ls_line == line && !strcmp(ls->ls_file, file)) {
+			lockstat_unlock(&lockstat_tablelock, spl);
+			return ls;
+		}
+	}
+	if (lockstat_num == LOCKSTAT_MAX) {
+		lockstat_overflow++;
+		lockstat_unlock(&lockstat_tablelock, spl);
+		return NULL;
+	}
+	ls = &lockstat_table[lockstat_num++];
+	bzero(ls, sizeof(*ls));
+	spinlock_data_set(&ls->ls_lock, 0);
+	snprintf(ls->ls_name, sizeof(ls->ls_name), "%s", name);
+	ls->ls_file = file;
+	ls->ls_line = line;
+	lockstat_unlock(&lockstat_tablelock, spl);
+	return ls;
+}
+
+uint64_t
+lockstat_now(void)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	if (!lockstat_timing) {
+		return 0;
+	}
+	gettime(&secs, &nsecs);
+	return (uint64_t)secs * 1000000000 + nsecs;
+}
+
+void
+lockstat_acquired(struct lockstat *ls, bool contended,
+		  uint64_t start, uint64_t now)
+{
+	uint64_t wait;
+	int spl;
+
+	if (ls == NULL) {
+		return;
+	}
+	wait = (start != 0) ? now - start : 0;
+
+	spl = lockstat_lock(&ls->ls_lock);
+	ls->ls_acquires++;
+	if (contended) {
+		ls->ls_contended++;
+		ls->ls_waitns += wait;
+		if (wait > ls->ls_maxwaitns) {
+			ls->ls_maxwaitns = wait;
+		}
+	}
+	lockstat_unlock(&ls->ls_lock, spl);
+}
+
+void
+lockstat_released(struct lockstat *ls, uint64_t acquired)
+{
+	uint64_t hold;
+	int spl;
+
+	if (ls == NULL || acquired == 0) {
+		return;
+	}
+	hold = lockstat_now() - acquired;
+
+	spl = lockstat_lock(&ls->ls_lock);
+	ls->ls_holdns += hold;
+	if (hold > ls->ls_maxholdns) {
+		ls->ls_maxholdns = hold;
+	}
+	lockstat_unlock(&ls->ls_lock, spl);
+}
+
+/*
+ * Drop the "../../" that the build puts on the front of __FILE__.
+ */
+static
+const char *
+lockstat_shortfile(const char *file)
+{
+	while (file[0] == '.' && file[1] == '.' && file[2] == '/') {
+		file += 3;
+	}
+	return file;
+}
+
+/*
+ * Order for printing: most contended first, then most time spent
+ * waiting, then most used. Unused records come last.
+ */
+static
+bool
+lockstat_worse(const struct lockstat *a, const struct lockstat *b)
+{
+	if (a->ls_contended != b->ls_contended) {
+		return a->ls_contended > b->ls_contended;
+	}
+	if (a->ls_waitns != b->ls_waitns) {
+		return a->ls_waitns > b->ls_waitns;
+	}
+	return a->ls_acquires > b->ls_acquires;
+}
+
+void
+lockstat_print(unsigned ntop, bool reset)
+{
+	bool shown[LOCKSTAT_MAX];
+	struct lockstat copy, *ls;
+	unsigned i, n, shownum, best;
+	char site[32];
+	int spl;
+
+	spl = lockstat_lock(&lockstat_tablelock);
+	n = lockstat_num;
+	lockstat_unlock(&lockstat_tablelock, spl);
+
+	for (i=0; i<n; i++) {
+		shown[i] = false;
+	}
+
+	kprintf("%-16s %-22s %8s %8s %10s %8s %10s %8s\n",
+		"NAME", "SITE", "ACQUIRES", "CONTEND", "WAIT(us)", "MAXWAIT",
+		"HOLD(us)", "MAXHOLD");
+
+	/* Records are never removed, so the first N stay valid. */
+	for (shownum=0; shownum<ntop && shownum<n; shownum++) {
+		best = n;
+		for (i=0; i<n; i++) {
+			if (shown[i]) {
+				continue;
+			}
+			if (best == n || lockstat_worse(&lockstat_table[i],
+							&lockstat_table[best])) {
+				best = i;
+			}
+		}
+		shown[best] = true;
+		ls = &lockstat_table[best];
+
+		/* don't call kprintf, which uses locks, with it held */
+		spl = lockstat_lock(&ls->ls_lock);
+		copy = *ls;
+		lockstat_unlock(&ls->ls_lock, spl);
+
+		if (copy.ls_acquires == 0) {
+			break;
+		}
+		snprintf(site, sizeof(site), "%s:%d",
+			 lockstat_shortfile(copy.ls_file), copy.ls_line);
+		kprintf("%-16s %-22s %8u %8u %10llu %8llu %10llu %8llu\n",
+			copy.ls_name, site, copy.ls_acquires,
+			copy.ls_contended, copy.ls_waitns / 1000,
+			copy.ls_maxwaitns / 1000, copy.ls_holdns / 1000,
+			copy.ls_maxholdns / 1000);
+	}
+	if (lockstat_overflow > 0) {
+		kprintf("(%u creation sites not tracked; table full)\n",
+			lockstat_overflow);
+	}
+
+	if (reset) {
+		for (i=0; i<n; i++) {
+			ls = &lockstat_table[i];
+			spl = lockstat_lock(&ls->ls_lock);
+			ls->ls_acquires = 0;
+			ls->ls_contended = 0;
+			ls->ls_waitns = 0;
+			ls->ls_maxwaitns = 0;
+			ls->ls_holdns = 0;
+			ls->ls_maxholdns = 0;
+			lockstat_unlock(&ls->ls_lock, spl);
+		}
+	}
+}
@@ -0,0 +1,180 @@
+/*
+ * Quiescent-state-based reclamation. See rcu.h.
+ *
+ * Every cpu counts its quiescent states in c_rcu_qs. Callbacks queue
+ * up in rcu_next; when no grace period is running, that batch moves
+ * to rcu_waiting and each cpu's count is recorded in c_rcu_snap.
+ * Once every cpu's count has moved on, the waiting batch is done.
+ *
+ * Idle cpus keep taking timer interrupts, and those count (the idle
+ * loop is never in a read section), so an idle cpu doesn't hold up
+ * grace periods.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <cpu.h>
+#include <current.h>
+#include <spinlock.h>
+#include <thread.h>
+#include <rcu.h>
+
+static struct spinlock rcu_lock;
+static struct rcu_head *rcu_waiting;	/* grace period running */
+static struct rcu_head *rcu_next;	/* queued since it started */
+static bool rcu_gprunning;
+
+void
+rcu_bootstrap(void)
+{
+	spinlock_init(&rcu_lock);
+	spinlock_register(&rcu_lock, "rcu");
+	rcu_waiting = NULL;
+	rcu_next = NULL;
+	rcu_gprunning = false;
+}
+
+void
+rcu_read_lock(void)
+{
+	curthread->t_rcunest++;
+}
+
+void
+rcu_read_unlock(void)
+{
+	struct thread *cur = curthread;
+
+	KASSERT(cur->t_rcunest > 0);
+	cur->t_rcunest--;
+	if (cur->t_rcunest == 0 && cur->t_yieldpending) {
+		/* hardclock put off a yield for us */
+		thread_yield_deferred();
+	}
+}
+
+bool
+rcu_read_held(void)
+{
+	return curthread->t_rcunest > 0;
+}
+
+void
+rcu_quiescent(void)
+{
+	curcpu->c_rcu_qs++;
+}
+
+/*
+ * Start a grace period: note where every cpu's count is now.
+ */
+static
+void
+rcu_gpstart(void)
+{
+	struct cpu *c;
+	unsigned i, n;
+
+	KASSERT(spinlock_do_i_hold(&rcu_lock));
+
+	n = cpu_count();
+	for (i=0; i<n; i++) {
+		c = cpu_bynumber(i);
+		c->c_rcu_snap = c->c_rcu_qs;
+	}
+	rcu_gprunning = true;
+}
+
+/*
+ * Has every cpu been through a quiescent state since rcu_gpstart?
+ */
+static
+bool
+rcu_gpdone(void)
+{
+	struct cpu *c;
+	unsigned i, n;
+
+	KASSERT(spinlock_do_i_hold(&rcu_lock));
+
+	n = cpu_count();
+	for (i=0; i<n; i++) {
+		c = cpu_bynumber(i);
+		if (c->c_rcu_qs == c->c_rcu_snap) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Run whatever callbacks are due, and start the next grace period if
+ * one is needed.
+ */
+static
+void
+rcu_poll(void)
+{
+	struct rcu_head *done, *rh;
+
+	/* we're not in a read section, so this cpu is quiescent now */
+	KASSERT(curthread->t_rcunest == 0);
+	rcu_quiescent();
+
+	done = NULL;
+	spinlock_acquire(&rcu_lock);
+	if (rcu_gprunning && rcu_gpdone()) {
+		done = rcu_waiting;
+		rcu_waiting = NULL;
+		rcu_gprunning = false;
+	}
+	if (!rcu_gprunning && rcu_next != NULL) {
+		rcu_waiting = rcu_next;
+		rcu_next = NULL;
+		rcu_gpstart();
+	}
+	spinlock_release(&rcu_lock);
+
+	while (done != NULL) {
+		rh = done;
+		done = rh->rh_next;
+		rh->rh_func(rh->rh_arg);
+	}
+}
+
+void
+rcu_call(struct rcu_head *rh, void (*func)(void *), void *arg)
+{
+	rh->rh_func = func;
+	rh->rh_arg = arg;
+
+	spinlock_acquire(&rcu_lock);
+	rh->rh_next = rcu_next;
+	rcu_next = rh;
+	spinlock_release(&rcu_lock);
+
+	rcu_poll();
+}
+
+static
+void
+rcu_syncdone(void *flag)
+{
+	*(volatile bool *)flag = true;
+}
+
+void
+rcu_synchronize(void)
+{
+	struct rcu_head rh;
+	volatile bool done = false;
+
+	KASSERT(curthread->t_in_interrupt == false);
+
+	rcu_call(&rh, rcu_syncdone, (void *)&done);
+	while (!done) {
+		clocknap(1);
+		rcu_poll();
+	}
+}
@@ -41,15 +41,63 @@
  * Spinlocks.
  */
 
+/*
+ * Backoff tuning. Waiting for our turn, we pause in proportion to the
+ * number of tickets ahead of us, SPINLOCK_BACKOFF_UNIT iterations
+ * each. Taking a ticket can fail if another cpu's SC gets in first;
+ * then we back off exponentially, starting at 1. Either way no single
+ * pause exceeds SPINLOCK_BACKOFF_MAX.
+ */
+#define SPINLOCK_BACKOFF_UNIT	8
+#define SPINLOCK_BACKOFF_MAX	1024
+
+/*
+ * Registered locks for spinlock_printstats.
+ */
+#define SPINLOCK_MAXREG		32
+
+static struct {
+	struct spinlock *lk;
+	const char *name;
+} spinlock_reg[SPINLOCK_MAXREG];
+static unsigned spinlock_nreg;
+static struct spinlock spinlock_reg_lock = SPINLOCK_INITIALIZER;
+
+/*
+ * Busy-wait for N iterations.
+ */
+static
+void
+spinlock_delay(unsigned n)
+{
+	volatile unsigned i;
+
+	for (i=0; i<n; i++) {
+		/* nothing */
+	}
+}
 
 /*
  * Initialize spinlock.
  */
+#if OPT_LOCKSTAT
+void
+spinlock_init_at(struct spinlock *lk, const char *file, int line)
+#else
 void
 spinlock_init(struct spinlock *lk)
+#endif
 {
-	spinlock_data_set(&lk->lk_lock, 0);
+	spinlock_data_set(&lk->lk_next, 0);
+	spinlock_data_set(&lk->lk_owner, 0);
 	lk->lk_holder = NULL;
+	lk->lk_acquires = 0;
+	lk->lk_contended = 0;
+	lk->lk_spins = 0;
+#if OPT_LOCKSTAT
+	lk->lk_stat = lockstat_get("spinlock", file, line);
+	lk->lk_acqtime = 0;
+#endif
 }
 
 /*
@@ -59,7 +107,8 @@ void
 spinlock_cleanup(struct spinlock *lk)
 {
 	KASSERT(lk->lk_holder == NULL);
-	KASSERT(spinlock_data_get(&lk->lk_lock) == 0);
+	KASSERT(spinlock_data_get(&lk->lk_next) ==
+		spinlock_data_get(&lk->lk_owner));
 }
 
 /*
@@ -67,14 +116,22 @@ spinlock_cleanup(struct spinlock *lk)
  *
  * First disable interrupts (otherwise, if we get a timer interrupt we
  * might come back to this lock and deadlock), then use a machine-level
- * atomic operation to wait for the lock to be free.
+ * atomic operation to take a ticket, and wait for it to come up.
  */
 void
 spinlock_acquire(struct spinlock *lk)
 {
 	struct cpu *mycpu;
+	spinlock_data_t ticket, serving;
+	unsigned backoff, spins;
+#if OPT_LOCKSTAT
+	uint64_t start;
+#endif
 
 	splraise(IPL_NONE, IPL_HIGH);
+#if OPT_LOCKSTAT
+	start = lockstat_now();
+#endif
 
 	/* this must work before curcpu initialization */
 	if (CURCPU_EXISTS()) {
@@ -87,27 +144,44 @@ spinlock_acquire(struct spinlock *lk)
 		mycpu = NULL;
 	}
 
-	while (1) {
-		/*
-		 * Do test-test-and-set, that is, read first before
-		 * doing test-and-set, to reduce bus contention.
-		 *
-		 * Test-and-set is a machine-level atomic operation
-		 * that writes 1 into the lock word and returns the
-		 * previous value. If that value was 0, the lock was
-		 * previously unheld and we now own it. If it was 1,
-		 * we don't.
-		 */
-		if (spinlock_data_get(&lk->lk_lock) != 0) {
-			continue;
+	spins = 0;
+
+	/* Take a ticket. */
+	backoff = 1;
+	while (!spinlock_data_tryadd(&lk->lk_next, 1, &ticket)) {
+		spinlock_delay(backoff);
+		spins += backoff;
+		if (backoff < SPINLOCK_BACKOFF_MAX) {
+			backoff *= 2;
 		}
-		if (spinlock_data_testandset(&lk->lk_lock) != 0) {
-			continue;
+	}
+
+	/*
+	 * Wait for it to be served. Only the holder writes lk_owner,
+	 * so we just read it; the further back in line we are, the
+	 * less often we look.
+	 */
+	while ((serving = spinlock_data_get(&lk->lk_owner)) != ticket) {
+		backoff = (ticket - serving) * SPINLOCK_BACKOFF_UNIT;
+		if (backoff > SPINLOCK_BACKOFF_MAX) {
+			backoff = SPINLOCK_BACKOFF_MAX;
 		}
-		break;
+		spinlock_delay(backoff);
+		spins += backoff;
 	}
 
 	lk->lk_holder = mycpu;
+
+	lk->lk_acquires++;
+	if (spins > 0) {
+		lk->lk_contended++;
+		lk->lk_spins += spins;
+	}
+
+#if OPT_LOCKSTAT
+	lk->lk_acqtime = lockstat_now();
+	lockstat_acquired(lk->lk_stat, spins > 0, start, lk->lk_acqtime);
+#endif
 }
 
 /*
@@ -121,8 +195,12 @@ spinlock_release(struct spinlock *lk)
 		KASSERT(lk->lk_holder == curcpu->c_self);
 	}
 
+#if OPT_LOCKSTAT
+	lockstat_released(lk->lk_stat, lk->lk_acqtime);
+#endif
+
 	lk->lk_holder = NULL;
-	spinlock_data_set(&lk->lk_lock, 0);
+	spinlock_data_set(&lk->lk_owner, spinlock_data_get(&lk->lk_owner) + 1);
 	spllower(IPL_HIGH, IPL_NONE);
 }
 
@@ -139,3 +217,65 @@ spinlock_do_i_hold(struct spinlock *lk)
 	/* Assume we can read lk_holder atomically enough for this to work */
 	return (lk->lk_holder == curcpu->c_self);
 }
+
+/*
+ * Add a lock to the statistics list. NAME is not copied.
+ */
+#if OPT_LOCKSTAT
+void
+spinlock_register_at(struct spinlock *lk, const char *name,
+		     const char *file, int line)
+#else
+void
+spinlock_register(struct spinlock *lk, const char *name)
+#endif
+{
+#if OPT_LOCKSTAT
+	/* A named lock gets a record of its own. */
+	spinlock_acquire(lk);
+	lk->lk_stat = lockstat_get(name, file, line);
+	spinlock_release(lk);
+#endif
+
+	spinlock_acquire(&spinlock_reg_lock);
+	if (spinlock_nreg < SPINLOCK_MAXREG) {
+		spinlock_reg[spinlock_nreg].lk = lk;
+		spinlock_reg[spinlock_nreg].name = name;
+		spinlock_nreg++;
+	}
+	spinlock_release(&spinlock_reg_lock);
+}
+
+/*
+ * Print the statistics of the registered locks. If RESET, zero them
+ * afterwards.
+ */
+void
+spinlock_printstats(bool reset)
+{
+	struct spinlock *lk;
+	unsigned i, n;
+
+	/* Entries are never removed, so the first N stay valid. */
+	spinlock_acquire(&spinlock_reg_lock);
+	n = spinlock_nreg;
+	spinlock_release(&spinlock_reg_lock);
+
+	kprintf("%-16s %10s %10s %12s %8s\n",
+		"NAME", "ACQUIRES", "CONTENDED", "SPINS", "SPINS/C");
+	for (i=0; i<n; i++) {
+		lk = spinlock_reg[i].lk;
+		kprintf("%-16s %10u %10u %12llu %8llu\n",
+			spinlock_reg[i].name, lk->lk_acquires,
+			lk->lk_contended, lk->lk_spins,
+			lk->lk_contended ?
+			lk->lk_spins / lk->lk_contended : 0);
+		if (reset) {
+			spinlock_acquire(lk);
+			lk->lk_acquires = 0;
+			lk->lk_contended = 0;
+			lk->lk_spins = 0;
+			spinlock_release(lk);
+		}
+	}
+}
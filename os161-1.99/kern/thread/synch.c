@@ -33,7 +33,9 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
+#include <clock.h>
 #include <spinlock.h>
 #include <wchan.h>
 #include <thread.h>
@@ -147,8 +149,13 @@ V(struct semaphore *sem)
 //
 // Lock.
 
+#if OPT_LOCKSTAT
+struct lock *
+lock_create_at(const char *name, const char *file, int line)
+#else
 struct lock *
 lock_create(const char *name)
+#endif
 {
         struct lock *lock;
  
@@ -173,6 +180,11 @@ lock_create(const char *name)
         spinlock_init(&lock->lk_lock);
         lock->lk_thread = NULL;
         lock->lk_bool = false;
+        lock->lk_sleeps = 0;
+#if OPT_LOCKSTAT
+        lock->lk_stat = lockstat_get(name, file, line);
+        lock->lk_acqtime = 0;
+#endif
  
         return lock;
 }
@@ -190,15 +202,62 @@ lock_destroy(struct lock *lock)
         kfree(lock);
 }
 
+/*
+ * Locks are adaptive: if the holder is running on another cpu it will
+ * probably let go soon, and spinning for a bit is much cheaper than
+ * two context switches. We poll lk_bool LOCK_SPIN_BURST times between
+ * looks at the holder, and give up and sleep after LOCK_SPIN_MAX
+ * polls in all or as soon as the holder isn't running.
+ */
+#define LOCK_SPIN_BURST 64
+#define LOCK_SPIN_MAX   4096
+
+/*
+ * Is the holder of LOCK running on some other cpu? Call with lk_lock
+ * held, which keeps the holder from releasing the lock (and so from
+ * exiting) while we look at it.
+ */
+static
+bool
+lock_holder_running(struct lock *lock)
+{
+        struct thread *holder;
+
+        KASSERT(spinlock_do_i_hold(&lock->lk_lock));
+        holder = lock->lk_thread;
+        return holder != NULL && holder->t_state == S_RUN &&
+                holder->t_cpu != curthread->t_cpu;
+}
+
 void
 lock_acquire(struct lock *lock)
 {
+        unsigned spins, i;
+#if OPT_LOCKSTAT
+        uint64_t start = lockstat_now();
+        bool contended = false;
+#endif
+
         KASSERT(!lock_do_i_hold(lock));
         KASSERT(curthread->t_in_interrupt == false);
         // acquire spinlock
         spinlock_acquire(&lock->lk_lock);
  
+        spins = 0;
         while(lock->lk_bool == true) {
+#if OPT_LOCKSTAT
+                contended = true;
+#endif
+                if (spins < LOCK_SPIN_MAX && lock_holder_running(lock)) {
+                        spinlock_release(&lock->lk_lock);
+                        for (i=0; i<LOCK_SPIN_BURST && lock->lk_bool; i++) {
+                                /* spin */
+                        }
+                        spins += LOCK_SPIN_BURST;
+                        spinlock_acquire(&lock->lk_lock);
+                        continue;
+                }
+                lock->lk_sleeps++;
                 wchan_lock(lock->lk_wchan);
                 spinlock_release(&lock->lk_lock);
                 wchan_sleep(lock->lk_wchan);
@@ -207,21 +266,107 @@ lock_acquire(struct lock *lock)
  
         lock->lk_bool = true;
         lock->lk_thread = curthread;
+        curthread->t_locksheld++;
  
         spinlock_release(&lock->lk_lock); // release spinlock
+
+#if OPT_LOCKSTAT
+        lock->lk_acqtime = lockstat_now();
+        lockstat_acquired(lock->lk_stat, contended, start, lock->lk_acqtime);
+#endif
+}
+
+bool
+lock_tryacquire(struct lock *lock)
+{
+        bool acquired;
+
+        KASSERT(!lock_do_i_hold(lock));
+        spinlock_acquire(&lock->lk_lock);
+        acquired = !lock->lk_bool;
+        if (acquired) {
+                lock->lk_bool = true;
+                lock->lk_thread = curthread;
+                curthread->t_locksheld++;
+        }
+        spinlock_release(&lock->lk_lock);
+#if OPT_LOCKSTAT
+        if (acquired) {
+                lock->lk_acqtime = lockstat_now();
+                lockstat_acquired(lock->lk_stat, false, 0, 0);
+        }
+#endif
+        return acquired;
+}
+
+int
+lock_acquire_timeout(struct lock *lock, uint32_t ticks)
+{
+        uint32_t deadline;
+        int32_t remaining;
+#if OPT_LOCKSTAT
+        uint64_t start = lockstat_now();
+        bool contended = false;
+#endif
+
+        KASSERT(!lock_do_i_hold(lock));
+        KASSERT(curthread->t_in_interrupt == false);
+
+        deadline = clock_ticks() + ticks;
+        spinlock_acquire(&lock->lk_lock);
+        while (lock->lk_bool == true) {
+#if OPT_LOCKSTAT
+                contended = true;
+#endif
+                remaining = (int32_t)(deadline - clock_ticks());
+                if (remaining <= 0) {
+                        spinlock_release(&lock->lk_lock);
+                        return ETIMEDOUT;
+                }
+                wchan_lock(lock->lk_wchan);
+                spinlock_release(&lock->lk_lock);
+                /*
+                 * Whether we time out or not, go around again: the
+                 * lock might be free by now, and if it isn't the
+                 * deadline check above decides.
+                 */
+                wchan_timedsleep(lock->lk_wchan, remaining);
+                spinlock_acquire(&lock->lk_lock);
+        }
+
+        lock->lk_bool = true;
+        lock->lk_thread = curthread;
+        curthread->t_locksheld++;
+
+        spinlock_release(&lock->lk_lock);
+#if OPT_LOCKSTAT
+        lock->lk_acqtime = lockstat_now();
+        lockstat_acquired(lock->lk_stat, contended, start, lock->lk_acqtime);
+#endif
+        return 0;
 }
 
 void
 lock_release(struct lock *lock)
 {
         KASSERT(lock_do_i_hold(lock));
+#if OPT_LOCKSTAT
+        lockstat_released(lock->lk_stat, lock->lk_acqtime);
+#endif
         // acquire spinlock
         spinlock_acquire(&lock->lk_lock);
         lock->lk_bool = false;
         wchan_wakeone(lock->lk_wchan);
         lock->lk_thread = NULL;
+        KASSERT(curthread->t_locksheld > 0);
+        curthread->t_locksheld--;
  
         spinlock_release(&lock->lk_lock); // release
+
+        /* if hardclock put off preempting us, this is the time */
+        if (curthread->t_yieldpending) {
+                thread_yield_deferred();
+        }
 }
 
 bool
@@ -295,6 +440,22 @@ cv_wait(struct cv *cv, struct lock *lock)
         lock_acquire(lock);
 }
  
+int
+cv_timedwait(struct cv *cv, struct lock *lock, uint32_t ticks)
+{
+        int result;
+
+        KASSERT(cv != NULL);
+        KASSERT(lock != NULL);
+        KASSERT(lock_do_i_hold(lock));
+
+        wchan_lock(cv->cv_wchan);
+        lock_release(lock);
+        result = wchan_timedsleep(cv->cv_wchan, ticks);
+        lock_acquire(lock);
+        return result;
+}
+
 void
 cv_signal(struct cv *cv, struct lock *lock)
 {
@@ -312,3 +473,157 @@ cv_broadcast(struct cv *cv, struct lock *lock)
         KASSERT(lock != NULL);
         wchan_wakeall(cv->cv_wchan);
 }
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock.
+
+struct rwlock *
+rwlock_create(const char *name)
+{
+        struct rwlock *rw;
+
+        rw = kmalloc(sizeof(struct rwlock));
+        if (rw == NULL) {
+                return NULL;
+        }
+
+        rw->rw_name = kstrdup(name);
+        if (rw->rw_name == NULL) {
+                kfree(rw);
+                return NULL;
+        }
+
+        rw->rw_rwchan = wchan_create(rw->rw_name);
+        if (rw->rw_rwchan == NULL) {
+                kfree(rw->rw_name);
+                kfree(rw);
+                return NULL;
+        }
+        rw->rw_wwchan = wchan_create(rw->rw_name);
+        if (rw->rw_wwchan == NULL) {
+                wchan_destroy(rw->rw_rwchan);
+                kfree(rw->rw_name);
+                kfree(rw);
+                return NULL;
+        }
+
+        spinlock_init(&rw->rw_lock);
+        rw->rw_readers = 0;
+        rw->rw_wwaiting = 0;
+        rw->rw_writer = NULL;
+
+        return rw;
+}
+
+void
+rwlock_destroy(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+        KASSERT(rw->rw_readers == 0);
+        KASSERT(rw->rw_writer == NULL);
+        KASSERT(rw->rw_wwaiting == 0);
+
+        spinlock_cleanup(&rw->rw_lock);
+        wchan_destroy(rw->rw_wwchan);
+        wchan_destroy(rw->rw_rwchan);
+
+        kfree(rw->rw_name);
+        kfree(rw);
+}
+
+void
+rwlock_acquire_read(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+        KASSERT(rw->rw_writer != curthread);
+        KASSERT(curthread->t_in_interrupt == false);
+
+        spinlock_acquire(&rw->rw_lock);
+        /* writer preference: stand behind any writer that is waiting */
+        while (rw->rw_writer != NULL || rw->rw_wwaiting > 0) {
+                wchan_lock(rw->rw_rwchan);
+                spinlock_release(&rw->rw_lock);
+                wchan_sleep(rw->rw_rwchan);
+                spinlock_acquire(&rw->rw_lock);
+        }
+        rw->rw_readers++;
+        spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_read(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+
+        spinlock_acquire(&rw->rw_lock);
+        KASSERT(rw->rw_readers > 0);
+        KASSERT(rw->rw_writer == NULL);
+        rw->rw_readers--;
+        if (rw->rw_readers == 0 && rw->rw_wwaiting > 0) {
+                wchan_wakeone(rw->rw_wwchan);
+        }
+        spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_acquire_write(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+        KASSERT(rw->rw_writer != curthread);
+        KASSERT(curthread->t_in_interrupt == false);
+
+        spinlock_acquire(&rw->rw_lock);
+        rw->rw_wwaiting++;
+        while (rw->rw_writer != NULL || rw->rw_readers > 0) {
+                wchan_lock(rw->rw_wwchan);
+                spinlock_release(&rw->rw_lock);
+                wchan_sleep(rw->rw_wwchan);
+                spinlock_acquire(&rw->rw_lock);
+        }
+        rw->rw_wwaiting--;
+        rw->rw_writer = curthread;
+        spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_write(struct rwlock *rw)
+{
+        KASSERT(rwlock_do_i_hold_write(rw));
+
+        spinlock_acquire(&rw->rw_lock);
+        rw->rw_writer = NULL;
+        /* hand off to the next writer if there is one, else all readers */
+        if (rw->rw_wwaiting > 0) {
+                wchan_wakeone(rw->rw_wwchan);
+        }
+        else {
+                wchan_wakeall(rw->rw_rwchan);
+        }
+        spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_downgrade(struct rwlock *rw)
+{
+        KASSERT(rwlock_do_i_hold_write(rw));
+
+        spinlock_acquire(&rw->rw_lock);
+        rw->rw_writer = NULL;
+        rw->rw_readers++;
+        /*
+         * Other readers can come in with us, unless a writer is
+         * waiting; then they keep waiting behind it.
+         */
+        if (rw->rw_wwaiting == 0) {
+                wchan_wakeall(rw->rw_rwchan);
+        }
+        spinlock_release(&rw->rw_lock);
+}
+
+bool
+rwlock_do_i_hold_write(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+        return rw->rw_writer == curthread;
+}
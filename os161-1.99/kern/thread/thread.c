@@ -41,6 +41,7 @@
 #include <spl.h>
 #include <spinlock.h>
 #include <wchan.h>
+#include <clock.h>
 #include <thread.h>
 #include <threadlist.h>
 #include <threadprivate.h>
@@ -50,6 +51,8 @@
 #include <addrspace.h>
 #include <mainbus.h>
 #include <vnode.h>
+#include <rcu.h>
+#include <sysstat.h>
 
 #include "opt-synchprobs.h"
 
@@ -72,6 +75,14 @@ static struct cpuarray allcpus;
 /* Used to wait for secondary CPUs to come online. */
 static struct semaphore *cpu_startup_sem;
 
+/*
+ * Every thread that exists, for the benefit of thread_printstats.
+ * Each thread remembers its own index so it can be removed in
+ * constant time.
+ */
+static struct threadarray allthreads;
+static struct spinlock allthreads_lock;
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -112,26 +123,51 @@ thread_checkstack(struct thread *thread)
 }
 
 /*
- * Create a thread. This is used both to create a first thread
- * for each CPU and to create subsequent forked threads.
+ * Set a thread's name. Short names are kept in the thread itself to
+ * save a kstrdup on every fork.
  */
 static
-struct thread *
-thread_create(const char *name)
+int
+thread_setname(struct thread *thread, const char *name)
 {
-	struct thread *thread;
-
-	DEBUGASSERT(name != NULL);
-
-	thread = kmalloc(sizeof(*thread));
-	if (thread == NULL) {
-		return NULL;
+	if (strlen(name) < sizeof(thread->t_namebuf)) {
+		strcpy(thread->t_namebuf, name);
+		thread->t_name = thread->t_namebuf;
+		return 0;
 	}
-
 	thread->t_name = kstrdup(name);
 	if (thread->t_name == NULL) {
-		kfree(thread);
-		return NULL;
+		return ENOMEM;
+	}
+	return 0;
+}
+
+static
+void
+thread_freename(struct thread *thread)
+{
+	if (thread->t_name != thread->t_namebuf) {
+		kfree(thread->t_name);
+	}
+	thread->t_name = NULL;
+}
+
+/*
+ * Initialize the fields of a thread structure, which is either
+ * freshly allocated or a recycled shell from the thread cache. The
+ * stack (t_stack) is left alone.
+ */
+static
+int
+thread_init(struct thread *thread, const char *name)
+{
+	int result;
+
+	DEBUGASSERT(name != NULL);
+
+	result = thread_setname(thread, name);
+	if (result) {
+		return result;
 	}
 	thread->t_wchan_name = "NEW";
 	thread->t_state = S_READY;
@@ -139,21 +175,192 @@ thread_create(const char *name)
 	/* Thread subsystem fields */
 	thread_machdep_init(&thread->t_machdep);
 	threadlistnode_init(&thread->t_listnode, thread);
-	thread->t_stack = NULL;
 	thread->t_context = NULL;
 	thread->t_cpu = NULL;
 	thread->t_proc = NULL;
+	thread->t_tid = 0;
+	thread->t_wchan = NULL;
 
 	/* Interrupt state fields */
 	thread->t_in_interrupt = false;
+	thread->t_intr_fromuser = false;
 	thread->t_curspl = IPL_HIGH;
 	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
 
+	/* Accounting fields */
+	thread->t_utime = 0;
+	thread->t_stime = 0;
+	thread->t_nvcsw = 0;
+	thread->t_nivcsw = 0;
+	thread->t_minflt = 0;
+	thread->t_inbytes = 0;
+	thread->t_outbytes = 0;
+	thread->t_readystamp = 0;
+	thread->t_waitticks = 0;
+	thread->t_pass = 0;
+	thread->t_locksheld = 0;
+	thread->t_preemptdeferred = 0;
+	thread->t_yieldpending = false;
+	thread->t_rcunest = 0;
+
 	/* If you add to struct thread, be sure to initialize here */
 
+	spinlock_acquire(&allthreads_lock);
+	result = threadarray_add(&allthreads, thread, &thread->t_allindex);
+	spinlock_release(&allthreads_lock);
+	if (result) {
+		threadlistnode_cleanup(&thread->t_listnode);
+		thread_machdep_cleanup(&thread->t_machdep);
+		thread_freename(thread);
+		return result;
+	}
+
+	return 0;
+}
+
+/*
+ * Create a thread. This is used both to create a first thread
+ * for each CPU and to create subsequent forked threads.
+ */
+static
+struct thread *
+thread_create(const char *name)
+{
+	struct thread *thread;
+
+	thread = kmalloc(sizeof(*thread));
+	if (thread == NULL) {
+		return NULL;
+	}
+	thread->t_stack = NULL;
+
+	if (thread_init(thread, name)) {
+		kfree(thread);
+		return NULL;
+	}
+
 	return thread;
 }
 
+////////////////////////////////////////////////////////////
+//
+// Thread cache.
+//
+// Rather than freeing exited threads, exorcise() keeps up to
+// THREAD_CACHE_MAX of them per cpu, stack and all, for thread_fork to
+// reuse. The stack guard band is still intact in a cached shell, so
+// reuse only has to reinitialize the thread fields.
+//
+// When kmalloc runs out it calls thread_cache_reclaim(), which empties
+// every cpu's cache. The thread structs go back to the subpage
+// allocator and can be handed out again straight away; the stacks are
+// whole pages, which only come back if the VM system reuses pages
+// given to free_kpages (dumbvm doesn't).
+
+#define THREAD_CACHE_MAX 16
+
+/*
+ * Try to put a thread that has been torn down by thread_destroy into
+ * the current cpu's cache. Returns true if it was taken.
+ */
+static
+bool
+thread_cache_put(struct thread *thread)
+{
+	struct cpu *c;
+	bool cached = false;
+
+	thread_checkstack(thread);
+	threadlistnode_init(&thread->t_listnode, thread);
+
+	c = curcpu->c_self;
+	spinlock_acquire(&c->c_threadcache_lock);
+	if (c->c_threadcache.tl_count < THREAD_CACHE_MAX) {
+		threadlist_addhead(&c->c_threadcache, thread);
+		cached = true;
+	}
+	spinlock_release(&c->c_threadcache_lock);
+
+	if (!cached) {
+		threadlistnode_cleanup(&thread->t_listnode);
+	}
+	return cached;
+}
+
+/*
+ * Get a thread from the current cpu's cache and initialize it. The
+ * result comes with a stack. Returns NULL if the cache is empty.
+ */
+static
+struct thread *
+thread_cache_get(const char *name)
+{
+	struct thread *thread;
+	struct cpu *c;
+
+	c = curcpu->c_self;
+	spinlock_acquire(&c->c_threadcache_lock);
+	thread = threadlist_remhead(&c->c_threadcache);
+	spinlock_release(&c->c_threadcache_lock);
+
+	if (thread == NULL) {
+		return NULL;
+	}
+	threadlistnode_cleanup(&thread->t_listnode);
+
+	KASSERT(thread->t_stack != NULL);
+	if (thread_init(thread, name)) {
+		kfree(thread->t_stack);
+		kfree(thread);
+		return NULL;
+	}
+	return thread;
+}
+
+/*
+ * Free every cached thread on every cpu. Returns the number freed.
+ */
+unsigned
+thread_cache_reclaim(void)
+{
+	struct threadlist victims;
+	struct thread *t;
+	struct cpu *c;
+	unsigned i, count = 0;
+
+	threadlist_init(&victims);
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		spinlock_acquire(&c->c_threadcache_lock);
+		while ((t = threadlist_remhead(&c->c_threadcache)) != NULL) {
+			threadlist_addtail(&victims, t);
+		}
+		spinlock_release(&c->c_threadcache_lock);
+	}
+
+	while ((t = threadlist_remhead(&victims)) != NULL) {
+		threadlistnode_cleanup(&t->t_listnode);
+		kfree(t->t_stack);
+		kfree(t);
+		count++;
+	}
+	threadlist_cleanup(&victims);
+
+	return count;
+}
+
+unsigned
+cpu_count(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
+struct cpu *
+cpu_bynumber(unsigned n)
+{
+	return cpuarray_get(&allcpus, n);
+}
+
 /*
  * Create a CPU structure. This is used for the bootup CPU and
  * also for secondary CPUs.
@@ -180,10 +387,18 @@ cpu_create(unsigned hardware_number)
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
 	c->c_hardclocks = 0;
+	sysstat_cpucreate(c);
+	threadlist_init(&c->c_threadcache);
+	spinlock_init(&c->c_threadcache_lock);
+
+	c->c_rcu_qs = 0;
+	c->c_rcu_snap = 0;
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
+	c->c_pass = 0;
 	spinlock_init(&c->c_runqueue_lock);
+	spinlock_register(&c->c_runqueue_lock, "runqueue");
 
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
@@ -239,9 +454,22 @@ static
 void
 thread_destroy(struct thread *thread)
 {
+	struct thread *last;
+	unsigned num;
+
 	KASSERT(thread != curthread);
 	KASSERT(thread->t_state != S_RUN);
 
+	/* Swap the last thread into our slot in allthreads. */
+	spinlock_acquire(&allthreads_lock);
+	num = threadarray_num(&allthreads);
+	KASSERT(threadarray_get(&allthreads, thread->t_allindex) == thread);
+	last = threadarray_get(&allthreads, num - 1);
+	threadarray_set(&allthreads, thread->t_allindex, last);
+	last->t_allindex = thread->t_allindex;
+	threadarray_setsize(&allthreads, num - 1);
+	spinlock_release(&allthreads_lock);
+
 	/*
 	 * If you add things to struct thread, be sure to clean them up
 	 * either here or in thread_exit(). (And not both...)
@@ -249,16 +477,21 @@ thread_destroy(struct thread *thread)
 
 	/* Thread subsystem fields */
 	KASSERT(thread->t_proc == NULL);
-	if (thread->t_stack != NULL) {
-		kfree(thread->t_stack);
-	}
 	threadlistnode_cleanup(&thread->t_listnode);
 	thread_machdep_cleanup(&thread->t_machdep);
 
 	/* sheer paranoia */
 	thread->t_wchan_name = "DESTROYED";
 
-	kfree(thread->t_name);
+	thread_freename(thread);
+
+	/* Keep the shell for reuse if we can. */
+	if (thread->t_stack != NULL) {
+		if (thread_cache_put(thread)) {
+			return;
+		}
+		kfree(thread->t_stack);
+	}
 	kfree(thread);
 }
 
@@ -350,6 +583,9 @@ thread_bootstrap(void)
 	struct thread *bootthread;
 
 	cpuarray_init(&allcpus);
+	threadarray_init(&allthreads);
+	spinlock_init(&allthreads_lock);
+	spinlock_register(&allthreads_lock, "allthreads");
 
 	/*
 	 * Create the cpu structure for the bootup CPU, the one we're
@@ -426,6 +662,69 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Stride scheduling.
+ *
+ * Each process holds some number of tickets (p_tickets); its stride
+ * is STRIDE1 divided by that. Every hardclock tick a thread spends
+ * running advances its pass by its stride, and each run queue is kept
+ * sorted by pass, lowest first, so over time threads get CPU in
+ * proportion to their tickets.
+ *
+ * c_pass is the pass of the last thread dispatched on the cpu, which
+ * is the cpu's notion of "now". A thread coming onto a run queue
+ * with a smaller pass (one that has been asleep, or is new) is
+ * brought up to it, so it can't bank credit while not runnable.
+ *
+ * Passes are 64 bits so we don't have to worry about wraparound.
+ */
+#define STRIDE1		(1U << 20)
+
+/*
+ * Insert a thread into a run queue in pass order, after any threads
+ * with the same pass. Searches from the tail, since a thread that has
+ * just run usually belongs at or near the end. The caller must hold
+ * the run queue lock.
+ */
+static
+void
+thread_enqueue(struct cpu *c, struct thread *t)
+{
+	struct threadlistnode *tln;
+
+	KASSERT(spinlock_do_i_hold(&c->c_runqueue_lock));
+
+	if (t->t_pass < c->c_pass) {
+		t->t_pass = c->c_pass;
+	}
+
+	for (tln = c->c_runqueue.tl_tail.tln_prev;
+	     tln->tln_self != NULL;
+	     tln = tln->tln_prev) {
+		if (tln->tln_self->t_pass <= t->t_pass) {
+			threadlist_insertafter(&c->c_runqueue,
+					       tln->tln_self, t);
+			return;
+		}
+	}
+	threadlist_addhead(&c->c_runqueue, t);
+}
+
+/*
+ * Charge the current thread for a hardclock tick.
+ */
+void
+thread_charge_pass(void)
+{
+	struct proc *p;
+	unsigned tickets;
+
+	p = curthread->t_proc;
+	tickets = (p != NULL) ? p->p_tickets : PROC_TICKETS_DEFAULT;
+	KASSERT(tickets > 0);
+	curthread->t_pass += STRIDE1 / tickets;
+}
+
 /*
  * Make a thread runnable.
  *
@@ -450,7 +749,8 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 	}
 
 	isidle = targetcpu->c_isidle;
-	threadlist_addtail(&targetcpu->c_runqueue, target);
+	target->t_readystamp = clock_ticks();
+	thread_enqueue(targetcpu, target);
 	if (isidle) {
 		/*
 		 * Other processor is idle; send interrupt to make
@@ -487,18 +787,22 @@ thread_fork(const char *name,
 	DEBUG(DB_THREADS,"Forking thread: %s\n",name);
 #endif // UW
 
-	newthread = thread_create(name);
+	/* Use a cached thread, stack and all, if there is one. */
+	newthread = thread_cache_get(name);
 	if (newthread == NULL) {
-		return ENOMEM;
-	}
+		newthread = thread_create(name);
+		if (newthread == NULL) {
+			return ENOMEM;
+		}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
+		/* Allocate a stack */
+		newthread->t_stack = kmalloc(STACK_SIZE);
+		if (newthread->t_stack == NULL) {
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
+		thread_checkstack_init(newthread);
 	}
-	thread_checkstack_init(newthread);
 
 	/*
 	 * Now we clone various fields from the parent thread.
@@ -570,6 +874,10 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	/* Check the stack guard band. */
 	thread_checkstack(cur);
 
+	/* No sleeping in RCU read sections; any switch is quiescent. */
+	KASSERT(cur->t_rcunest == 0);
+	rcu_quiescent();
+
 	/* Lock the run queue. */
 	spinlock_acquire(&curcpu->c_runqueue_lock);
 
@@ -580,6 +888,22 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 		return;
 	}
 
+	/*
+	 * Count the switch. Yielding from an interrupt handler means
+	 * we were preempted by the timer; anything else was our own
+	 * idea.
+	 */
+	if (newstate == S_READY && cur->t_in_interrupt) {
+		cur->t_nivcsw++;
+	}
+	else {
+		cur->t_nvcsw++;
+	}
+
+	/* Any switch pays off a yield hardclock put off. */
+	cur->t_yieldpending = false;
+	cur->t_preemptdeferred = 0;
+
 	/* Put the thread in the right place. */
 	switch (newstate) {
 	    case S_RUN:
@@ -602,6 +926,7 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 		 * or want it locked and if it does can lock it itself
 		 * without racing. Exercise: what's the other?)
 		 */
+		cur->t_wchan = wc;
 		threadlist_addtail(&wc->wc_threads, cur);
 		wchan_unlock(wc);
 		break;
@@ -641,6 +966,14 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	} while (next == NULL);
 	curcpu->c_isidle = false;
 
+	/* Advance the cpu's virtual time. */
+	if (next->t_pass > curcpu->c_pass) {
+		curcpu->c_pass = next->t_pass;
+	}
+
+	/* Charge the time it spent on the run queue. */
+	next->t_waitticks += clock_ticks() - next->t_readystamp;
+
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
 	 * curthread and it may not be, depending on how curthread and
@@ -817,6 +1150,21 @@ thread_yield(void)
 	thread_switch(S_READY, NULL);
 }
 
+void
+thread_yield_deferred(void)
+{
+	struct thread *cur = curthread;
+
+	if (!cur->t_yieldpending || cur->t_locksheld > 0 ||
+	    cur->t_rcunest > 0 ||
+	    cur->t_in_interrupt || cur->t_iplhigh_count > 0) {
+		return;
+	}
+	cur->t_yieldpending = false;
+	cur->t_preemptdeferred = 0;
+	thread_yield();
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -830,8 +1178,9 @@ void
 schedule(void)
 {
 	/*
-	 * You can write this. If we do nothing, threads will run in
-	 * round-robin fashion.
+	 * Nothing to do: thread_enqueue keeps the run queue in pass
+	 * order as threads are added to it, and hardclock yields
+	 * every tick, so the lowest pass always runs next.
 	 */
 }
 
@@ -923,8 +1272,19 @@ thread_consider_migration(void)
 				continue;
 			}
 
+			/*
+			 * Carry over how far ahead of this cpu's
+			 * virtual time the thread was; passes on
+			 * different cpus aren't comparable.
+			 */
+			if (t->t_pass > curcpu->c_pass) {
+				t->t_pass += c->c_pass - curcpu->c_pass;
+			}
+			else {
+				t->t_pass = c->c_pass;
+			}
 			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
+			thread_enqueue(c, t);
 			DEBUG(DB_THREADS,
 			      "Migrated thread %s: cpu %u -> %u",
 			      t->t_name, curcpu->c_number, c->c_number);
@@ -948,7 +1308,7 @@ thread_consider_migration(void)
 	if (!threadlist_isempty(&victims)) {
 		spinlock_acquire(&curcpu->c_runqueue_lock);
 		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
+			thread_enqueue(curcpu->c_self, t);
 		}
 		spinlock_release(&curcpu->c_runqueue_lock);
 	}
@@ -959,6 +1319,102 @@ thread_consider_migration(void)
 
 ////////////////////////////////////////////////////////////
 
+/*
+ * Thread statistics
+ */
+
+/* Snapshot of one thread's accounting, for thread_printstats. */
+struct threadstat {
+	char ts_name[24];
+	threadstate_t ts_state;
+	unsigned ts_cpu;
+	unsigned ts_utime;
+	unsigned ts_stime;
+	unsigned ts_nvcsw;
+	unsigned ts_nivcsw;
+	uint32_t ts_waitticks;
+};
+
+static const char *const threadstatenames[] = {
+	"run", "ready", "sleep", "zombie",
+};
+
+/*
+ * Print a table of all threads, busiest first. Times are printed in
+ * milliseconds.
+ *
+ * We copy everything out under the allthreads lock and print after
+ * releasing it, because printing is slow and threads may come and go
+ * meanwhile.
+ */
+void
+thread_printstats(void)
+{
+	struct threadstat *stats, tmp;
+	struct thread *t;
+	unsigned i, j, num, max;
+	uint32_t tickspersec;
+
+	/* Leave some slack in case threads get created meanwhile. */
+	spinlock_acquire(&allthreads_lock);
+	max = threadarray_num(&allthreads) + 16;
+	spinlock_release(&allthreads_lock);
+
+	stats = kmalloc(max * sizeof(*stats));
+	if (stats == NULL) {
+		kprintf("thread_printstats: Out of memory\n");
+		return;
+	}
+
+	spinlock_acquire(&allthreads_lock);
+	num = threadarray_num(&allthreads);
+	if (num > max) {
+		num = max;
+	}
+	for (i=0; i<num; i++) {
+		t = threadarray_get(&allthreads, i);
+		snprintf(stats[i].ts_name, sizeof(stats[i].ts_name),
+			 "%s", t->t_name);
+		stats[i].ts_state = t->t_state;
+		stats[i].ts_cpu = t->t_cpu != NULL ? t->t_cpu->c_number : 0;
+		stats[i].ts_utime = t->t_utime;
+		stats[i].ts_stime = t->t_stime;
+		stats[i].ts_nvcsw = t->t_nvcsw;
+		stats[i].ts_nivcsw = t->t_nivcsw;
+		stats[i].ts_waitticks = t->t_waitticks;
+	}
+	spinlock_release(&allthreads_lock);
+
+	/* Insertion sort by total cpu time, descending. */
+	for (i=1; i<num; i++) {
+		tmp = stats[i];
+		for (j=i; j>0 && stats[j-1].ts_utime + stats[j-1].ts_stime <
+			     tmp.ts_utime + tmp.ts_stime; j--) {
+			stats[j] = stats[j-1];
+		}
+		stats[j] = tmp;
+	}
+
+	tickspersec = clock_timetoticks(1, 0);
+	kprintf("%-24s %-6s %3s %9s %9s %7s %7s %9s\n", "NAME", "STATE",
+		"CPU", "USER(ms)", "SYS(ms)", "VCSW", "IVCSW", "WAIT(ms)");
+	for (i=0; i<num; i++) {
+		kprintf("%-24s %-6s %3u %9u %9u %7u %7u %9u\n",
+			stats[i].ts_name,
+			threadstatenames[stats[i].ts_state],
+			stats[i].ts_cpu,
+			stats[i].ts_utime * 1000 / HZ,
+			stats[i].ts_stime * 1000 / HZ,
+			stats[i].ts_nvcsw,
+			stats[i].ts_nivcsw,
+			stats[i].ts_waitticks * 1000 / tickspersec);
+	}
+
+	kfree(stats);
+}
+
+////////////////////////////////////////////////////////////
+
 /*
  * Wait channel functions
  */
@@ -1028,6 +1484,62 @@ wchan_sleep(struct wchan *wc)
 	thread_switch(S_SLEEP, wc);
 }
 
+/*
+ * State shared between a thread in wchan_timedsleep and its timeout
+ * callout.
+ */
+struct wchan_timeout {
+	struct wchan *wt_wchan;
+	struct thread *wt_thread;
+	bool wt_expired;
+};
+
+static
+void
+wchan_timeout_expire(void *data)
+{
+	struct wchan_timeout *wt = data;
+
+	spinlock_acquire(&wt->wt_wchan->wc_lock);
+	/* Only counts as a timeout if nobody woke the thread first. */
+	wt->wt_expired = wchan_wakethread(wt->wt_wchan, wt->wt_thread);
+	spinlock_release(&wt->wt_wchan->wc_lock);
+}
+
+/*
+ * Like wchan_sleep, but give up after NUM_TICKS timer ticks. Returns
+ * 0 if woken by someone else and ETIMEDOUT if the time ran out. If
+ * the timeout fires, the thread is taken off the channel before it
+ * runs again, so there is nothing for the caller to clean up.
+ */
+int
+wchan_timedsleep(struct wchan *wc, uint32_t num_ticks)
+{
+	struct wchan_timeout wt;
+	struct callout co;
+
+	KASSERT(!curthread->t_in_interrupt);
+	KASSERT(spinlock_do_i_hold(&wc->wc_lock));
+
+	wt.wt_wchan = wc;
+	wt.wt_thread = curthread;
+	wt.wt_expired = false;
+	callout_init(&co, wchan_timeout_expire, &wt);
+
+	/*
+	 * Schedule with the channel locked; if the callout fires
+	 * before we're asleep it waits on the channel lock and then
+	 * finds us on the list.
+	 */
+	callout_schedule(&co, num_ticks);
+	thread_switch(S_SLEEP, wc);
+
+	/* The channel is unlocked now, so this can't deadlock. */
+	callout_stop(&co);
+
+	return wt.wt_expired ? ETIMEDOUT : 0;
+}
+
 /*
  * Wake up one thread sleeping on a wait channel.
  */
@@ -1039,6 +1551,9 @@ wchan_wakeone(struct wchan *wc)
 	/* Lock the channel and grab a thread from it */
 	spinlock_acquire(&wc->wc_lock);
 	target = threadlist_remhead(&wc->wc_threads);
+	if (target != NULL) {
+		target->t_wchan = NULL;
+	}
 	/*
 	 * Nobody else can wake up this thread now, so we don't need
 	 * to hang onto the lock.
@@ -1070,6 +1585,7 @@ wchan_wakeall(struct wchan *wc)
 	 */
 	spinlock_acquire(&wc->wc_lock);
 	while ((target = threadlist_remhead(&wc->wc_threads)) != NULL) {
+		target->t_wchan = NULL;
 		threadlist_addtail(&list, target);
 	}
 	/*
@@ -1090,6 +1606,24 @@ wchan_wakeall(struct wchan *wc)
 	threadlist_cleanup(&list);
 }
 
+/*
+ * Wake up a specific thread if it is sleeping on a wait channel.
+ * The channel must be locked by the caller.
+ */
+bool
+wchan_wakethread(struct wchan *wc, struct thread *target)
+{
+	KASSERT(spinlock_do_i_hold(&wc->wc_lock));
+
+	if (target->t_wchan != wc) {
+		return false;
+	}
+	threadlist_remove(&wc->wc_threads, target);
+	target->t_wchan = NULL;
+	thread_make_runnable(target, false);
+	return true;
+}
+
 /*
  * Return nonzero if there are no threads sleeping on the channel.
  * This is meant to be used only for diagnostic purposes.
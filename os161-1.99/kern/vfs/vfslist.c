@@ -37,7 +37,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
-#include <array.h>
+#include <rcu.h>
 #include <synch.h>
 #include <vfs.h>
 #include <fs.h>
@@ -80,12 +80,33 @@ struct knowndev {
 	struct device *kd_device;
 	struct vnode *kd_vnode;
 	struct fs *kd_fs;
+	struct knowndev *kd_next;
 };
 
-DECLARRAY(knowndev);
-DEFARRAY(knowndev, /*no inline*/);
+/*
+ * The list of known devices, in the order they were added. Devices
+ * are never removed, so entries stay valid for good once reachable.
+ * The list is read with RCU (see rcu.h): new entries are filled in
+ * before being linked onto the end with rcu_assign, so code that
+ * doesn't sleep, like vfs_getdevname and findmount, can walk it with
+ * no lock. The names in an entry never change, and since entries are
+ * never freed a pointer found this way stays good after the walk.
+ */
+static struct knowndev *knowndevs;
+static struct knowndev **knowndevs_tail;	/* &last->kd_next */
+static unsigned knowndevs_num;
 
-static struct knowndevarray *knowndevs;
+/*
+ * Serializes changes to knowndevs and the kd_fs fields. Lookups that
+ * go on to call into the filesystem, and so may sleep, can't use RCU
+ * and instead hold this for reading, which keeps the filesystem from
+ * being unmounted under them; adding devices, mounting and unmounting
+ * take it for writing.
+ *
+ * Filesystem operations get the big lock themselves, so this lock
+ * comes first: never take it while holding vfs_biglock.
+ */
+static struct rwlock *knowndevs_lock;
 
 /* The big lock for all FS ops. Remove for filesystem assignment. */
 static struct lock *vfs_biglock;
@@ -98,9 +119,13 @@ static unsigned vfs_biglock_depth;
 void
 vfs_bootstrap(void)
 {
-	knowndevs = knowndevarray_create();
-	if (knowndevs==NULL) {
-		panic("vfs: Could not create knowndevs array\n");
+	knowndevs = NULL;
+	knowndevs_tail = &knowndevs;
+	knowndevs_num = 0;
+
+	knowndevs_lock = rwlock_create("knowndevs_lock");
+	if (knowndevs_lock==NULL) {
+		panic("vfs: Could not create knowndevs lock\n");
 	}
 
 	vfs_biglock = lock_create("vfs_biglock");
@@ -152,19 +177,16 @@ int
 vfs_sync(void)
 {
 	struct knowndev *dev;
-	unsigned i, num;
 
-	vfs_biglock_acquire();
+	rwlock_acquire_read(knowndevs_lock);
 
-	num = knowndevarray_num(knowndevs);
-	for (i=0; i<num; i++) {
-		dev = knowndevarray_get(knowndevs, i);
+	for (dev = knowndevs; dev != NULL; dev = dev->kd_next) {
 		if (dev->kd_fs != NULL) {
 			/*result =*/ FSOP_SYNC(dev->kd_fs);
 		}
 	}
 
-	vfs_biglock_release();
+	rwlock_release_read(knowndevs_lock);
 
 	return 0;
 }
@@ -177,13 +199,10 @@ int
 vfs_getroot(const char *devname, struct vnode **result)
 {
 	struct knowndev *kd;
-	unsigned i, num;
 
-	KASSERT(vfs_biglock_do_i_hold());
+	rwlock_acquire_read(knowndevs_lock);
 
-	num = knowndevarray_num(knowndevs);
-	for (i=0; i<num; i++) {
-		kd = knowndevarray_get(knowndevs, i);
+	for (kd = knowndevs; kd != NULL; kd = kd->kd_next) {
 
 		/*
 		 * If this device has a mounted filesystem, and
@@ -201,12 +220,14 @@ vfs_getroot(const char *devname, struct vnode **result)
 			if (!strcmp(kd->kd_name, devname) ||
 			    (volname!=NULL && !strcmp(volname, devname))) {
 				*result = FSOP_GETROOT(kd->kd_fs);
+				rwlock_release_read(knowndevs_lock);
 				return 0;
 			}
 		}
 		else {
 			if (kd->kd_rawname!=NULL &&
 			    !strcmp(kd->kd_name, devname)) {
+				rwlock_release_read(knowndevs_lock);
 				return ENXIO;
 			}
 		}
@@ -222,6 +243,7 @@ vfs_getroot(const char *devname, struct vnode **result)
 			KASSERT(kd->kd_device != NULL);
 			VOP_INCREF(kd->kd_vnode);
 			*result = kd->kd_vnode;
+			rwlock_release_read(knowndevs_lock);
 			return 0;
 		}
 
@@ -233,6 +255,7 @@ vfs_getroot(const char *devname, struct vnode **result)
 			KASSERT(kd->kd_device != NULL);
 			VOP_INCREF(kd->kd_vnode);
 			*result = kd->kd_vnode;
+			rwlock_release_read(knowndevs_lock);
 			return 0;
 		}
 
@@ -247,6 +270,7 @@ vfs_getroot(const char *devname, struct vnode **result)
 	 * If we got here, the device specified by devname doesn't exist.
 	 */
 
+	rwlock_release_read(knowndevs_lock);
 	return ENODEV;
 }
 
@@ -257,16 +281,13 @@ const char *
 vfs_getdevname(struct fs *fs)
 {
 	struct knowndev *kd;
-	unsigned i, num;
+	const char *name = NULL;
 
 	KASSERT(fs != NULL);
 
-	KASSERT(vfs_biglock_do_i_hold());
-
-	num = knowndevarray_num(knowndevs);
-	for (i=0; i<num; i++) {
-		kd = knowndevarray_get(knowndevs, i);
-
+	/* only compares pointers, so needs no lock */
+	rcu_read_lock();
+	for (kd = knowndevs; kd != NULL; kd = kd->kd_next) {
 		if (kd->kd_fs == fs) {
 			/*
 			 * This is not a race condition: as long as the
@@ -274,11 +295,13 @@ vfs_getdevname(struct fs *fs)
 			 * the fs cannot go away, and the device can't
 			 * go away until the fs goes away.
 			 */
-			return kd->kd_name;
+			name = kd->kd_name;
+			break;
 		}
 	}
+	rcu_read_unlock();
 
-	return NULL;
+	return name;
 }
 
 /*
@@ -335,15 +358,11 @@ int
 badnames(const char *n1, const char *n2, const char *n3)
 {
 	const char *volname;
-	unsigned i, num;
 	struct knowndev *kd;
 
-	KASSERT(vfs_biglock_do_i_hold());
-
-	num = knowndevarray_num(knowndevs);
-	for (i=0; i<num; i++) {
-		kd = knowndevarray_get(knowndevs, i);
+	KASSERT(rwlock_do_i_hold_write(knowndevs_lock));
 
+	for (kd = knowndevs; kd != NULL; kd = kd->kd_next) {
 		if (kd->kd_fs) {
 			volname = FSOP_GETVOLNAME(kd->kd_fs);
 			if (samestring3(volname, n1, n2, n3)) {
@@ -375,10 +394,8 @@ vfs_doadd(const char *dname, int mountable, struct device *dev, struct fs *fs)
 	struct knowndev *kd=NULL;
 	struct vnode *vnode=NULL;
 	const char *volname=NULL;
-	unsigned index;
-	int result;
 
-	vfs_biglock_acquire();
+	rwlock_acquire_write(knowndevs_lock);
 
 	name = kstrdup(dname);
 	if (name==NULL) {
@@ -406,25 +423,29 @@ vfs_doadd(const char *dname, int mountable, struct device *dev, struct fs *fs)
 	kd->kd_device = dev;
 	kd->kd_vnode = vnode;
 	kd->kd_fs = fs;
+	kd->kd_next = NULL;
 
 	if (fs!=NULL) {
 		volname = FSOP_GETVOLNAME(fs);
 	}
 
 	if (badnames(name, rawname, volname)) {
-		vfs_biglock_release();
+		rwlock_release_write(knowndevs_lock);
 		return EEXIST;
 	}
 
-	result = knowndevarray_add(knowndevs, kd, &index);
-
-	if (result == 0 && dev != NULL) {
-		/* use index+1 as the device number, so 0 is reserved */
-		dev->d_devnumber = index+1;
+	knowndevs_num++;
+	if (dev != NULL) {
+		/* number devices from 1, so 0 is reserved */
+		dev->d_devnumber = knowndevs_num;
 	}
 
-	vfs_biglock_release();
-	return result;
+	/* fully set up; now let readers see it */
+	rcu_assign(*knowndevs_tail, kd);
+	knowndevs_tail = &kd->kd_next;
+
+	rwlock_release_write(knowndevs_lock);
+	return 0;
 
  nomem:
 
@@ -441,7 +462,7 @@ vfs_doadd(const char *dname, int mountable, struct device *dev, struct fs *fs)
 		kfree(kd);
 	}
 	
-	vfs_biglock_release();
+	rwlock_release_write(knowndevs_lock);
 	return ENOMEM;
 }
 
@@ -469,22 +490,19 @@ vfs_addfs(const char *devname, struct fs *fs)
 //////////////////////////////////////////////////
 
 /*
- * Look for a mountable device named DEVNAME.
- * Should already hold knowndevs_lock.
+ * Look for a mountable device named DEVNAME. Only looks at the names,
+ * so needs no lock; whether it has a filesystem mounted is for the
+ * caller to check under knowndevs_lock.
  */
 static
 int
 findmount(const char *devname, struct knowndev **result)
 {
 	struct knowndev *dev;
-	unsigned i, num;
-	bool found = false;
+	int err = ENODEV;
 
-	KASSERT(vfs_biglock_do_i_hold());
-
-	num = knowndevarray_num(knowndevs);
-	for (i=0; !found && i<num; i++) {
-		dev = knowndevarray_get(knowndevs, i);
+	rcu_read_lock();
+	for (dev = knowndevs; dev != NULL; dev = dev->kd_next) {
 		if (dev->kd_rawname==NULL) {
 			/* not mountable/unmountable */
 			continue;
@@ -492,11 +510,13 @@ findmount(const char *devname, struct knowndev **result)
 
 		if (!strcmp(devname, dev->kd_name)) {
 			*result = dev;
-			found = true;
+			err = 0;
+			break;
 		}
 	}
+	rcu_read_unlock();
 
-	return found ? 0 : ENODEV;
+	return err;
 }
 
 /*
@@ -514,16 +534,15 @@ vfs_mount(const char *devname, void *data,
 	struct fs *fs;
 	int result;
 
-	vfs_biglock_acquire();
-
 	result = findmount(devname, &kd);
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
+	rwlock_acquire_write(knowndevs_lock);
+
 	if (kd->kd_fs != NULL) {
-		vfs_biglock_release();
+		rwlock_release_write(knowndevs_lock);
 		return EBUSY;
 	}
 	KASSERT(kd->kd_rawname != NULL);
@@ -531,7 +550,7 @@ vfs_mount(const char *devname, void *data,
 
 	result = mountfunc(data, kd->kd_device, &fs);
 	if (result) {
-		vfs_biglock_release();
+		rwlock_release_write(knowndevs_lock);
 		return result;
 	}
 
@@ -543,7 +562,7 @@ vfs_mount(const char *devname, void *data,
 	kprintf("vfs: Mounted %s: on %s\n",
 		volname ? volname : kd->kd_name, kd->kd_name);
 
-	vfs_biglock_release();
+	rwlock_release_write(knowndevs_lock);
 	return 0;
 }
 
@@ -557,13 +576,13 @@ vfs_unmount(const char *devname)
 	struct knowndev *kd;
 	int result;
 
-	vfs_biglock_acquire();
-
 	result = findmount(devname, &kd);
 	if (result) {
-		goto fail;
+		return result;
 	}
 
+	rwlock_acquire_write(knowndevs_lock);
+
 	if (kd->kd_fs == NULL) {
 		result = EINVAL;
 		goto fail;
@@ -589,7 +608,7 @@ vfs_unmount(const char *devname)
 	KASSERT(result==0);
 
  fail:
-	vfs_biglock_release();
+	rwlock_release_write(knowndevs_lock);
 	return result;
 }
 
@@ -600,14 +619,11 @@ int
 vfs_unmountall(void)
 {
 	struct knowndev *dev;
-	unsigned i, num;
 	int result;
 
-	vfs_biglock_acquire();
+	rwlock_acquire_write(knowndevs_lock);
 
-	num = knowndevarray_num(knowndevs);
-	for (i=0; i<num; i++) {
-		dev = knowndevarray_get(knowndevs, i);
+	for (dev = knowndevs; dev != NULL; dev = dev->kd_next) {
 		if (dev->kd_rawname == NULL) {
 			/* not mountable/unmountable */
 			continue;
@@ -650,7 +666,7 @@ vfs_unmountall(void)
 		dev->kd_fs = NULL;
 	}
 
-	vfs_biglock_release();
+	rwlock_release_write(knowndevs_lock);
 
 	return 0;
 }
@@ -43,7 +43,8 @@
 static struct vnode *bootfs_vnode = NULL;
 
 /*
- * Helper function for actually changing bootfs_vnode.
+ * Helper function for actually changing bootfs_vnode. bootfs_vnode is
+ * protected by vfs_biglock.
  */
 static
 void
@@ -51,6 +52,8 @@ change_bootfs(struct vnode *newvn)
 {
 	struct vnode *oldvn;
 
+	KASSERT(vfs_biglock_do_i_hold());
+
 	oldvn = bootfs_vnode;
 	bootfs_vnode = newvn;
 
@@ -75,14 +78,11 @@ vfs_setbootfs(const char *fsname)
 	int result;
 	struct vnode *newguy;
 
-	vfs_biglock_acquire();
-
 	snprintf(tmp, sizeof(tmp)-1, "%s", fsname);
 	s = strchr(tmp, ':');
 	if (s) {
 		/* If there's a colon, it must be at the end */
 		if (strlen(s)>0) {
-			vfs_biglock_release();
 			return EINVAL;
 		}
 	}
@@ -92,18 +92,17 @@ vfs_setbootfs(const char *fsname)
 
 	result = vfs_chdir(tmp);
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
 	result = vfs_getcurdir(&newguy);
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
+	/* not held across vfs_chdir, which takes the mount list lock */
+	vfs_biglock_acquire();
 	change_bootfs(newguy);
-
 	vfs_biglock_release();
 	return 0;
 }
@@ -123,6 +122,11 @@ vfs_clearbootfs(void)
 /*
  * Common code to pull the device name, if any, off the front of a
  * path and choose the vnode to begin the name lookup relative to.
+ *
+ * This doesn't need vfs_biglock except to look at bootfs_vnode:
+ * vfs_getroot locks the device list for reading, and the filesystems
+ * take the big lock themselves. So lookups only hold it while they
+ * are actually inside a filesystem.
  */
 
 static
@@ -133,8 +137,6 @@ getdevice(char *path, char **subpath, struct vnode **startvn)
 	struct vnode *vn;
 	int result;
 
-	KASSERT(vfs_biglock_do_i_hold());
-
 	/*
 	 * Locate the first colon or slash.
 	 */
@@ -188,11 +190,14 @@ getdevice(char *path, char **subpath, struct vnode **startvn)
 	KASSERT(colon==0 || slash==0);
 
 	if (path[0]=='/') {
+		vfs_biglock_acquire();
 		if (bootfs_vnode==NULL) {
+			vfs_biglock_release();
 			return ENOENT;
 		}
 		VOP_INCREF(bootfs_vnode);
 		*startvn = bootfs_vnode;
+		vfs_biglock_release();
 	}
 	else {
 		KASSERT(path[0]==':');
@@ -235,11 +240,8 @@ vfs_lookparent(char *path, struct vnode **retval,
 	struct vnode *startvn;
 	int result;
 
-	vfs_biglock_acquire();
-
 	result = getdevice(path, &path, &startvn);
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
@@ -257,7 +259,6 @@ vfs_lookparent(char *path, struct vnode **retval,
 
 	VOP_DECREF(startvn);
 
-	vfs_biglock_release();
 	return result;
 }
 
@@ -267,23 +268,18 @@ vfs_lookup(char *path, struct vnode **retval)
 	struct vnode *startvn;
 	int result;
 
-	vfs_biglock_acquire();
-
 	result = getdevice(path, &path, &startvn);
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
 	if (strlen(path)==0) {
 		*retval = startvn;
-		vfs_biglock_release();
 		return 0;
 	}
 
 	result = VOP_LOOKUP(startvn, path, retval);
 
 	VOP_DECREF(startvn);
-	vfs_biglock_release();
 	return result;
 }
@@ -33,6 +33,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <atomic.h>
 #include <synch.h>
 #include <vfs.h>
 #include <vnode.h>
@@ -77,23 +78,51 @@ vnode_cleanup(struct vnode *vn)
 /*
  * Increment refcount.
  * Called by VOP_INCREF.
+ *
+ * The caller already has a reference, or found the vnode in a table
+ * its filesystem protects with the big lock, so the count can't be
+ * going to zero underneath us and no lock is needed.
  */
 void
 vnode_incref(struct vnode *vn)
 {
 	KASSERT(vn != NULL);
 
-	vfs_biglock_acquire();
+	atomic_inc(&vn->vn_refcount);
+}
 
-	vn->vn_refcount++;
+/*
+ * Drop a reference if it isn't the last one. Returns true if it did,
+ * false (leaving the count at 1) if it is the last. Also used by
+ * VOP_RECLAIM implementations to give back the reference they were
+ * called with when someone has picked the vnode up again meanwhile.
+ */
+bool
+vnode_decref_unlesslast(struct vnode *vn)
+{
+	int old, seen;
 
-	vfs_biglock_release();
+	old = atomic_get(&vn->vn_refcount);
+	while (old > 1) {
+		seen = atomic_cas(&vn->vn_refcount, old, old - 1);
+		if (seen == old) {
+			return true;
+		}
+		old = seen;
+	}
+	KASSERT(old == 1);
+	return false;
 }
 
 /*
  * Decrement refcount.
  * Called by VOP_DECREF.
  * Calls VOP_RECLAIM if the refcount hits zero.
+ *
+ * Only the last reference needs the big lock, which is what
+ * serializes VOP_RECLAIM against filesystems handing the vnode out
+ * again. Since the count never goes below 1 outside the lock, there's
+ * no moment at which another decref could also think it's the last.
  */
 void
 vnode_decref(struct vnode *vn)
@@ -102,19 +131,18 @@ vnode_decref(struct vnode *vn)
 
 	KASSERT(vn != NULL);
 
+	if (vnode_decref_unlesslast(vn)) {
+		return;
+	}
+
 	vfs_biglock_acquire();
 
-	KASSERT(vn->vn_refcount>0);
-	if (vn->vn_refcount>1) {
-		vn->vn_refcount--;
-	}
-	else {
-		result = VOP_RECLAIM(vn);
-		if (result != 0 && result != EBUSY) {
-			// XXX: lame.
-			kprintf("vfs: Warning: VOP_RECLAIM: %s\n",
-				strerror(result));
-		}
+	/* VOP_RECLAIM checks again: it may have been picked up meanwhile */
+	result = VOP_RECLAIM(vn);
+	if (result != 0 && result != EBUSY) {
+		// XXX: lame.
+		kprintf("vfs: Warning: VOP_RECLAIM: %s\n",
+			strerror(result));
 	}
 
 	vfs_biglock_release();
@@ -30,6 +30,7 @@
 #include <types.h>
 #include <lib.h>
 #include <spinlock.h>
+#include <thread.h>
 #include <vm.h>
 
 /*
@@ -330,6 +331,16 @@ dumpsubpage(struct pageref *pr)
 	kprintf("\n");
 }
 
+/*
+ * Register the heap lock for spinlock statistics. Called once during
+ * boot; kmalloc works before this.
+ */
+void
+kheap_bootstrap(void)
+{
+	spinlock_register(&kmalloc_spinlock, "kmalloc");
+}
+
 void
 kheap_printstats(void)
 {
@@ -598,8 +609,9 @@ subpage_kfree(void *ptr)
 //
 ////////////////////////////////////////////////////////////
 
+static
 void *
-kmalloc(size_t sz)
+kmalloc_once(size_t sz)
 {
 	if (sz>=LARGEST_SUBPAGE_SIZE) {
 		unsigned long npages;
@@ -618,6 +630,19 @@ kmalloc(size_t sz)
 	return subpage_kmalloc(sz);
 }
 
+void *
+kmalloc(size_t sz)
+{
+	void *ptr;
+
+	ptr = kmalloc_once(sz);
+	if (ptr == NULL && thread_cache_reclaim() > 0) {
+		/* Cached threads gave some memory back; try again. */
+		ptr = kmalloc_once(sz);
+	}
+	return ptr;
+}
+
 void
 kfree(void *ptr)
 {
@@ -8,16 +8,21 @@
  * (i.e., outside of these routines) by acquiring stats_lock.
  * All of the functions whose names do not begin
  * with '_' ensure atomicity locally.
+ *
+ * The counters themselves are updated with atomic adds, so
+ * vmstats_inc doesn't need stats_lock; it is still used to keep
+ * vmstats_init from racing with itself.
  */
 
 #include <types.h>
 #include <lib.h>
 #include <synch.h>
 #include <spl.h>
+#include <atomic.h>
 #include <uw-vmstats.h>
 
 /* Counters for tracking statistics */
-static unsigned int stats_counts[VMSTAT_COUNT];
+static volatile int stats_counts[VMSTAT_COUNT];
 
 struct spinlock stats_lock = SPINLOCK_INITIALIZER;
 
@@ -41,9 +46,7 @@ static const char *stats_names[] = {
 void
 vmstats_inc(unsigned int index)
 {
-    spinlock_acquire(&stats_lock);
-      _vmstats_inc(index);
-    spinlock_release(&stats_lock);
+    _vmstats_inc(index);
 }
 
 /* ---------------------------------------------------------------------- */
@@ -65,7 +68,7 @@ void
 _vmstats_inc(unsigned int index)
 {
   KASSERT(index < VMSTAT_COUNT);
-  stats_counts[index]++;
+  atomic_inc(&stats_counts[index]);
 }
 
 /* ---------------------------------------------------------------------- */
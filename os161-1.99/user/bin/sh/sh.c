@@ -37,6 +37,9 @@
 
 #include <sys/types.h>
 #include <sys/wait.h>
+#ifndef HOST
+#include <sys/resource.h>
+#endif
 #include <assert.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -151,48 +154,72 @@ dowait(pid_t pid)
 	}
 }
 
-#ifdef WNOHANG
 /*
- * dowaitpoll
- * like dowait, but uses WNOHANG. returns true if we got something.
+ * forget_bg
+ * clears the slot for pid, if it's a background job.
  */
 static
-int
-dowaitpoll(pid_t pid)
+void
+forget_bg(pid_t pid)
 {
-	int status;
-	pid_t result;
-	result = waitpid(pid, &status, WNOHANG);
-	if (result<0) {
-		warn("pid %d", pid);
+	int i;
+	for (i = 0; i < MAXBG; i++) {
+		if (bgpids[i] == pid) {
+			bgpids[i] = 0;
+			return;
+		}
 	}
-	else if (result!=0) {
-		printf("pid %d: ", pid);
-		printstatus(status);
-		printf("\n");
-		return 1;
+}
+
+/*
+ * have_bg
+ * true if there are any background jobs.
+ */
+static
+int
+have_bg(void)
+{
+	int i;
+	for (i = 0; i < MAXBG; i++) {
+		if (bgpids[i] != 0) {
+			return 1;
+		}
 	}
 	return 0;
 }
 
 /*
- * waitpoll
- * poll all background jobs for having exited.
+ * reapbg
+ * collects background jobs as they exit, asking for whichever child
+ * is done rather than going through the jobs one by one. with
+ * WNOHANG, collects the ones that have already exited; without, waits
+ * for all of them.
  */
 static
 void
-waitpoll(void)
+reapbg(int options)
 {
-	int i;
-	for (i=0; i < MAXBG; i++) {
-		if (bgpids[i] != 0) {
-			if (dowaitpoll(bgpids[i])) {
-				bgpids[i] = 0;
+	int status;
+	pid_t pid;
+
+	while (have_bg()) {
+		pid = waitpid(WAIT_ANY, &status, options);
+		if (pid < 0) {
+			if (errno != ECHILD) {
+				warn("waitpid");
 			}
+			return;
+		}
+		if (pid == 0) {
+			/* WNOHANG, and nothing more has exited */
+			return;
 		}
+		forget_bg(pid);
+		printf("pid %d: ", pid);
+		printstatus(status);
+		printf("\n");
 	}
 }
-#endif /* WNOHANG */
 
 /*
  * wait
@@ -204,26 +231,16 @@ static
 int
 cmd_wait(int ac, char *av[])
 {
-	int i;
 	pid_t pid;
 
 	if (ac == 2) {
 		pid = atoi(av[1]);
 		dowait(pid);
-		for (i = 0; i < MAXBG; i++) {
-			if (bgpids[i]==pid) {
-				bgpids[i] = 0;
-			}
-		}
+		forget_bg(pid);
 		return 0;
 	}
 	else if (ac == 1) {
-		for (i=0; i < MAXBG; i++) {
-			if (bgpids[i] != 0) {
-				dowait(bgpids[i]);
-				bgpids[i] = 0;
-			}
-		}
+		reapbg(0);
 		return 0;
 	}
 	printf("Usage: wait [pid]\n");
@@ -277,6 +294,77 @@ cmd_exit(int ac, char *av[])
 	return 0; /* quell the compiler warning */
 }
 
+#ifndef HOST
+static int runcommand(int nargs, char *args[]);
+
+/*
+ * tvsub
+ * returns b - a, in microseconds.
+ */
+static
+unsigned long long
+tvsub(const struct timeval *a, const struct timeval *b)
+{
+	return (b->tv_sec - a->tv_sec) * 1000000ULL + b->tv_usec - a->tv_usec;
+}
+
+/*
+ * time
+ * runs a command and reports what it cost: the elapsed time, and the
+ * resources used by the child processes the shell collected meanwhile.
+ */
+static
+int
+cmd_time(int ac, char *av[])
+{
+	struct rusage before, after;
+	time_t startsecs, endsecs;
+	unsigned long startnsecs, endnsecs;
+	unsigned long long us;
+	int status;
+
+	if (ac < 2) {
+		printf("Usage: time command [args...]\n");
+		return 1;
+	}
+	if (getrusage(RUSAGE_CHILDREN, &before) < 0) {
+		warn("getrusage");
+		return 1;
+	}
+	__time(&startsecs, &startnsecs);
+
+	status = runcommand(ac - 1, av + 1);
+
+	__time(&endsecs, &endnsecs);
+	if (getrusage(RUSAGE_CHILDREN, &after) < 0) {
+		warn("getrusage");
+		return status;
+	}
+
+	if (endnsecs < startnsecs) {
+		endnsecs += 1000000000;
+		endsecs--;
+	}
+	us = (endsecs - startsecs) * 1000000ULL + (endnsecs - startnsecs) / 1000;
+	printf("real %llu.%06llu", us / 1000000, us % 1000000);
+	us = tvsub(&before.ru_utime, &after.ru_utime);
+	printf("  user %llu.%06llu", us / 1000000, us % 1000000);
+	us = tvsub(&before.ru_stime, &after.ru_stime);
+	printf("  sys %llu.%06llu", us / 1000000, us % 1000000);
+	us = tvsub(&before.ru_wtime, &after.ru_wtime);
+	printf("  runnable %llu.%06llu\n", us / 1000000, us % 1000000);
+	printf("faults %llu  switches %llu voluntary, %llu involuntary\n",
+	       after.ru_minflt - before.ru_minflt,
+	       after.ru_nvcsw - before.ru_nvcsw,
+	       after.ru_nivcsw - before.ru_nivcsw);
+	printf("bytes in %llu, out %llu\n",
+	       after.ru_inbytes - before.ru_inbytes,
+	       after.ru_outbytes - before.ru_outbytes);
+
+	return status;
+}
+#endif /* HOST */
+
 /*
  * a struct of the builtins associates the builtin name with the function that
  * executes it.  they must all take an argc and argv.
@@ -288,47 +376,31 @@ static struct {
 	{ "cd",    cmd_chdir },
 	{ "chdir", cmd_chdir },
 	{ "exit",  cmd_exit },
+#ifndef HOST
+	{ "time",  cmd_time },
+#endif
 	{ "wait",  cmd_wait },
 	{ NULL, NULL }
 };
 
 /*
- * docommand
- * tokenizes the command line using strtok.  if there aren't any commands,
- * simply returns.  checks to see if it's a builtin, running it if it is.
- * otherwise, it's a standard command.  check for the '&', try to background
- * the job if possible, otherwise just run it and wait on it.
+ * runcommand
+ * runs a command that has been split into words.  checks to see if it's a
+ * builtin, running it if it is.  otherwise, it's a standard command.  check
+ * for the '&', try to background the job if possible, otherwise just run it
+ * and wait on it.
  */
 static
 int
-docommand(char *buf)
+runcommand(int nargs, char *args[])
 {
-	char *args[NARG_MAX + 1];
-	int nargs, i;
-	char *s;
+	int i;
 	pid_t pid;
 	int status;
 	int bg=0;
 	time_t startsecs, endsecs;
 	unsigned long startnsecs, endnsecs;
 
-	nargs = 0;
-	for (s = strtok(buf, " \t\r\n"); s; s = strtok(NULL, " \t\r\n")) {
-		if (nargs >= NARG_MAX) {
-			printf("%s: Too many arguments "
-			       "(exceeds system limit)\n",
-			       args[0]);
-			return 1;
-		}
-		args[nargs++] = s;
-	}
-	args[nargs] = NULL;
-
-	if (nargs==0) {
-		/* empty line */
-		return 0;
-	}
-
 	for (i=0; builtins[i].name; i++) {
 		if (!strcmp(builtins[i].name, args[0])) {
 			return builtins[i].func(nargs, args);
@@ -354,6 +426,14 @@ docommand(char *buf)
 		__time(&startsecs, &startnsecs);
 	}
 
+#ifndef HOST
+	/* build the child straight from the program, without copying us */
+	pid = spawn(args[0], args, NULL, 0);
+	if (pid < 0) {
+		warn("%s", args[0]);
+		return _MKWAIT_EXIT(255);
+	}
+#else
 	pid = fork();
 	switch (pid) {
 		case -1:
@@ -375,6 +455,7 @@ docommand(char *buf)
 		default:
 			break;
 	}
+#endif
 
 	/* parent */
 	if (bg) {
@@ -404,6 +485,39 @@ docommand(char *buf)
 	return status;
 }
 
+/*
+ * docommand
+ * tokenizes the command line using strtok.  if there aren't any commands,
+ * simply returns.  otherwise runs it.
+ */
+static
+int
+docommand(char *buf)
+{
+	char *args[NARG_MAX + 1];
+	int nargs;
+	char *s;
+
+	nargs = 0;
+	for (s = strtok(buf, " \t\r\n"); s; s = strtok(NULL, " \t\r\n")) {
+		if (nargs >= NARG_MAX) {
+			printf("%s: Too many arguments "
+			       "(exceeds system limit)\n",
+			       args[0]);
+			return 1;
+		}
+		args[nargs++] = s;
+	}
+	args[nargs] = NULL;
+
+	if (nargs==0) {
+		/* empty line */
+		return 0;
+	}
+
+	return runcommand(nargs, args);
+}
+
 /*
  * getcmd
  * pulls valid characters off the console, filling the buffer.  
@@ -471,9 +585,8 @@ interactive(void)
 			printstatus(status);
 			printf("\n");
 		}
-#ifdef WNOHANG
-		waitpoll();
-#endif
+		/* collect any background jobs that have finished */
+		reapbg(WNOHANG);
 	}
 }
 
@@ -0,0 +1,36 @@
+#ifndef _MUTEX_H_
+#define _MUTEX_H_
+
+/*
+ * Mutexes and condition variables for user threads, built on
+ * futex(). Neither needs to be destroyed, and both can be set up with
+ * the initializers instead of the init functions.
+ *
+ * Taking a free mutex and releasing one nobody is waiting for don't
+ * make any system calls; nor does signalling a condition variable
+ * nobody is waiting on.
+ */
+
+struct mutex {
+	volatile int m_state;	/* 0 free, 1 held, 2 held with waiters */
+};
+
+struct cond {
+	volatile int c_seq;	/* bumped by every signal/broadcast */
+	volatile int c_waiters;
+};
+
+#define MUTEX_INITIALIZER	{ 0 }
+#define COND_INITIALIZER	{ 0, 0 }
+
+void mutex_init(struct mutex *m);
+void mutex_lock(struct mutex *m);
+int mutex_trylock(struct mutex *m);	/* 0 on success, -1 if held */
+void mutex_unlock(struct mutex *m);
+
+void cond_init(struct cond *c);
+void cond_wait(struct cond *c, struct mutex *m);
+void cond_signal(struct cond *c);
+void cond_broadcast(struct cond *c);
+
+#endif /* _MUTEX_H_ */
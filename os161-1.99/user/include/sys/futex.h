@@ -0,0 +1,11 @@
+#ifndef _SYS_FUTEX_H_
+#define _SYS_FUTEX_H_
+
+/*
+ * Get the FUTEX_* operations from the kernel.
+ */
+#include <kern/futex.h>
+
+int futex(int *addr, int op, int val);
+
+#endif /* _SYS_FUTEX_H_ */
@@ -0,0 +1,10 @@
+#ifndef _SYS_SPAWN_H_
+#define _SYS_SPAWN_H_
+
+/*
+ * Descriptor actions for spawn(); see <unistd.h> for the call.
+ */
+#include <sys/types.h>
+#include <kern/spawn.h>
+
+#endif /* _SYS_SPAWN_H_ */
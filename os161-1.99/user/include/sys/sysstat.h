@@ -0,0 +1,12 @@
+#ifndef _SYS_SYSSTAT_H_
+#define _SYS_SYSSTAT_H_
+
+/*
+ * Get struct sysstat from the kernel.
+ */
+#include <sys/types.h>
+#include <kern/sysstat.h>
+
+int __sysstat(int callno, struct sysstat *stat);
+
+#endif /* _SYS_SYSSTAT_H_ */
@@ -127,6 +127,8 @@ int waitpid(pid_t pid, int *returncode, int flags);
 int open(const char *filename, int flags, ...);
 int read(int filehandle, void *buf, size_t size);
 int write(int filehandle, const void *buf, size_t size);
+ssize_t pread(int filehandle, void *buf, size_t size, off_t pos);
+ssize_t pwrite(int filehandle, const void *buf, size_t size, off_t pos);
 int close(int filehandle);
 int reboot(int code);
 int sync(void);
@@ -153,7 +155,16 @@ int readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
 time_t __time(time_t *seconds, unsigned long *nanoseconds);
+int nanosleep(const struct timespec *req, struct timespec *rem);
 int __getcwd(char *buf, size_t buflen);
+int setshare(pid_t pid, int tickets);
+int __thread_create(void (*start)(void (*)(void *), void *),
+		    void (*func)(void *), void *arg);
+__DEAD void thread_exit(int status);
+int thread_join(int tid, int *status);
+struct spawn_fdaction;	/* see sys/spawn.h */
+pid_t spawn(const char *prog, char *const *args,
+	    const struct spawn_fdaction *actions, int nactions);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
 
@@ -163,5 +174,6 @@ int __getcwd(char *buf, size_t buflen);
 
 char *getcwd(char *buf, size_t buflen);		/* calls __getcwd */
 time_t time(time_t *seconds);			/* calls __time */
+int thread_create(void (*func)(void *), void *arg); /* calls __thread_create */
 
 #endif /* _UNISTD_H_ */
@@ -0,0 +1,237 @@
+/*
+ * Mutexes and condition variables for user threads. See mutex.h.
+ *
+ * The mutex is the three-state one from Drepper's "Futexes Are
+ * Tricky": 0 is free, 1 is held, and 2 is held with (possibly)
+ * somebody asleep on it. Lock and unlock only go to the kernel when
+ * they find it in state 2, or have to put it there.
+ *
+ * A condition variable is a sequence number. A waiter notes it,
+ * drops the mutex, and sleeps as long as it hasn't changed; signal
+ * and broadcast change it and wake one or all. c_waiters lets them
+ * skip the system call when there's nobody to wake.
+ */
+
+#include <sys/futex.h>
+#include <errno.h>
+#include <mutex.h>
+
+/*
+ * Atomic operations, as LL/SC. Each _once function makes one attempt
+ * and returns 0 if the SC failed; the callers loop. (Looping in C
+ * keeps branches, and their delay slots, out of the asm.)
+ */
+
+static
+int
+cas_once(volatile int *p, int old, int new, int *seen)
+{
+	int x, y, t;
+
+	/*
+	 * Store NEW if the word is OLD; otherwise store back what was
+	 * there, which changes nothing. Computed without branches:
+	 * T is all ones if the word matched and zero if it didn't.
+	 */
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		"ll %0, 0(%3);"		/*   x = *p */
+		"xor %2, %0, %4;"	/*   t = x ^ old */
+		"sltiu %2, %2, 1;"	/*   t = (x == old) */
+		"subu %2, $0, %2;"	/*   t = -t */
+		"xor %1, %5, %0;"	/*   y = new ^ x */
+		"and %1, %1, %2;"	/*   y &= t */
+		"xor %1, %1, %0;"	/*   y ^= x: new or x */
+		"sc %1, 0(%3);"		/*   *p = y; y = success? */
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y), "=&r" (t)
+		: "r" (p), "r" (old), "r" (new)
+		: "memory");
+	*seen = x;
+	return y != 0;
+}
+
+static
+int
+swap_once(volatile int *p, int new, int *seen)
+{
+	int x, y;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		"ll %0, 0(%2);"		/*   x = *p */
+		"move %1, %3;"		/*   y = new */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y)
+		: "r" (p), "r" (new)
+		: "memory");
+	*seen = x;
+	return y != 0;
+}
+
+static
+int
+add_once(volatile int *p, int inc, int *seen)
+{
+	int x, y;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		"ll %0, 0(%2);"		/*   x = *p */
+		"addu %1, %0, %3;"	/*   y = x + inc */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y)
+		: "r" (p), "r" (inc)
+		: "memory");
+	*seen = x;
+	return y != 0;
+}
+
+/* Each of these returns the old value. */
+
+static
+int
+atomic_cas(volatile int *p, int old, int new)
+{
+	int seen;
+
+	while (!cas_once(p, old, new, &seen)) {
+		/* retry */
+	}
+	return seen;
+}
+
+static
+int
+atomic_swap(volatile int *p, int new)
+{
+	int seen;
+
+	while (!swap_once(p, new, &seen)) {
+		/* retry */
+	}
+	return seen;
+}
+
+static
+int
+atomic_add(volatile int *p, int inc)
+{
+	int seen;
+
+	while (!add_once(p, inc, &seen)) {
+		/* retry */
+	}
+	return seen;
+}
+
+////////////////////////////////////////////////////////////
+
+void
+mutex_init(struct mutex *m)
+{
+	m->m_state = 0;
+}
+
+/*
+ * Take the mutex the slow way, marking it contended. Also used when
+ * coming back from a condition variable, since whoever woke us may
+ * have left others asleep on the mutex.
+ */
+static
+void
+mutex_lock_contended(struct mutex *m, int c)
+{
+	if (c != 2) {
+		c = atomic_swap(&m->m_state, 2);
+	}
+	while (c != 0) {
+		/* EAGAIN just means it changed; look again */
+		futex((int *)&m->m_state, FUTEX_WAIT, 2);
+		c = atomic_swap(&m->m_state, 2);
+	}
+}
+
+void
+mutex_lock(struct mutex *m)
+{
+	int c;
+
+	c = atomic_cas(&m->m_state, 0, 1);
+	if (c != 0) {
+		mutex_lock_contended(m, c);
+	}
+}
+
+int
+mutex_trylock(struct mutex *m)
+{
+	if (atomic_cas(&m->m_state, 0, 1) != 0) {
+		errno = EBUSY;
+		return -1;
+	}
+	return 0;
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+	if (atomic_add(&m->m_state, -1) != 1) {
+		/* it was 2: somebody may be asleep */
+		m->m_state = 0;
+		futex((int *)&m->m_state, FUTEX_WAKE, 1);
+	}
+}
+
+////////////////////////////////////////////////////////////
+
+void
+cond_init(struct cond *c)
+{
+	c->c_seq = 0;
+	c->c_waiters = 0;
+}
+
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+	int seq;
+
+	/* both before letting go, so a signaller holding M sees them */
+	seq = c->c_seq;
+	atomic_add(&c->c_waiters, 1);
+
+	mutex_unlock(m);
+	futex((int *)&c->c_seq, FUTEX_WAIT, seq);
+	atomic_add(&c->c_waiters, -1);
+
+	mutex_lock_contended(m, 1);
+}
+
+void
+cond_signal(struct cond *c)
+{
+	if (c->c_waiters == 0) {
+		return;
+	}
+	atomic_add(&c->c_seq, 1);
+	futex((int *)&c->c_seq, FUTEX_WAKE, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+	if (c->c_waiters == 0) {
+		return;
+	}
+	atomic_add(&c->c_seq, 1);
+	futex((int *)&c->c_seq, FUTEX_WAKE, c->c_waiters);
+}
@@ -0,0 +1,139 @@
+/*
+ * fdtest - check that descriptors share open files the way they should.
+ *
+ * Descriptors made by dup2 and inherited across fork refer to the same
+ * open file, so they share one seek position; two separate opens of
+ * the same file don't. pread and pwrite work at a given position and
+ * leave the seek position alone; readv and writev move a scattered
+ * record in one call. Also checks lseek, fstat, close and the usual
+ * bad-descriptor errors.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/uio.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <err.h>
+
+#define TESTFILE	"fdtest.tmp"
+
+static int failures;
+
+static
+void
+check(int ok, const char *what)
+{
+	if (!ok) {
+		printf("fdtest: %s\n", what);
+		failures++;
+	}
+}
+
+static
+void
+writestr(int fd, const char *s)
+{
+	if (write(fd, s, strlen(s)) != (ssize_t)strlen(s)) {
+		err(1, "write");
+	}
+}
+
+int
+main(void)
+{
+	char buf[16], hdr[4], body[8];
+	struct iovec iov[2];
+	struct stat st;
+	pid_t pid;
+	int fd, fd2, status;
+
+	fd = open(TESTFILE, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", TESTFILE);
+	}
+	check(fd > STDERR_FILENO, "open reused a standard descriptor");
+
+	/* a forked child advances the parent's offset */
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		writestr(fd, "child");
+		_exit(0);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	check(lseek(fd, 0, SEEK_CUR) == 5, "fork did not share the offset");
+
+	/* so does a dup */
+	fd2 = 20;
+	check(dup2(fd, fd2) == fd2, "dup2 returned the wrong descriptor");
+	writestr(fd2, "dup");
+	check(lseek(fd, 0, SEEK_CUR) == 8, "dup2 did not share the offset");
+	check(close(fd2) == 0, "close of the dup failed");
+	check(lseek(fd, 0, SEEK_END) == 8, "SEEK_END is wrong");
+
+	/* but a second open has its own */
+	fd2 = open(TESTFILE, O_RDONLY);
+	if (fd2 < 0) {
+		err(1, "%s", TESTFILE);
+	}
+	check(read(fd2, buf, 5) == 5 && memcmp(buf, "child", 5) == 0,
+	      "second open did not start at 0");
+	check(lseek(fd, 0, SEEK_CUR) == 8, "second open moved the first");
+	check(write(fd2, "x", 1) < 0 && errno == EBADF,
+	      "write to a read-only descriptor");
+	close(fd2);
+
+	/* positional I/O doesn't move the offset */
+	check(pwrite(fd, "CH", 2, 0) == 2, "pwrite failed");
+	check(pread(fd, buf, 5, 0) == 5 && memcmp(buf, "CHild", 5) == 0,
+	      "pread did not see pwrite's data");
+	check(lseek(fd, 0, SEEK_CUR) == 8, "pread/pwrite moved the offset");
+	check(pread(fd, buf, 1, -1) < 0 && errno == EINVAL,
+	      "pread at a negative offset");
+	check(pwrite(STDOUT_FILENO, "x", 1, 0) < 0 && errno == ESPIPE,
+	      "pwrite to the console allowed");
+
+	/* a scattered record goes out and comes back in one call each */
+	iov[0].iov_base = (void *)"HDR:";
+	iov[0].iov_len = 4;
+	iov[1].iov_base = (void *)"12345678";
+	iov[1].iov_len = 8;
+	check(writev(fd, iov, 2) == 12, "writev failed");
+	check(lseek(fd, 0, SEEK_CUR) == 20, "writev did not advance");
+	iov[0].iov_base = hdr;
+	iov[1].iov_base = body;
+	check(lseek(fd, 8, SEEK_SET) == 8, "lseek failed");
+	check(readv(fd, iov, 2) == 12 && memcmp(hdr, "HDR:", 4) == 0 &&
+	      memcmp(body, "12345678", 8) == 0, "readv got the wrong data");
+	check(readv(fd, iov, 0) < 0 && errno == EINVAL, "readv of nothing");
+
+	check(fstat(fd, &st) == 0 && st.st_size == 20, "fstat size is wrong");
+	check(lseek(fd, -1, SEEK_SET) < 0 && errno == EINVAL,
+	      "negative seek allowed");
+	check(lseek(STDOUT_FILENO, 0, SEEK_SET) < 0 && errno == ESPIPE,
+	      "seek on the console allowed");
+
+	close(fd);
+	check(read(fd, buf, 1) < 0 && errno == EBADF, "read after close");
+	check(close(fd) < 0 && errno == EBADF, "double close");
+	check(dup2(STDOUT_FILENO, OPEN_MAX) < 0 && errno == EBADF,
+	      "dup2 past OPEN_MAX");
+	check(remove(TESTFILE) == 0, "remove failed");
+
+	if (failures > 0) {
+		printf("fdtest: FAILED\n");
+		return 1;
+	}
+	printf("fdtest: passed\n");
+	return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * futextest - exercise the futex-based mutexes and condition
+ * variables in libc with several threads.
+ *
+ * First each thread bumps a shared counter many times under a mutex,
+ * with a short critical section so the lock is often contended; the
+ * total has to come out exact. Then a producer and several consumers
+ * pass items through a small bounded buffer guarded by a mutex and
+ * two condition variables, and every item has to arrive exactly once.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <err.h>
+#include <mutex.h>
+
+#define NTHREADS	4
+#define NINCS		20000
+
+#define NCONSUMERS	3
+#define NITEMS		3000
+#define BUFSIZE		4
+
+static struct mutex countlock = MUTEX_INITIALIZER;
+static volatile int count;
+
+static struct mutex buflock = MUTEX_INITIALIZER;
+static struct cond notempty = COND_INITIALIZER;
+static struct cond notfull = COND_INITIALIZER;
+static int buf[BUFSIZE];
+static int bufhead, buflen;
+static int seen[NITEMS];
+static int done;
+
+static
+void
+counter(void *arg)
+{
+	int i;
+
+	(void)arg;
+	for (i=0; i<NINCS; i++) {
+		mutex_lock(&countlock);
+		count = count + 1;
+		mutex_unlock(&countlock);
+	}
+}
+
+static
+void
+consumer(void *arg)
+{
+	int item;
+
+	(void)arg;
+	mutex_lock(&buflock);
+	while (1) {
+		while (buflen == 0 && !done) {
+			cond_wait(&notempty, &buflock);
+		}
+		if (buflen == 0) {
+			break;
+		}
+		item = buf[bufhead];
+		bufhead = (bufhead + 1) % BUFSIZE;
+		buflen--;
+		seen[item]++;
+		cond_signal(&notfull);
+	}
+	mutex_unlock(&buflock);
+}
+
+static
+void
+runthreads(void (*func)(void *), int n, int *tids)
+{
+	int i;
+
+	for (i=0; i<n; i++) {
+		tids[i] = thread_create(func, NULL);
+		if (tids[i] < 0) {
+			err(1, "thread_create");
+		}
+	}
+}
+
+static
+void
+jointhreads(int n, int *tids)
+{
+	int i;
+
+	for (i=0; i<n; i++) {
+		if (thread_join(tids[i], NULL) < 0) {
+			err(1, "thread_join");
+		}
+	}
+}
+
+int
+main(void)
+{
+	int tids[NTHREADS > NCONSUMERS ? NTHREADS : NCONSUMERS];
+	int i, failures = 0;
+
+	runthreads(counter, NTHREADS, tids);
+	jointhreads(NTHREADS, tids);
+	if (count != NTHREADS * NINCS) {
+		printf("futextest: mutex: count is %d, expected %d\n",
+		       count, NTHREADS * NINCS);
+		failures++;
+	}
+
+	runthreads(consumer, NCONSUMERS, tids);
+	for (i=0; i<NITEMS; i++) {
+		mutex_lock(&buflock);
+		while (buflen == BUFSIZE) {
+			cond_wait(&notfull, &buflock);
+		}
+		buf[(bufhead + buflen) % BUFSIZE] = i;
+		buflen++;
+		cond_signal(&notempty);
+		mutex_unlock(&buflock);
+	}
+	mutex_lock(&buflock);
+	done = 1;
+	cond_broadcast(&notempty);
+	mutex_unlock(&buflock);
+	jointhreads(NCONSUMERS, tids);
+
+	for (i=0; i<NITEMS; i++) {
+		if (seen[i] != 1) {
+			printf("futextest: cond: item %d seen %d times\n",
+			       i, seen[i]);
+			failures++;
+		}
+	}
+
+	if (failures > 0) {
+		printf("futextest: FAILED\n");
+		return 1;
+	}
+	printf("futextest: passed\n");
+	return 0;
+}
@@ -0,0 +1,109 @@
+/*
+ * rusagetest - check per-process resource usage accounting.
+ *
+ * A child spins for a while and writes a known number of bytes, then
+ * exits. Before the parent waits for it, RUSAGE_CHILDREN must not
+ * include it; afterwards it must show at least the child's CPU time
+ * and bytes written, and the child's writes must not have been
+ * charged to the parent.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <err.h>
+
+#define SPIN_SECS	2
+#define NWRITES		16
+
+static
+unsigned long long
+cpu_us(const struct rusage *ru)
+{
+	return (ru->ru_utime.tv_sec + ru->ru_stime.tv_sec) * 1000000ULL
+		+ ru->ru_utime.tv_usec + ru->ru_stime.tv_usec;
+}
+
+static
+void
+getusage(int who, struct rusage *ru)
+{
+	if (getrusage(who, ru) < 0) {
+		err(1, "getrusage");
+	}
+}
+
+int
+main(void)
+{
+	static const char line[] = "rusagetest: child writing\n";
+	struct rusage self0, self1, kids0, kids1, kids2;
+	time_t start;
+	pid_t pid;
+	int i, status, failures = 0;
+
+	getusage(RUSAGE_SELF, &self0);
+	getusage(RUSAGE_CHILDREN, &kids0);
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		start = time(NULL);
+		while (time(NULL) < start + SPIN_SECS) {
+			/* burn */
+		}
+		for (i=0; i<NWRITES; i++) {
+			write(STDOUT_FILENO, line, strlen(line));
+		}
+		_exit(0);
+	}
+
+	/* let it finish, but don't collect it yet */
+	start = time(NULL);
+	while (time(NULL) < start + SPIN_SECS + 1) {
+		/* wait */
+	}
+	getusage(RUSAGE_CHILDREN, &kids1);
+	if (cpu_us(&kids1) != cpu_us(&kids0)) {
+		printf("rusagetest: children's usage grew before waitpid\n");
+		failures++;
+	}
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	getusage(RUSAGE_SELF, &self1);
+	getusage(RUSAGE_CHILDREN, &kids2);
+
+	if (cpu_us(&kids2) - cpu_us(&kids0) < 1000000ULL) {
+		printf("rusagetest: child's cpu time %llu us, expected "
+		       "at least a second\n", cpu_us(&kids2) - cpu_us(&kids0));
+		failures++;
+	}
+	if (kids2.ru_outbytes - kids0.ru_outbytes < NWRITES * strlen(line)) {
+		printf("rusagetest: child wrote %llu bytes, expected %u\n",
+		       kids2.ru_outbytes - kids0.ru_outbytes,
+		       NWRITES * strlen(line));
+		failures++;
+	}
+	if (kids2.ru_minflt == kids0.ru_minflt) {
+		printf("rusagetest: child took no vm faults\n");
+		failures++;
+	}
+	if (self1.ru_outbytes != self0.ru_outbytes) {
+		printf("rusagetest: child's writes charged to the parent\n");
+		failures++;
+	}
+
+	if (failures > 0) {
+		printf("rusagetest: FAILED\n");
+		return 1;
+	}
+	printf("rusagetest: passed\n");
+	return 0;
+}
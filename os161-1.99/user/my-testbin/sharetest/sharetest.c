@@ -0,0 +1,119 @@
+/*
+ * sharetest - check that the stride scheduler divides the CPU
+ * according to setshare().
+ *
+ * Forks several CPU-bound children and gives them different shares by
+ * pid. Each child waits for a common start time, then spins for a fixed wall-clock
+ * window and measures with getrusage how much CPU it got during it.
+ * It exits with that as a percentage of the window, and the parent
+ * compares the percentages against the shares.
+ *
+ * The numbers only mean something on a single-CPU machine, and with
+ * nothing else busy.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <err.h>
+
+#define NCHILDREN	3
+#define SETTLE_SECS	1	/* let everyone get going first */
+#define WINDOW_SECS	5	/* how long to measure */
+#define TOLERANCE	4	/* allowed error, in percentage points */
+
+static const int shares[NCHILDREN] = { 100, 200, 400 };
+
+static
+unsigned
+cputime_ms(void)
+{
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_SELF, &ru) < 0) {
+		err(1, "getrusage");
+	}
+	return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000
+		+ (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000;
+}
+
+static
+void
+spinuntil(time_t when)
+{
+	while (time(NULL) < when) {
+		/* burn */
+	}
+}
+
+static
+void
+child(time_t start)
+{
+	unsigned before, after;
+
+	spinuntil(start);
+	before = cputime_ms();
+	spinuntil(start + WINDOW_SECS);
+	after = cputime_ms();
+
+	_exit((after - before) / (WINDOW_SECS * 10));
+}
+
+int
+main(void)
+{
+	pid_t pids[NCHILDREN];
+	time_t start;
+	int i, status, got, want, total, failures;
+
+	start = time(NULL) + SETTLE_SECS + 1;
+
+	total = 0;
+	for (i=0; i<NCHILDREN; i++) {
+		total += shares[i];
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			err(1, "fork");
+		}
+		if (pids[i] == 0) {
+			child(start);
+		}
+		if (setshare(pids[i], shares[i]) < 0) {
+			err(1, "setshare %d", pids[i]);
+		}
+	}
+
+	failures = 0;
+	for (i=0; i<NCHILDREN; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+		if (!WIFEXITED(status)) {
+			errx(1, "child %d did not exit normally", i);
+		}
+		got = WEXITSTATUS(status);
+		want = shares[i] * 100 / total;
+		printf("sharetest: share %d: got %d%% of the cpu, "
+		       "expected %d%%\n", shares[i], got, want);
+		if (got < want - TOLERANCE || got > want + TOLERANCE) {
+			failures++;
+		}
+	}
+
+	/* they've all been collected now */
+	if (setshare(pids[0], shares[0]) >= 0 || errno != ESRCH) {
+		printf("sharetest: setshare on a dead pid: expected ESRCH\n");
+		failures++;
+	}
+
+	if (failures > 0) {
+		printf("sharetest: FAILED\n");
+		return 1;
+	}
+	printf("sharetest: passed\n");
+	return 0;
+}
@@ -0,0 +1,203 @@
+/*
+ * spawnbench - compare the cost of starting a program with fork and
+ * execv against spawn.
+ *
+ * Runs /bin/true the given number of times (default 20) each way,
+ * waiting for each one before starting the next, and prints the
+ * average time from starting the child to collecting it.
+ *
+ * First checks that spawn's descriptor actions work, by running
+ * /bin/cat with its input and output redirected to files, and that a
+ * failing action means no child.
+ *
+ * Under dumbvm, memory given back by exiting processes is not reused,
+ * so don't ask for too many rounds.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/spawn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <err.h>
+
+#define PROG		"/bin/true"
+#define CATPROG		"/bin/cat"
+#define INFILE		"spawnbench.in"
+#define OUTFILE		"spawnbench.out"
+#define MESSAGE		"spawnbench redirect\n"
+#define DEFROUNDS	20
+
+static char *progargv[2] = { (char *)"true", NULL };
+static char *catargv[2] = { (char *)"cat", NULL };
+
+static
+void
+now(time_t *secs, unsigned long *nsecs)
+{
+	if (__time(secs, nsecs) == -1) {
+		err(1, "__time");
+	}
+}
+
+/* microseconds since START */
+static
+unsigned long
+since(time_t startsecs, unsigned long startnsecs)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	now(&secs, &nsecs);
+	return (secs - startsecs) * 1000000 + nsecs / 1000 - startnsecs / 1000;
+}
+
+static
+void
+collect(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "%s: bad status %d", PROG, status);
+	}
+}
+
+static
+void
+checkredirect(void)
+{
+	struct spawn_fdaction acts[3];
+	char buf[64];
+	pid_t pid;
+	int fd, status;
+	ssize_t len;
+
+	fd = open(INFILE, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", INFILE);
+	}
+	if (write(fd, MESSAGE, strlen(MESSAGE)) != (ssize_t)strlen(MESSAGE)) {
+		err(1, "%s: write", INFILE);
+	}
+	close(fd);
+
+	/* cat < INFILE > OUTFILE, with stderr closed for good measure */
+	acts[0].sfa_op = SPAWN_FDOPEN;
+	acts[0].sfa_fd = STDIN_FILENO;
+	acts[0].sfa_path = INFILE;
+	acts[0].sfa_flags = O_RDONLY;
+	acts[0].sfa_mode = 0;
+	acts[1].sfa_op = SPAWN_FDOPEN;
+	acts[1].sfa_fd = STDOUT_FILENO;
+	acts[1].sfa_path = OUTFILE;
+	acts[1].sfa_flags = O_WRONLY|O_CREAT|O_TRUNC;
+	acts[1].sfa_mode = 0664;
+	acts[2].sfa_op = SPAWN_FDCLOSE;
+	acts[2].sfa_fd = STDERR_FILENO;
+
+	pid = spawn(CATPROG, catargv, acts, 3);
+	if (pid < 0) {
+		err(1, "spawn: %s", CATPROG);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "%s: bad status %d", CATPROG, status);
+	}
+
+	fd = open(OUTFILE, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", OUTFILE);
+	}
+	len = read(fd, buf, sizeof(buf));
+	close(fd);
+	if (len != (ssize_t)strlen(MESSAGE) || memcmp(buf, MESSAGE, len) != 0) {
+		errx(1, "redirected output is wrong");
+	}
+
+	/* a failing action fails the spawn */
+	acts[0].sfa_path = "spawnbench.nonexistent";
+	pid = spawn(CATPROG, catargv, acts, 1);
+	if (pid >= 0 || errno != ENOENT) {
+		errx(1, "spawn with a bad open action did not fail with ENOENT");
+	}
+
+	remove(INFILE);
+	remove(OUTFILE);
+	printf("spawnbench: descriptor actions ok\n");
+}
+
+static
+void
+forkexec(void)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		execv(PROG, progargv);
+		warn("%s", PROG);
+		_exit(1);
+	}
+	collect(pid);
+}
+
+static
+void
+dospawn(void)
+{
+	pid_t pid;
+
+	pid = spawn(PROG, progargv, NULL, 0);
+	if (pid < 0) {
+		err(1, "spawn: %s", PROG);
+	}
+	collect(pid);
+}
+
+static
+void
+bench(const char *name, void (*func)(void), int rounds)
+{
+	time_t secs;
+	unsigned long nsecs, total;
+	int i;
+
+	now(&secs, &nsecs);
+	for (i=0; i<rounds; i++) {
+		func();
+	}
+	total = since(secs, nsecs);
+	printf("spawnbench: %-10s %d rounds, %lu us each\n",
+	       name, rounds, total / rounds);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int rounds = DEFROUNDS;
+
+	if (argc == 2) {
+		rounds = atoi(argv[1]);
+	}
+	if (argc > 2 || rounds < 1) {
+		errx(1, "Usage: spawnbench [rounds]");
+	}
+
+	checkredirect();
+	bench("fork+exec", forkexec, rounds);
+	bench("spawn", dospawn, rounds);
+	return 0;
+}
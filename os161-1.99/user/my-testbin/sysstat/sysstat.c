@@ -0,0 +1,132 @@
+/*
+ * sysstat - print the kernel's system call counts and latencies.
+ *
+ * With no arguments, prints the figures since boot (or since the last
+ * "ss reset" at the menu). Given a program and its arguments, spawns
+ * it, waits for it, and prints only what was done while it ran, by
+ * subtracting a snapshot taken before it started. The counts are
+ * system-wide either way.
+ *
+ * Latencies are shown as the upper bounds of the log2 histogram
+ * buckets that the median and 99th percentile fall in.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/sysstat.h>
+#include <kern/syscall.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <err.h>
+
+static const char *const names[SYSSTAT_NCALLS] = {
+	[SYS_fork] = "fork",
+	[SYS_execv] = "execv",
+	[SYS__exit] = "_exit",
+	[SYS_waitpid] = "waitpid",
+	[SYS_getpid] = "getpid",
+	[SYS_open] = "open",
+	[SYS_close] = "close",
+	[SYS_read] = "read",
+	[SYS_write] = "write",
+	[SYS_lseek] = "lseek",
+	[SYS___time] = "__time",
+	[SYS_spawn] = "spawn",
+	[SYS_futex] = "futex",
+};
+
+static struct sysstat before[SYSSTAT_NCALLS];
+
+static
+void
+snapshot(struct sysstat *ss)
+{
+	int i;
+
+	for (i=0; i<SYSSTAT_NCALLS; i++) {
+		if (__sysstat(i, &ss[i]) < 0) {
+			err(1, "__sysstat");
+		}
+	}
+}
+
+/* upper bound in us of the bucket the PCT'th percentile is in */
+static
+unsigned long
+percentile(const struct sysstat *ss, unsigned long long returned,
+	   unsigned pct)
+{
+	unsigned long long want, seen;
+	int b;
+
+	want = (returned * pct + 99) / 100;
+	seen = 0;
+	for (b=0; b<SYSSTAT_NBUCKETS-1; b++) {
+		seen += ss->ss_hist[b];
+		if (seen >= want) {
+			break;
+		}
+	}
+	return 1UL << b;
+}
+
+static
+void
+show(int callno, const struct sysstat *now, const struct sysstat *then)
+{
+	struct sysstat d;
+	unsigned long long returned;
+	int b;
+
+	d.ss_calls = now->ss_calls - then->ss_calls;
+	d.ss_errors = now->ss_errors - then->ss_errors;
+	d.ss_totalus = now->ss_totalus - then->ss_totalus;
+	returned = 0;
+	for (b=0; b<SYSSTAT_NBUCKETS; b++) {
+		d.ss_hist[b] = now->ss_hist[b] - then->ss_hist[b];
+		returned += d.ss_hist[b];
+	}
+	if (d.ss_calls == 0) {
+		return;
+	}
+
+	if (names[callno] != NULL) {
+		printf("%-12s", names[callno]);
+	}
+	else {
+		printf("#%-11d", callno);
+	}
+	printf(" %9llu %8llu %9llu %9lu %9lu\n",
+	       d.ss_calls, d.ss_errors,
+	       returned ? d.ss_totalus / returned : 0,
+	       percentile(&d, returned, 50), percentile(&d, returned, 99));
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct sysstat now;
+	pid_t pid;
+	int i, status;
+
+	if (argc > 1) {
+		snapshot(before);
+		pid = spawn(argv[1], argv + 1, NULL, 0);
+		if (pid < 0) {
+			err(1, "%s", argv[1]);
+		}
+		if (waitpid(pid, &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+	}
+
+	printf("%-12s %9s %8s %9s %9s %9s\n",
+	       "call", "calls", "errors", "avg us", "p50 <us", "p99 <us");
+	for (i=0; i<SYSSTAT_NCALLS; i++) {
+		if (__sysstat(i, &now) < 0) {
+			err(1, "__sysstat");
+		}
+		show(i, &now, &before[i]);
+	}
+	return 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * waittest - exercise waitpid with WNOHANG and with pid -1.
+ *
+ * Forks several children that each run for a little while and exit
+ * with their own index. A WNOHANG wait for one that is still running
+ * has to come back with 0; then waitpid(-1) has to hand back every
+ * child exactly once, with the right status, after which it has to
+ * fail with ECHILD. Also checks the error cases.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <err.h>
+
+#define NCHILDREN	6
+
+static
+void
+spin(time_t secs)
+{
+	time_t start, now;
+	unsigned long nsecs;
+
+	__time(&start, &nsecs);
+	do {
+		__time(&now, &nsecs);
+	} while (now - start < secs);
+}
+
+int
+main(void)
+{
+	pid_t pids[NCHILDREN], pid;
+	int seen[NCHILDREN];
+	int i, status, failures = 0;
+
+	for (i=0; i<NCHILDREN; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			err(1, "fork");
+		}
+		if (pids[i] == 0) {
+			/* the first one stays around long enough to poll */
+			spin(i == 0 ? 2 : 0);
+			_exit(i);
+		}
+		seen[i] = 0;
+	}
+
+	pid = waitpid(pids[0], &status, WNOHANG);
+	if (pid != 0) {
+		printf("waittest: WNOHANG on a running child gave %d\n", pid);
+		failures++;
+	}
+
+	for (i=0; i<NCHILDREN; i++) {
+		pid = waitpid(-1, &status, 0);
+		if (pid < 0) {
+			err(1, "waitpid(-1)");
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) >= NCHILDREN ||
+		    pids[WEXITSTATUS(status)] != pid) {
+			printf("waittest: pid %d: bad status %d\n",
+			       pid, status);
+			failures++;
+			continue;
+		}
+		seen[WEXITSTATUS(status)]++;
+	}
+	for (i=0; i<NCHILDREN; i++) {
+		if (seen[i] != 1) {
+			printf("waittest: child %d collected %d times\n",
+			       i, seen[i]);
+			failures++;
+		}
+	}
+
+	if (waitpid(-1, &status, 0) >= 0 || errno != ECHILD) {
+		printf("waittest: waitpid(-1) with no children: "
+		       "expected ECHILD\n");
+		failures++;
+	}
+	if (waitpid(-1, &status, WNOHANG) >= 0 || errno != ECHILD) {
+		printf("waittest: WNOHANG with no children: "
+		       "expected ECHILD\n");
+		failures++;
+	}
+	if (waitpid(pids[0], &status, 0) >= 0 || errno != ESRCH) {
+		printf("waittest: waitpid on a collected child: "
+		       "expected ESRCH\n");
+		failures++;
+	}
+	if (waitpid(-1, &status, 0x100) >= 0 || errno != EINVAL) {
+		printf("waittest: bad options: expected EINVAL\n");
+		failures++;
+	}
+
+	if (failures > 0) {
+		printf("waittest: FAILED\n");
+		return 1;
+	}
+	printf("waittest: passed\n");
+	return 0;
+}
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * pmatmult.c
+ *
+ *    Multithreaded matrix multiplication. Multiplies the same
+ *    matrices as matmult (without the huge temporary array) once
+ *    with one thread and once with several, splitting the rows of
+ *    the result among the threads, and reports the speedup.
+ *
+ *    Usage: pmatmult [nthreads]
+ *
+ *    Needs thread_create/thread_join. On a single-cpu machine the
+ *    speedup will of course be about 1.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <err.h>
+
+#define Dim 	72
+#define REPS	10		/* repeat to get a measurable run time */
+#define MAXTHREADS 16
+
+#define RIGHT  8772192		/* correct answer */
+
+int A[Dim][Dim];
+int B[Dim][Dim];
+int C[Dim][Dim];
+
+struct slice {
+	int lo, hi;		/* rows [lo, hi) of C */
+};
+
+static struct slice slices[MAXTHREADS];
+
+static
+void
+multiply(void *arg)
+{
+	struct slice *s = arg;
+	int i, j, k, r, sum;
+
+	for (r = 0; r < REPS; r++) {
+		for (i = s->lo; i < s->hi; i++) {
+			for (j = 0; j < Dim; j++) {
+				sum = 0;
+				for (k = 0; k < Dim; k++) {
+					sum += A[i][k] * B[k][j];
+				}
+				C[i][j] = sum;
+			}
+		}
+	}
+}
+
+/*
+ * Multiply using NTHREADS threads (the calling thread is one of
+ * them). Returns the elapsed time in milliseconds.
+ */
+static
+unsigned
+run(int nthreads)
+{
+	time_t s0, s1;
+	unsigned long ns0, ns1;
+	int tids[MAXTHREADS];
+	int i, r;
+
+	for (i = 0; i < nthreads; i++) {
+		slices[i].lo = Dim * i / nthreads;
+		slices[i].hi = Dim * (i + 1) / nthreads;
+	}
+
+	__time(&s0, &ns0);
+	for (i = 1; i < nthreads; i++) {
+		tids[i] = thread_create(multiply, &slices[i]);
+		if (tids[i] < 0) {
+			err(1, "thread_create");
+		}
+	}
+	multiply(&slices[0]);
+	for (i = 1; i < nthreads; i++) {
+		if (thread_join(tids[i], NULL) < 0) {
+			err(1, "thread_join");
+		}
+	}
+	__time(&s1, &ns1);
+
+	r = 0;
+	for (i = 0; i < Dim; i++) {
+		r += C[i][i];
+	}
+	if (r != RIGHT) {
+		errx(1, "%d threads: answer is %d (should be %d)",
+		     nthreads, r, RIGHT);
+	}
+
+	return (s1 - s0) * 1000 + ns1 / 1000000 - ns0 / 1000000;
+}
+
+int
+main(int argc, char *argv[])
+{
+	int i, j, nthreads;
+	unsigned t1, tn;
+
+	nthreads = 4;
+	if (argc > 1) {
+		nthreads = atoi(argv[1]);
+	}
+	if (nthreads < 1 || nthreads > MAXTHREADS) {
+		errx(1, "Usage: pmatmult [nthreads], at most %d", MAXTHREADS);
+	}
+
+	for (i = 0; i < Dim; i++) {
+		for (j = 0; j < Dim; j++) {
+			A[i][j] = i;
+			B[i][j] = j;
+		}
+	}
+
+	t1 = run(1);
+	tn = run(nthreads);
+
+	printf("pmatmult: 1 thread: %u ms, %d threads: %u ms\n",
+	       t1, nthreads, tn);
+	if (tn > 0) {
+		printf("pmatmult: speedup %u.%02u\n",
+		       t1 / tn, (t1 * 100 / tn) % 100);
+	}
+	printf("Passed.\n");
+	return 0;
+}